@@ -0,0 +1,998 @@
+// bench.cpp - Runtime benchmarks for MiniLisp
+// =============================================================================
+// Build and run all benchmarks:   make bench
+// Run a single benchmark:         ./lisp_bench <name> [args...]
+// List benchmarks:                ./lisp_bench --list
+//
+// Like wasm.cpp, this translation unit includes main.cpp directly and
+// suppresses its main(), so every benchmark drives the real interpreter.
+// Numbers are wall-clock on the current machine; scaling benchmarks sweep
+// worker counts 1, 2, 4 ... up to the number of hardware threads.
+// =============================================================================
+#define MINILISP_NO_MAIN
+#include "main.cpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <sys/resource.h>  // For raising RLIMIT_NOFILE (socket)
+
+using namespace MiniLisp;
+using BenchClock = std::chrono::steady_clock;
+
+static double seconds_since(BenchClock::time_point start) {
+    return std::chrono::duration<double>(BenchClock::now() - start).count();
+}
+
+// 1, 2, 4, ... max_threads (always including max_threads itself)
+static std::vector<size_t> thread_sweep(size_t max_threads) {
+    std::vector<size_t> counts;
+    for (size_t n = 1; n < max_threads; n *= 2) counts.push_back(n);
+    counts.push_back(max_threads);
+    return counts;
+}
+
+static size_t arg_or(int argc, char** argv, int i, size_t fallback) {
+    return argc > i ? std::strtoul(argv[i], nullptr, 10) : fallback;
+}
+
+static size_t hw_threads() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// -----------------------------------------------------------------------------
+// service: closed-loop load generator against EvalService
+//   ./lisp_bench service [requests] [max_workers] [fib_n]
+// Keeps 4 requests in flight per worker and reports throughput and latency.
+// -----------------------------------------------------------------------------
+static void bench_service(int argc, char** argv) {
+    size_t requests = arg_or(argc, argv, 2, 2000);
+    size_t max_workers = arg_or(argc, argv, 3, hw_threads());
+    size_t fib_n = arg_or(argc, argv, 4, 12);
+    std::string call = "(fib " + std::to_string(fib_n) + ")";
+
+    std::printf("service: %zu x %s\n", requests, call.c_str());
+    std::printf("%8s %12s %10s %10s\n", "workers", "req/s", "p50(us)", "p99(us)");
+    for (size_t workers : thread_sweep(max_workers)) {
+        std::mutex m;
+        std::condition_variable cv;
+        size_t completed = 0;
+        EvalService service(workers, [&](const EvalResponse&) {
+            std::lock_guard<std::mutex> lock(m);
+            ++completed;
+            cv.notify_one();
+        });
+        service.submit(0, "(defun fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))");
+        service.drain();
+        service.reset_stats();
+        completed = 0;
+
+        size_t window = workers * 4;
+        auto start = BenchClock::now();
+        for (size_t submitted = 0; submitted < requests; ++submitted) {
+            {
+                std::unique_lock<std::mutex> lock(m);
+                cv.wait(lock, [&] { return submitted - completed < window; });
+            }
+            service.submit(submitted + 1, call);
+        }
+        service.drain();
+        double secs = seconds_since(start);
+
+        const auto& lat = service.latency();
+        std::printf("%8zu %12.0f %10.1f %10.1f\n", workers, requests / secs,
+                    lat.percentile(50) / 1000.0, lat.percentile(99) / 1000.0);
+    }
+}
+
+// Quoted list literal '(0 1 2 ... n-1)
+static std::string quoted_range(size_t n) {
+    std::string src = "'(";
+    for (size_t i = 0; i < n; ++i) {
+        src += std::to_string(i);
+        src += ' ';
+    }
+    src += ')';
+    return src;
+}
+
+// -----------------------------------------------------------------------------
+// pmap: (pmap heavy big-list) on a work-stealing TaskPool
+//   ./lisp_bench pmap [items] [max_threads] [fib_n]
+// Each item costs one (fib fib_n). Threads = pool workers + the caller.
+// -----------------------------------------------------------------------------
+static void bench_pmap(int argc, char** argv) {
+    size_t items = arg_or(argc, argv, 2, 256);
+    size_t max_threads = arg_or(argc, argv, 3, hw_threads());
+    size_t fib_n = arg_or(argc, argv, 4, 12);
+    std::string expr = "(pmap heavy " + quoted_range(items) + ")";
+
+    std::printf("pmap: %zu items x (fib %zu)\n", items, fib_n);
+    std::printf("%8s %10s %10s\n", "threads", "ms", "speedup");
+    double base = 0;
+    for (size_t threads : thread_sweep(max_threads)) {
+        TaskPool pool(threads - 1);
+        Context ctx;
+        ctx.pool = &pool;
+        eval_string("(defun fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))", ctx);
+        eval_string("(defun heavy (x) (+ x (fib " + std::to_string(fib_n) + ")))", ctx);
+        eval_string("(pmap heavy '(1 2 3 4 5 6 7 8))", ctx);  // Warm up the pool
+
+        auto start = BenchClock::now();
+        SExpr result = eval_string(expr, ctx);
+        double secs = seconds_since(start);
+        p_assert(result.list && result.list->size() == items, "pmap returned wrong length");
+        if (threads == 1) base = secs;
+        std::printf("%8zu %10.1f %9.2fx\n", threads, secs * 1000, base / secs);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// future: fork-join fib with (future ...) and lazy task creation
+//   ./lisp_bench future [n] [max_threads]
+// Baseline is plain sequential fib in the same interpreter.
+// -----------------------------------------------------------------------------
+static void bench_future(int argc, char** argv) {
+    size_t n = arg_or(argc, argv, 2, 22);
+    size_t max_threads = arg_or(argc, argv, 3, hw_threads());
+
+    std::printf("future: fib %zu\n", n);
+    std::printf("%8s %10s %10s\n", "threads", "ms", "speedup");
+    double base = 0;
+    {
+        Context ctx;
+        eval_string("(defun fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))", ctx);
+        auto start = BenchClock::now();
+        eval_string("(fib " + std::to_string(n) + ")", ctx);
+        base = seconds_since(start);
+        std::printf("%8s %10.1f %9.2fx\n", "seq", base * 1000, 1.0);
+    }
+    for (size_t threads : thread_sweep(max_threads)) {
+        TaskPool pool(threads - 1);
+        Context ctx;
+        ctx.pool = &pool;
+        eval_string("(defun pfib (n) (if (< n 2) n "
+                    "(+ (future (pfib (- n 1))) (pfib (- n 2)))))", ctx);
+        auto start = BenchClock::now();
+        eval_string("(pfib " + std::to_string(n) + ")", ctx);
+        double secs = seconds_since(start);
+        std::printf("%8zu %10.1f %9.2fx\n", threads, secs * 1000, base / secs);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// parargs: automatic parallel operands on a tree-shaped recursive aggregation
+//   ./lisp_bench parargs [depth] [max_threads]
+// Same unmodified source, Limits::par_args off vs on.
+// -----------------------------------------------------------------------------
+static void bench_parargs(int argc, char** argv) {
+    size_t depth = arg_or(argc, argv, 2, 14);
+    size_t max_threads = arg_or(argc, argv, 3, hw_threads());
+    const char* tsum = "(defun tsum (d) (if (= d 0) 1 (+ (tsum (- d 1)) (tsum (- d 1)))))";
+    std::string call = "(tsum " + std::to_string(depth) + ")";
+
+    std::printf("parargs: %s\n", call.c_str());
+    std::printf("%8s %10s %10s\n", "threads", "ms", "speedup");
+    double base = 0;
+    {
+        Context ctx;
+        eval_string(tsum, ctx);
+        auto start = BenchClock::now();
+        eval_string(call, ctx);
+        base = seconds_since(start);
+        std::printf("%8s %10.1f %9.2fx\n", "off", base * 1000, 1.0);
+    }
+    for (size_t threads : thread_sweep(max_threads)) {
+        TaskPool pool(threads - 1);
+        Context ctx;
+        ctx.pool = &pool;
+        ctx.limits.par_args = true;
+        eval_string(tsum, ctx);
+        auto start = BenchClock::now();
+        eval_string(call, ctx);
+        double secs = seconds_since(start);
+        std::printf("%8zu %10.1f %9.2fx\n", threads, secs * 1000, base / secs);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// actors: message throughput between processes
+//   ./lisp_bench actors [messages] [max_threads]
+// pingpong: two processes making `messages` round trips (two messages each)
+// in rounds of 200: each round trip is a level of recursion in the Lisp loop, and a
+// call copies its caller's bindings, so long loops would measure that instead.
+// ring: a token passed around 1000 processes until `messages` hops are made.
+// Threads = pool workers + the top level; "inline" runs without a pool.
+// -----------------------------------------------------------------------------
+static const char* ACTOR_DEFS =
+    "(defun ponger (n) (if (= n 0) 0 (ponger (- n (+ 1 (* 0 (send (receive) 0)))))))"
+    "(defun pinger (peer n) (if (= n 0) (send 0 n)"
+    "  (pinger peer (- n (+ 1 (* 0 (send peer (self)) (receive)))))))"
+    "(defun node (next laps) (if (= laps 0) 0"
+    "  (node next (- laps (+ 1 (* 0 (send next (+ 1 (receive)))))))))";
+
+static double actor_pingpong(TaskPool* pool, size_t messages) {
+    Context ctx;
+    ctx.pool = pool;
+    eval_string(ACTOR_DEFS, ctx);
+    auto start = BenchClock::now();
+    for (size_t done = 0; done < messages;) {
+        size_t round = std::min<size_t>(200, messages - done);
+        std::string n = std::to_string(round);
+        eval_string("(spawn pinger (spawn ponger " + n + ") " + n + ")", ctx);
+        eval_string("(receive)", ctx);
+        done += round;
+    }
+    return 2.0 * messages / seconds_since(start);  // Each round trip is two messages
+}
+
+static double actor_ring(TaskPool* pool, size_t messages) {
+    constexpr size_t NODES = 1000;
+    size_t laps = std::max<size_t>(1, messages / NODES);
+    Context ctx;
+    ctx.pool = pool;
+    eval_string(ACTOR_DEFS, ctx);
+    std::string spawns;
+    for (size_t i = 1; i <= NODES; ++i) {
+        spawns += "(spawn node " + std::to_string(i == NODES ? 0 : i + 1) + " " +
+                  std::to_string(laps) + ")";
+    }
+    eval_string(spawns, ctx);
+
+    auto start = BenchClock::now();
+    eval_string("(send 1 0)", ctx);
+    for (size_t lap = 0; lap < laps; ++lap) {
+        SExpr token = eval_string("(receive)", ctx);
+        if (lap + 1 < laps) eval_string("(send 1 " + std::to_string(get_long(token)) + ")", ctx);
+    }
+    return static_cast<double>(laps * NODES) / seconds_since(start);
+}
+
+static void bench_actors(int argc, char** argv) {
+    size_t messages = arg_or(argc, argv, 2, 200000);
+    size_t max_threads = arg_or(argc, argv, 3, hw_threads());
+
+    std::printf("actors: %zu messages\n", messages);
+    std::printf("%8s %16s %16s\n", "threads", "pingpong msg/s", "ring(1k) msg/s");
+    std::printf("%8s %16.0f %16.0f\n", "inline",
+                actor_pingpong(nullptr, messages), actor_ring(nullptr, messages));
+    for (size_t threads : thread_sweep(max_threads)) {
+        TaskPool pool(threads - 1);
+        std::printf("%8zu %16.0f %16.0f\n", threads,
+                    actor_pingpong(&pool, messages), actor_ring(&pool, messages));
+    }
+}
+
+// -----------------------------------------------------------------------------
+// parse: bulk loading of a large multi-form rule file
+//   ./lisp_bench parse [megabytes] [max_threads]
+// Compares a plain parse_interned() loop against parse_program() on a pool.
+// Every run starts from a fresh Context so the symbol table begins empty.
+// -----------------------------------------------------------------------------
+static std::string rule_file(size_t bytes) {
+    std::string src;
+    src.reserve(bytes + 256);
+    for (size_t i = 0; src.size() < bytes; ++i) {
+        std::string n = std::to_string(i);
+        src += "(defun rule-" + n + " (x y)\n  (if (< x " + n + ")\n      '(match rule-" + n +
+               " x)\n      (+ (* x y) (- y " + std::to_string(i % 97) + "))))\n";
+    }
+    return src;
+}
+
+static double parse_rate(const std::string& src, TaskPool* pool) {
+    Context ctx;
+    ctx.pool = pool;
+    auto start = BenchClock::now();
+    size_t forms = 0;
+    if (pool) {
+        forms = parse_program(src, ctx).size();
+    } else {
+        std::vector<SExpr> out;
+        std::string_view rest(src);
+        while (has_more_forms(rest)) out.push_back(parse_interned(rest, ctx));
+        forms = out.size();
+    }
+    double secs = seconds_since(start);
+    if (forms == 0) std::abort();
+    return src.size() / 1e6 / secs;
+}
+
+static void bench_parse(int argc, char** argv) {
+    size_t megabytes = arg_or(argc, argv, 2, 32);
+    size_t max_threads = arg_or(argc, argv, 3, hw_threads());
+    std::string src = rule_file(megabytes << 20);
+
+    std::printf("parse: %.1f MB of rule forms\n", src.size() / 1e6);
+    std::printf("%8s %12s\n", "threads", "MB/s");
+    std::printf("%8s %12.1f\n", "seq", parse_rate(src, nullptr));
+    for (size_t threads : thread_sweep(max_threads)) {
+        TaskPool pool(threads - 1);
+        std::printf("%8zu %12.1f\n", threads, parse_rate(src, &pool));
+    }
+}
+
+// -----------------------------------------------------------------------------
+// locations: cost of recording source locations while parsing
+//   ./lisp_bench locations [megabytes] [threads]
+// parse_program() on a generated rule file with and without a SourceMap,
+// sequentially and on a pool. Runs alternate; best of 11, MB/s of source.
+// -----------------------------------------------------------------------------
+static void bench_locations(int argc, char** argv) {
+    size_t megabytes = arg_or(argc, argv, 2, 32);
+    size_t threads = arg_or(argc, argv, 3, hw_threads());
+    std::string src = rule_file(megabytes << 20);
+
+    std::printf("locations: %.1f MB of rule forms\n", src.size() / 1e6);
+    std::printf("%-12s %12s %12s %10s %10s\n", "", "plain MB/s", "mapped MB/s", "overhead", "lists");
+    for (size_t n : {size_t{1}, threads}) {
+        TaskPool pool(n - 1);
+        double best[2] = {1e30, 1e30};
+        size_t lists = 0;
+        for (int rep = 0; rep < 11; ++rep) {
+            for (int mapped = 0; mapped < 2; ++mapped) {
+                Context ctx;
+                ctx.pool = n > 1 ? &pool : nullptr;
+                SourceMap map("rules.lisp");
+                auto start = BenchClock::now();
+                size_t forms = parse_program(src, ctx, mapped ? &map : nullptr).size();
+                best[mapped] = std::min(best[mapped], seconds_since(start));
+                if (forms == 0) std::abort();
+                if (mapped) lists = map.size();
+            }
+        }
+        char label[32];
+        std::snprintf(label, sizeof(label), n > 1 ? "%zu threads" : "sequential", n);
+        std::printf("%-12s %12.1f %12.1f %9.1f%% %10zu\n", label, src.size() / 1e6 / best[0],
+                    src.size() / 1e6 / best[1], (best[1] / best[0] - 1) * 100, lists);
+        if (threads == 1) break;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// tokenize: the structural index behind parse_program
+//   ./lisp_bench tokenize [megabytes]
+// Finding every token start one byte at a time vs index_tokens() with the
+// portable SWAR classifier and with the vector one, then whole parses: a
+// parse_interned() loop vs parse_program() without a pool. Best of 3, MB/s
+// of source.
+// -----------------------------------------------------------------------------
+// The same token starts as index_tokens(), found one byte at a time the way
+// parse_interned() walks its input
+static std::vector<uint32_t> index_bytewise(std::string_view s) {
+    std::vector<uint32_t> starts;
+    starts.reserve(s.size() / 4);
+    size_t i = 0;
+    while (i < s.size()) {
+        char c = s[i];
+        if (c == ' ' || c == '\n' || c == '\t') {
+            ++i;
+            continue;
+        }
+        starts.push_back(static_cast<uint32_t>(i++));
+        if (c == '(' || c == ')' || c == '\'') continue;
+        while (i < s.size() && s[i] != ' ' && s[i] != ')' && s[i] != '\'' &&
+               s[i] != '\n' && s[i] != '\t') {
+            ++i;
+        }
+    }
+    return starts;
+}
+
+static void bench_tokenize(int argc, char** argv) {
+    size_t megabytes = arg_or(argc, argv, 2, 32);
+    std::string src = rule_file(megabytes << 20);
+    auto rate = [&src](const std::function<size_t()>& run) {
+        double best = 1e30;
+        size_t result = 0;
+        for (int rep = 0; rep < 3; ++rep) {
+            auto start = BenchClock::now();
+            result = run();
+            best = std::min(best, seconds_since(start));
+        }
+        if (result == 0) std::abort();
+        return src.size() / 1e6 / best;
+    };
+    size_t tokens = index_bytewise(src).size();
+    if (tokens != index_tokens(src).size()) std::abort();
+
+    std::printf("tokenize: %.1f MB of rule forms (%zu tokens)\n", src.size() / 1e6, tokens);
+    std::printf("%-30s %10s\n", "", "MB/s");
+    std::printf("%-30s %10.1f\n", "token starts, bytewise", rate([&] { return index_bytewise(src).size(); }));
+    std::printf("%-30s %10.1f\n", "index_tokens, SWAR", rate([&] { return index_tokens<classify_block_swar>(src).size(); }));
+    std::printf("%-30s %10.1f\n", "index_tokens, " MINILISP_INDEX_ISA,
+                rate([&] { return index_tokens(src).size(); }));
+    std::printf("%-30s %10.1f\n", "parse_interned loop", rate([&] {
+        Context ctx;
+        std::vector<SExpr> out;
+        std::string_view rest(src);
+        while (has_more_forms(rest)) out.push_back(parse_interned(rest, ctx));
+        return out.size();
+    }));
+    std::printf("%-30s %10.1f\n", "parse_program (indexed)", rate([&] {
+        Context ctx;
+        return parse_program(src, ctx).size();
+    }));
+}
+
+// -----------------------------------------------------------------------------
+// binary: the binary S-expression format vs text
+//   ./lisp_bench binary [megabytes]
+// Encodes a generated rule file's forms, then times getting the same forms
+// back: a parse_interned() loop and parse_program() on the text, and
+// decode_binary() on the encoding, in memory and from a mapped file. Every
+// decode starts from a fresh Context. Best of 3.
+// -----------------------------------------------------------------------------
+static void bench_binary(int argc, char** argv) {
+    size_t megabytes = arg_or(argc, argv, 2, 32);
+    std::string src = rule_file(megabytes << 20);
+    Context source_ctx;
+    std::vector<SExpr> forms = parse_program(src, source_ctx);
+
+    auto best_of_3 = [](const std::function<size_t()>& run) {
+        double best = 1e30;
+        for (int rep = 0; rep < 3; ++rep) {
+            auto start = BenchClock::now();
+            if (run() == 0) std::abort();
+            best = std::min(best, seconds_since(start));
+        }
+        return best;
+    };
+    std::string bin;
+    double encode_secs = best_of_3([&] {
+        bin = encode_binary(forms);
+        return bin.size();
+    });
+    std::string path = "/tmp/lisp_bench_" + std::to_string(::getpid()) + ".mlb";
+    std::FILE* f = std::fopen(path.c_str(), "wb");
+    if (!f || std::fwrite(bin.data(), 1, bin.size(), f) != bin.size()) std::abort();
+    std::fclose(f);
+
+    std::printf("binary: %zu forms, text %.1f MB, binary %.1f MB (%.0f%%)\n", forms.size(),
+                src.size() / 1e6, bin.size() / 1e6, 100.0 * bin.size() / src.size());
+    std::printf("%-28s %10s %12s\n", "", "seconds", "forms/s");
+    auto report = [&forms](const char* what, double secs) {
+        std::printf("%-28s %10.3f %12.0f\n", what, secs, forms.size() / secs);
+    };
+    report("encode_binary", encode_secs);
+    report("parse_interned loop", best_of_3([&] {
+        Context ctx;
+        std::vector<SExpr> out;
+        std::string_view rest(src);
+        while (has_more_forms(rest)) out.push_back(parse_interned(rest, ctx));
+        return out.size();
+    }));
+    report("parse_program", best_of_3([&] {
+        Context ctx;
+        return parse_program(src, ctx).size();
+    }));
+    report("decode_binary", best_of_3([&] {
+        Context ctx;
+        return decode_binary(bin, ctx).size();
+    }));
+    report("decode_binary, mapped file", best_of_3([&] {
+        Context ctx;
+        MappedFile file(path.c_str());
+        return decode_binary(file.view(), ctx).size();
+    }));
+    std::remove(path.c_str());
+}
+
+// -----------------------------------------------------------------------------
+// pipeline: streaming many small expressions through stdin-style input
+//   ./lisp_bench pipeline [expressions]
+// The REPL's loop (getline, parse, eval, print with std::endl) against
+// run_pipeline() (--batch), both reading a file of one expression per line and
+// writing to /dev/null.
+// -----------------------------------------------------------------------------
+static void bench_pipeline(int argc, char** argv) {
+    size_t count = arg_or(argc, argv, 2, 1000000);
+    std::string path = "/tmp/lisp_bench_" + std::to_string(::getpid()) + ".in";
+    {
+        std::string input;
+        for (size_t i = 0; i < count; ++i) input += "(+ " + std::to_string(i) + " (* 2 3))\n";
+        std::FILE* f = std::fopen(path.c_str(), "wb");
+        if (!f || std::fwrite(input.data(), 1, input.size(), f) != input.size()) std::abort();
+        std::fclose(f);
+    }
+    std::printf("pipeline: %zu expressions\n", count);
+    std::printf("%-24s %12s\n", "", "expr/s");
+
+    {
+        Context ctx;
+        std::ifstream in(path);
+        std::ofstream out("/dev/null");
+        auto start = BenchClock::now();
+        std::string line;
+        while (std::getline(in, line)) {
+            std::string_view sv(line);
+            auto result = eval_toplevel(parse_interned(sv, ctx), ctx);
+            out << "=> " << std::get<long>(*result.atom) << std::endl;
+        }
+        std::printf("%-24s %12.0f\n", "REPL loop", count / seconds_since(start));
+    }
+    {
+        Context ctx;
+        int in = ::open(path.c_str(), O_RDONLY);
+        int out = ::open("/dev/null", O_WRONLY);
+        auto start = BenchClock::now();
+        if (run_pipeline(in, out, ctx) != 0) std::abort();
+        std::printf("%-24s %12.0f\n", "run_pipeline (--batch)", count / seconds_since(start));
+        ::close(in);
+        ::close(out);
+    }
+    std::remove(path.c_str());
+}
+
+// -----------------------------------------------------------------------------
+// script: loading a large script file
+//   ./lisp_bench script [megabytes] [threads]
+// Writes a generated rule file to /tmp, then loads it by copying it into a
+// std::string (read()) and by mapping it (load_script), both sequentially and
+// on a pool. Every load starts from a fresh Context; best of 2.
+// -----------------------------------------------------------------------------
+static void bench_script(int argc, char** argv) {
+    size_t megabytes = arg_or(argc, argv, 2, 100);
+    size_t threads = arg_or(argc, argv, 3, hw_threads());
+    std::string path = "/tmp/lisp_bench_" + std::to_string(::getpid()) + ".lisp";
+    size_t bytes = 0;
+    {
+        std::string src = rule_file(megabytes << 20);
+        bytes = src.size();
+        std::FILE* f = std::fopen(path.c_str(), "w");
+        if (!f || std::fwrite(src.data(), 1, src.size(), f) != src.size()) std::abort();
+        std::fclose(f);
+    }
+
+    auto copied = [&path](Context& ctx) {
+        std::string src;
+        int fd = ::open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || ::fstat(fd, &st) != 0) std::abort();
+        src.resize(static_cast<size_t>(st.st_size));
+        for (size_t off = 0; off < src.size();) {
+            ssize_t n = ::read(fd, src.data() + off, src.size() - off);
+            if (n <= 0) std::abort();
+            off += static_cast<size_t>(n);
+        }
+        ::close(fd);
+        return parse_program(src, ctx).size();
+    };
+    auto mapped = [&path](Context& ctx) { return load_script(path.c_str(), ctx).size(); };
+    // Best of 2: the first load of a run also pays for growing the heap
+    auto rate = [bytes](const std::function<size_t(Context&)>& load, TaskPool* pool) {
+        double secs = 1e30;
+        for (int rep = 0; rep < 2; ++rep) {
+            Context ctx;
+            ctx.pool = pool;
+            auto start = BenchClock::now();
+            if (load(ctx) == 0) std::abort();
+            secs = std::min(secs, seconds_since(start));
+        }
+        std::printf("%12.1f %10.3f", bytes / 1e6 / secs, secs);
+    };
+
+    std::printf("script: %.1f MB file\n", bytes / 1e6);
+    std::printf("%-22s %12s %10s\n", "", "MB/s", "seconds");
+    TaskPool pool(threads - 1);
+    for (TaskPool* p : {static_cast<TaskPool*>(nullptr), &pool}) {
+        std::string where = p ? std::to_string(threads) + " threads" : "sequential";
+        std::printf("%-22s", ("read + parse, " + where).c_str());
+        rate(copied, p);
+        std::printf("\n%-22s", ("mmap + parse, " + where).c_str());
+        rate(mapped, p);
+        std::printf("\n");
+    }
+    std::remove(path.c_str());
+}
+
+// -----------------------------------------------------------------------------
+// fuel: cost of fuel checking, and what preemption buys
+//   ./lisp_bench fuel [fib_n] [hog_requests]
+// Times (fib n) with and without a fuel limit (best of 5), then runs one
+// worker shared by a tenant submitting expensive requests and a tenant
+// submitting cheap ones, and reports the cheap tenant's latency.
+// -----------------------------------------------------------------------------
+static const char* FIB_DEF = "(defun fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))";
+
+static double best_of_5(const std::function<void()>& run) {
+    double best = 1e30;
+    for (int i = 0; i < 5; ++i) {
+        auto start = BenchClock::now();
+        run();
+        best = std::min(best, seconds_since(start));
+    }
+    return best;
+}
+
+// p50 and max latency (us) of the cheap tenant's requests
+static std::pair<uint64_t, uint64_t> mixed_tenants(size_t fuel, size_t hogs) {
+    constexpr uint64_t CHEAP = 200;
+    LatencyStats cheap;
+    EvalService service(1, [&](const EvalResponse& r) {
+        if (r.id >= 1000) cheap.record(r.queue_ns + r.eval_ns);
+    }, fuel);
+    service.submit(0, FIB_DEF);
+    for (uint64_t i = 0; i < std::max<uint64_t>(hogs, CHEAP); ++i) {
+        if (i < hogs) service.submit(1 + i, "(fib 22)", 1);
+        if (i < CHEAP) service.submit(1000 + i, "(fib 5)", 2);
+    }
+    service.drain();
+    return {cheap.percentile(50) / 1000, cheap.percentile(100) / 1000};
+}
+
+static void bench_fuel(int argc, char** argv) {
+    size_t fib_n = arg_or(argc, argv, 2, 25);
+    size_t hogs = arg_or(argc, argv, 3, 8);
+    std::string call = "(fib " + std::to_string(fib_n) + ")";
+
+    Context ctx;
+    eval_string(FIB_DEF, ctx);
+    double plain = best_of_5([&] { eval_string(call, ctx); });
+    double fueled = best_of_5([&] {
+        size_t fuel = SIZE_MAX;
+        eval_string_fueled(call, ctx, fuel);
+    });
+    std::printf("fuel: %s\n", call.c_str());
+    std::printf("%12s %10.3fs\n%12s %10.3fs  (%+.1f%%)\n", "unlimited", plain,
+                "fuel check", fueled, (fueled / plain - 1) * 100);
+
+    std::printf("\n1 worker, %zu x (fib 22) from one tenant, 200 x (fib 5) from another\n", hogs);
+    std::printf("%12s %14s %14s\n", "fuel", "cheap p50(us)", "cheap max(us)");
+    for (size_t fuel : {size_t(0), size_t(1000), EvalService::DEFAULT_FUEL}) {
+        auto [p50, max] = mixed_tenants(fuel, hogs);
+        std::printf("%12zu %14llu %14llu\n", fuel, (unsigned long long)p50, (unsigned long long)max);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// evaluator: the call path against the pre-series interpreter
+//   ./lisp_bench evaluator [fib_n] [calls] [baseline_repl] [current_repl]
+// Feeds FIB_DEF and `calls` x (fib n) to each REPL binary on stdin and reports
+// per-call time with process startup subtracted, best of 5, runs interleaved.
+// `make bench-baseline` builds the baseline REPL from the baseline commit.
+// -----------------------------------------------------------------------------
+static double repl_seconds(const std::string& repl, const std::string& input_path) {
+    std::string cmd = repl + " < " + input_path + " > /dev/null";
+    auto start = BenchClock::now();
+    if (std::system(cmd.c_str()) != 0) std::abort();
+    return seconds_since(start);
+}
+
+static void bench_evaluator(int argc, char** argv) {
+    size_t fib_n = arg_or(argc, argv, 2, 25);
+    size_t calls = arg_or(argc, argv, 3, 10);
+    std::string baseline = argc > 4 ? argv[4] : "./lisp_repl_baseline";
+    std::string current = argc > 5 ? argv[5] : "./lisp_repl";
+    std::string call = "(fib " + std::to_string(fib_n) + ")";
+    std::string base_path = "/tmp/lisp_bench_" + std::to_string(::getpid());
+
+    std::string startup_path = base_path + ".def";
+    std::string calls_path = base_path + ".calls";
+    {
+        std::string def = std::string(FIB_DEF) + "\n";
+        std::string input = def;
+        for (size_t i = 0; i < calls; ++i) input += call + "\n";
+        std::ofstream(startup_path) << def;
+        std::ofstream(calls_path) << input;
+    }
+
+    std::printf("evaluator: %zu x %s per run\n", calls, call.c_str());
+    std::printf("%-24s %12s\n", "", "ms/call");
+    Context ctx;
+    eval_string(FIB_DEF, ctx);
+    double in_process = best_of_5([&] { eval_string(call, ctx); });
+    std::printf("%-24s %12.2f\n", "in process", in_process * 1000);
+
+    if (::access(baseline.c_str(), X_OK) != 0 || ::access(current.c_str(), X_OK) != 0) {
+        std::printf("(no %s; run 'make bench-baseline' to compare)\n",
+                    ::access(baseline.c_str(), X_OK) != 0 ? baseline.c_str() : current.c_str());
+    } else {
+        double best[2] = {1e9, 1e9};
+        const std::string* repls[2] = {&baseline, &current};
+        for (int run = 0; run < 5; ++run) {
+            for (int r = 0; r < 2; ++r) {
+                double total = repl_seconds(*repls[r], calls_path);
+                double startup = repl_seconds(*repls[r], startup_path);
+                best[r] = std::min(best[r], (total - startup) / calls);
+            }
+        }
+        std::printf("%-24s %12.2f\n", "baseline REPL", best[0] * 1000);
+        std::printf("%-24s %12.2f  (%+.1f%%)\n", "current REPL", best[1] * 1000,
+                    (best[1] / best[0] - 1) * 100);
+    }
+    std::remove(startup_path.c_str());
+    std::remove(calls_path.c_str());
+}
+
+// -----------------------------------------------------------------------------
+// batch: one rule over many records
+//   ./lisp_bench batch [records]
+// Compares building and evaluating a source string per record with
+// BatchProgram: interpreted, compiled scalar, and compiled in 4 and 8 SIMD
+// lanes. The two slow modes run on the first million records only.
+// -----------------------------------------------------------------------------
+static const char* RULE_DEF =
+    "(defun rule (amount age score)"
+    " (if (> amount 1000) (if (< age 25) (* score 2) (+ score 10)) (- score (/ amount 100))))";
+
+static std::vector<long> rule_records(size_t count) {
+    std::vector<long> args;
+    args.reserve(count * 3);
+    uint64_t seed = 42;
+    for (size_t i = 0; i < count * 3; ++i) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        args.push_back(static_cast<long>((seed >> 33) % 2000));
+    }
+    return args;
+}
+
+static void bench_batch(int argc, char** argv) {
+    size_t records = arg_or(argc, argv, 2, 10000000);
+    std::vector<long> args = rule_records(records);
+    std::vector<long> out(records);
+    Context ctx;
+    eval_string(RULE_DEF, ctx);
+
+    std::printf("batch: %zu records of (rule amount age score)\n", records);
+    std::printf("%-22s %14s\n", "mode", "records/s");
+    auto report = [&](const char* mode, size_t n, double secs) {
+        std::printf("%-22s %14.0f\n", mode, n / secs);
+    };
+
+    size_t sample = std::min<size_t>(records, 1000000);
+    auto start = BenchClock::now();
+    for (size_t r = 0; r < sample; ++r) {
+        std::string src = "(rule " + std::to_string(args[r * 3]) + " " +
+                          std::to_string(args[r * 3 + 1]) + " " + std::to_string(args[r * 3 + 2]) + ")";
+        out[r] = std::get<long>(*eval_string(src, ctx).atom);
+    }
+    report("string + eval_string", sample, seconds_since(start));
+
+    BatchProgram interpreted(ctx, "rule", false);
+    start = BenchClock::now();
+    interpreted.run(std::span<const long>(args.data(), sample * 3), out);
+    report("batch interpreted", sample, seconds_since(start));
+
+    BatchProgram compiled(ctx, "rule");
+    if (!compiled.vectorized()) std::abort();
+    std::vector<long> scalar_out(records);
+    for (size_t lanes : {0, 4, 8}) {
+        compiled.set_lane_width(lanes);
+        start = BenchClock::now();
+        compiled.run(args, lanes ? out : scalar_out);
+        std::string mode = lanes ? "batch " + std::to_string(lanes) + " lanes" : std::string("batch scalar");
+        report(mode.c_str(), records, seconds_since(start));
+    }
+    if (out != scalar_out) std::abort();
+}
+
+// -----------------------------------------------------------------------------
+// print: printing a large list result
+//   ./lisp_bench print [elements]
+// A flat list of mixed numbers and symbols, and the same elements as a list of
+// 8-element sublists. Compares a recursive std::ostringstream printer (what a
+// straightforward operator<< would do) with print_sexpr into a fresh string
+// and into a reused buffer. Best of 5.
+// -----------------------------------------------------------------------------
+static void print_ostream(std::ostream& os, const SExpr& value) {
+    if (value.atom) {
+        if (std::holds_alternative<long>(*value.atom)) {
+            os << std::get<long>(*value.atom);
+        } else {
+            os << std::get<std::string_view>(*value.atom);
+        }
+        return;
+    }
+    os << '(';
+    for (size_t i = 0; i < value.list->size(); ++i) {
+        if (i > 0) os << ' ';
+        print_ostream(os, (*value.list)[i]);
+    }
+    os << ')';
+}
+
+static void bench_print(int argc, char** argv) {
+    size_t elements = arg_or(argc, argv, 2, 1000000);
+    Context ctx;
+    auto element = [&](size_t i) {
+        return i % 4 == 3 ? SExpr{Atom{ctx.symbols.intern("sym" + std::to_string(i % 1000))}}
+                          : SExpr{Atom{static_cast<long>(i * 2654435761u % 100000000) - 50000000}};
+    };
+    List flat, nested, group;
+    for (size_t i = 0; i < elements; ++i) {
+        flat.push_back(element(i));
+        group.push_back(element(i));
+        if (group.size() == 8 || i + 1 == elements) nested.push_back(SExpr{std::exchange(group, {})});
+    }
+    const SExpr shapes[] = {SExpr{std::move(flat)}, SExpr{std::move(nested)}};
+    const char* names[] = {"flat", "8-wide sublists"};
+
+    std::printf("print: %zu elements\n", elements);
+    std::printf("%-16s %-22s %12s %10s\n", "list", "printer", "Melem/s", "MB/s");
+    for (int s = 0; s < 2; ++s) {
+        std::string reused;
+        size_t bytes = 0;
+        auto run = [&](const char* label, auto&& print) {
+            double best = 1e9;
+            for (int rep = 0; rep < 5; ++rep) {
+                auto start = BenchClock::now();
+                bytes = print();
+                best = std::min(best, seconds_since(start));
+            }
+            std::printf("%-16s %-22s %12.1f %10.1f\n", names[s], label, elements / best / 1e6, bytes / best / 1e6);
+        };
+        {
+            std::ostringstream os;
+            print_ostream(os, shapes[s]);
+            if (os.str() != print_sexpr(shapes[s])) std::abort();
+        }
+        run("ostringstream", [&] {
+            std::ostringstream os;
+            print_ostream(os, shapes[s]);
+            return static_cast<size_t>(os.tellp());
+        });
+        run("print_sexpr", [&] { return print_sexpr(shapes[s]).size(); });
+        run("print_sexpr (reused)", [&] {
+            reused.clear();
+            print_sexpr(reused, shapes[s]);
+            return reused.size();
+        });
+    }
+}
+
+// -----------------------------------------------------------------------------
+// socket: load test of the Unix socket server (--listen)
+//   ./lisp_bench socket [max_clients] [requests] [fib_n] [path]
+// One epoll thread drives 1, 10, 100 ... max_clients connections, each with
+// one request in flight (closed loop), and reports requests/s and round-trip
+// latency percentiles. Without `path`, an in-process SocketServer with one
+// worker per hardware thread is started; with it, a running
+// `lisp_repl --listen <path>` is targeted.
+// -----------------------------------------------------------------------------
+static int connect_unix(const std::string& path) {
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.data(), std::min(path.size(), sizeof(addr.sun_path) - 1));
+    if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        std::fprintf(stderr, "cannot connect to %s\n", path.c_str());
+        std::exit(1);
+    }
+    return fd;
+}
+
+static void bench_socket(int argc, char** argv) {
+    size_t max_clients = arg_or(argc, argv, 2, 1000);
+    size_t requests = arg_or(argc, argv, 3, 200000);
+    size_t fib_n = arg_or(argc, argv, 4, 5);
+    std::string path = argc > 5 ? argv[5] : "/tmp/lisp_bench_" + std::to_string(::getpid()) + ".sock";
+
+    // Two descriptors per client when the server is in-process
+    rlimit files;
+    ::getrlimit(RLIMIT_NOFILE, &files);
+    files.rlim_cur = files.rlim_max;
+    ::setrlimit(RLIMIT_NOFILE, &files);
+
+    std::unique_ptr<SocketServer> server;
+    std::thread loop;
+    if (argc <= 5) {
+        server = std::make_unique<SocketServer>(path, hw_threads());
+        loop = std::thread([&] { server->run(); });
+    }
+    {
+        int fd = connect_unix(path);
+        const char def[] = "(defun fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))\n";
+        if (::write(fd, def, sizeof(def) - 1) < 0) std::abort();
+        char buf[64];
+        if (::read(fd, buf, sizeof(buf)) <= 0) std::abort();
+        ::close(fd);
+    }
+
+    std::string call = "(fib " + std::to_string(fib_n) + ")\n";
+    std::printf("socket: %zu x %.*s\n", requests, static_cast<int>(call.size() - 1), call.c_str());
+    std::printf("%8s %12s %10s %10s %10s\n", "clients", "req/s", "p50(us)", "p99(us)", "p99.9(us)");
+    for (size_t clients = 1;; clients = std::min(clients * 10, max_clients)) {
+        struct Client {
+            int fd;
+            BenchClock::time_point sent;
+            std::string in;
+        };
+        std::vector<Client> conns(clients);
+        int ep = ::epoll_create1(EPOLL_CLOEXEC);
+        size_t sent = 0, received = 0;
+        std::vector<uint64_t> rtts;
+        rtts.reserve(requests);
+        auto send_one = [&](Client& c) {
+            c.sent = BenchClock::now();
+            if (::write(c.fd, call.data(), call.size()) != static_cast<ssize_t>(call.size())) std::abort();
+            ++sent;
+        };
+        auto start = BenchClock::now();
+        for (size_t i = 0; i < clients; ++i) {
+            conns[i].fd = connect_unix(path);
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.u64 = i;
+            ::epoll_ctl(ep, EPOLL_CTL_ADD, conns[i].fd, &ev);
+            if (sent < requests) send_one(conns[i]);
+        }
+        epoll_event events[256];
+        while (received < requests) {
+            int n = ::epoll_wait(ep, events, 256, -1);
+            for (int e = 0; e < n; ++e) {
+                Client& c = conns[events[e].data.u64];
+                char buf[256];
+                ssize_t got = ::read(c.fd, buf, sizeof(buf));
+                if (got <= 0) std::abort();
+                c.in.append(buf, static_cast<size_t>(got));
+                if (c.in.back() != '\n') continue;
+                if (c.in.compare(0, 6, "Error:") == 0) std::abort();
+                c.in.clear();
+                rtts.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now() - c.sent).count());
+                ++received;
+                if (sent < requests) send_one(c);
+            }
+        }
+        double secs = seconds_since(start);
+        for (auto& c : conns) ::close(c.fd);
+        ::close(ep);
+
+        std::sort(rtts.begin(), rtts.end());
+        auto pct = [&](double p) { return rtts[std::min(rtts.size() - 1, static_cast<size_t>(p * rtts.size()))] / 1000.0; };
+        std::printf("%8zu %12.0f %10.1f %10.1f %10.1f\n", clients, requests / secs, pct(0.5), pct(0.99), pct(0.999));
+        if (clients >= max_clients) break;
+    }
+    if (server) {
+        server->stop();
+        loop.join();
+    }
+}
+
+struct Benchmark {
+    const char* name;
+    void (*run)(int argc, char** argv);
+    const char* description;
+};
+
+static const Benchmark BENCHMARKS[] = {
+    {"service", bench_service, "EvalService throughput and p99 latency vs worker count"},
+    {"pmap", bench_pmap, "pmap over a list of expensive calls vs thread count"},
+    {"future", bench_future, "Fork-join fib with future vs thread count"},
+    {"parargs", bench_parargs, "Automatic parallel operands (par_args) vs thread count"},
+    {"actors", bench_actors, "Actor ping-pong and 1k-process ring message throughput"},
+    {"batch", bench_batch, "One rule over many records: per-record strings vs BatchProgram"},
+    {"fuel", bench_fuel, "Fuel-check overhead on fib and cheap-tenant latency under preemption"},
+    {"evaluator", bench_evaluator, "fib per-call time: current REPL vs the pre-series baseline REPL"},
+    {"parse", bench_parse, "Bulk parse_program() throughput (MB/s) vs thread count"},
+    {"locations", bench_locations, "parse_program() MB/s with and without a SourceMap"},
+    {"tokenize", bench_tokenize, "Structural index MB/s (bytewise vs SWAR vs SIMD) and parse MB/s"},
+    {"binary", bench_binary, "Binary S-expression encode/decode vs parsing the text"},
+    {"pipeline", bench_pipeline, "Expressions/s: REPL loop vs --batch streaming pipeline"},
+    {"print", bench_print, "Printing a 1M-element list: ostringstream vs print_sexpr"},
+    {"socket", bench_socket, "Unix socket server (--listen) req/s and tail latency vs client count"},
+    {"script", bench_script, "Loading a 100 MB script file: read() copy vs mmap (load_script)"},
+};
+
+int main(int argc, char** argv) {
+    if (argc > 1 && std::strcmp(argv[1], "--list") == 0) {
+        for (const auto& b : BENCHMARKS) std::printf("%-12s %s\n", b.name, b.description);
+        return 0;
+    }
+    bool ran = false;
+    for (const auto& b : BENCHMARKS) {
+        if (argc > 1 && std::strcmp(argv[1], b.name) != 0) continue;
+        if (ran) std::printf("\n");
+        // Benchmarks read their own arguments from argv[2...] when named
+        // explicitly; with no name every benchmark runs with defaults
+        b.run(argc > 1 ? argc : 1, argv);
+        ran = true;
+    }
+    if (!ran) {
+        std::fprintf(stderr, "Unknown benchmark '%s' (try --list)\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
@@ -22,18 +22,71 @@
 #include <numeric>   // for std::transform_reduce (constexpr in C++20)
 #include <functional>  // for std::plus/multiplies
 #include <optional>  // for std::optional (constexpr-friendly)
+#include <type_traits>  // for std::is_constant_evaluated (SExpr destructor)
 #include <list>      // for std::list (stable references)
+#include <atomic>    // for std::atomic (FunctionStore snapshots)
+#include <memory>    // for std::shared_ptr/unique_ptr
+#include <bit>       // for std::countr_zero (parser index), std::bit_ceil
+#include <cstdint>   // for uint32_t/uint64_t
+#include <cstring>   // for std::memcpy/memset (parser index)
+
+// Vector instructions for the parser's structural index (scalar otherwise)
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MINILISP_INDEX_ISA "AVX2"
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define MINILISP_INDEX_ISA "SSE2"
+#else
+#define MINILISP_INDEX_ISA "SWAR"
+#endif
 
 // Conditional includes based on build mode
 #ifndef MINIMAL_BUILD
 #include <iostream>  // For std::cout (standard build)
 #include <string>    // For std::string and std::getline
+#include <coroutine> // For time-sliced evaluation
+#include <utility>   // For std::exchange
+#include <deque>     // For the actor run queue
+#include <unordered_map>  // For per-tenant service queues, binary symbol tables
 #else
 // POSIX I/O for minimal build
 #include <unistd.h>  // For write, read
 #include <cstring>   // For strlen, memset
 #endif
 
+// Threaded runtime (evaluation service, parallel builtins) - native builds only.
+// WASM has no threads and the minimal build stays single-threaded for size.
+#if !defined(MINIMAL_BUILD) && !defined(WASM_BUILD)
+#define MINILISP_THREADS
+#include <thread>              // For std::thread
+#include <mutex>               // For std::mutex
+#include <condition_variable>  // For std::condition_variable
+#include <chrono>              // For latency accounting
+#endif
+
+// Memory-mapped script files and the batch pipeline (POSIX) - native
+// standard build only
+#if !defined(MINIMAL_BUILD) && !defined(WASM_BUILD)
+#include <fcntl.h>     // For open
+#include <sys/mman.h>  // For mmap
+#include <sys/stat.h>  // For fstat
+#include <unistd.h>    // For read, write, close
+#include <cerrno>      // For EINTR
+#include <charconv>    // For std::from_chars (NDJSON requests)
+#include <cctype>      // For std::isalnum (NDJSON requests)
+#include <cstdio>      // For std::snprintf (NDJSON responses)
+#endif
+
+// Unix socket server (epoll) - Linux only
+#if !defined(MINIMAL_BUILD) && !defined(WASM_BUILD) && defined(__linux__)
+#include <sys/epoll.h>    // For epoll_create1, epoll_wait
+#include <sys/eventfd.h>  // For waking the event loop from workers
+#include <sys/socket.h>   // For socket, accept4, send
+#include <sys/un.h>       // For sockaddr_un
+#include <csignal>        // For stopping the server on SIGINT/SIGTERM
+#endif
+
 // 1. A struct that can hold a string at compile-time
 // (Allowed as a template parameter in C++20)
 template <size_t N>
@@ -59,7 +112,7 @@ namespace MiniLisp {
 // Problem: In WASM, the input buffer at offset 1024 gets reused between calls.
 // string_view pointers into this buffer become invalid after the next eval.
 //
-// Solution: Store all symbol strings in a global table (interning). The parser
+// Solution: Store all symbol strings in a per-Context table (interning). The parser
 // returns string_views that point into this permanent table, not the input buffer.
 // This way all symbol references remain valid across multiple eval calls.
 //
@@ -69,22 +122,70 @@ namespace MiniLisp {
 // - Scheme implementations typically use a symbol table
 //
 // Benefits:
-// 1. No lifetime issues - symbols persist for program duration
+// 1. No lifetime issues - symbols persist for the lifetime of their Context
 // 2. Fast comparison - comparing string_views (pointer+len) is fast
 // 3. Memory efficient - each unique symbol stored once
 // 4. Safe copying - Lambda/Env can be copied freely (just string_views)
+//
+// The table is a hash set split into shards, each with its own lock in
+// threaded builds, so several threads can intern at once (parse_program()
+// parses chunks of a file in parallel) with little contention.
 // =============================================================================
 
-struct SymbolTable {
-    // IMPORTANT: Use std::list, NOT std::vector!
-    // When vector grows, it reallocates and moves strings. With SSO (Small String
-    // Optimization), short strings store their data inside the string object.
-    // Moving the string moves the data, invalidating string_views pointing to it.
-    // std::list elements never move, so string_views into them remain valid forever.
-    std::list<std::string> symbols;
+#ifdef MINILISP_THREADS
+using ShardMutex = std::mutex;
+using ShardLock = std::lock_guard<std::mutex>;
+#else
+struct ShardMutex {};
+struct ShardLock { explicit ShardLock(ShardMutex&) {} };
+#endif
+
+class SymbolTable {
+public:
+    // Intern a symbol - returns string_view into permanent storage. Thread-safe.
+    std::string_view intern(std::string_view s) {
+        uint64_t h = hash(s);
+        Shard& shard = shards_[h % SHARDS];
+        ShardLock lock(shard.mutex);
+        return shard.intern(s, h / SHARDS);
+    }
+
+    void clear() {
+        for (auto& shard : shards_) {
+            ShardLock lock(shard.mutex);
+            shard.symbols.clear();
+            shard.slots.clear();
+        }
+    }
+
+    size_t size() {
+        size_t n = 0;
+        for (auto& shard : shards_) {
+            ShardLock lock(shard.mutex);
+            n += shard.symbols.size();
+        }
+        return n;
+    }
+
+private:
+#ifdef MINILISP_THREADS
+    static constexpr size_t SHARDS = 16;
+#else
+    static constexpr size_t SHARDS = 1;
+#endif
+
+    // FNV-1a
+    static uint64_t hash(std::string_view s) {
+        uint64_t h = 14695981039346656037ull;
+        for (char c : s) {
+            h ^= static_cast<unsigned char>(c);
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
 
     // WASM string comparison workaround - explicit character comparison
-    static bool str_equals(const std::string& a, std::string_view b) {
+    static bool str_equals(std::string_view a, std::string_view b) {
         if (a.size() != b.size()) return false;
         for (size_t i = 0; i < a.size(); i++) {
             if (a[i] != b[i]) return false;
@@ -92,35 +193,51 @@ struct SymbolTable {
         return true;
     }
 
-    // Intern a symbol - returns string_view into permanent storage
-    std::string_view intern(std::string_view s) {
-        // Check if already interned (use explicit char comparison for WASM)
-        for (const auto& sym : symbols) {
-            if (str_equals(sym, s)) {
-                return std::string_view(sym);
+    struct Shard {
+        ShardMutex mutex;
+        // IMPORTANT: Use std::list, NOT std::vector!
+        // When vector grows, it reallocates and moves strings. With SSO (Small String
+        // Optimization), short strings store their data inside the string object.
+        // Moving the string moves the data, invalidating string_views pointing to it.
+        // std::list elements never move, so string_views into them remain valid forever.
+        std::list<std::string> symbols;
+        std::vector<std::string_view> slots;  // Open addressing; data() == nullptr = empty
+
+        std::string_view intern(std::string_view s, uint64_t h) {
+            if (slots.size() < 2 * (symbols.size() + 1)) grow();
+            size_t mask = slots.size() - 1;
+            for (size_t i = h & mask;; i = (i + 1) & mask) {
+                if (slots[i].data() == nullptr) {
+                    symbols.push_back(std::string(s));
+                    slots[i] = std::string_view(symbols.back());
+                    return slots[i];
+                }
+                if (str_equals(slots[i], s)) return slots[i];
             }
         }
-        // Add new symbol - list doesn't invalidate references when adding
-        symbols.push_back(std::string(s));
-        return std::string_view(symbols.back());
-    }
 
-    void clear() { symbols.clear(); }
-    size_t size() const { return symbols.size(); }
-};
+        void grow() {
+            std::vector<std::string_view> old = std::move(slots);
+            slots.assign(old.empty() ? 16 : old.size() * 2, std::string_view{});
+            size_t mask = slots.size() - 1;
+            for (auto sym : old) {
+                if (sym.data() == nullptr) continue;
+                size_t i = (hash(sym) / SHARDS) & mask;
+                while (slots[i].data() != nullptr) i = (i + 1) & mask;
+                slots[i] = sym;
+            }
+        }
+    };
 
-// Lazy initialization for WASM compatibility (avoids static init order issues)
-inline SymbolTable* get_symbol_table() {
-    static SymbolTable table;
-    return &table;
-}
+    Shard shards_[SHARDS];
+};
 
 // --- 1. AST (Abstract Syntax Tree) Data Structures ---
 
 struct SExpr; // Forward declaration
 
 // An "Atom" is either a number (long) or a symbol (string_view)
-// For runtime/WASM: string_views point into the global SymbolTable
+// For runtime/WASM: string_views point into the Context's SymbolTable
 // For compile-time: string_views point into the source literal
 using Atom = std::variant<long, std::string_view>;
 
@@ -135,10 +252,94 @@ struct SExpr {
     // Constexpr constructors for ease of use
     constexpr SExpr(Atom a) : atom(std::move(a)), list(std::nullopt) {}
     constexpr SExpr(List l) : atom(std::nullopt), list(std::move(l)) {}
+    constexpr SExpr(SExpr&&) = default;
+    constexpr SExpr& operator=(SExpr&&) = default;
+
+    // Implicit copies and destruction recurse once per nesting level; at
+    // runtime, copy_list() and release_list() bound that so a tree of any
+    // depth can be copied and freed
+    constexpr SExpr(const SExpr& other) : atom(other.atom), list(std::nullopt) {
+        if (!other.list) return;
+        if (std::is_constant_evaluated()) {
+            list = other.list;
+        } else {
+            copy_list(*other.list);
+        }
+    }
+
+    constexpr SExpr& operator=(const SExpr& other) {
+        if (this != &other) *this = SExpr(other);
+        return *this;
+    }
+
+    constexpr ~SExpr() {
+        if (!std::is_constant_evaluated() && list && !list->empty()) release_list();
+    }
+
+    void copy_list(const List& from);
+    void release_list() noexcept;
 };
 
+// Nesting levels below any node being copied or freed that use ordinary
+// recursion; small enough for a WASM stack
+inline constexpr size_t SEXPR_RECURSION_LIMIT = 64;
+
+// Sets `list` to a copy of `from`. Deeper than SEXPR_RECURSION_LIMIT, the
+// rest is copied from a heap stack of (source, copy) pairs. Each copy is
+// sized up front, so the addresses of its nested lists stay valid until
+// they are filled.
+inline void SExpr::copy_list(const List& from) {
+    thread_local size_t depth = 0;
+    if (depth < SEXPR_RECURSION_LIMIT) {
+        struct Nest {
+            size_t& depth;
+            explicit Nest(size_t& d) : depth(d) { ++depth; }
+            ~Nest() { --depth; }
+        } nest(depth);
+        list = from;
+        return;
+    }
+    list.emplace();
+    std::vector<std::pair<const List*, List*>> pending{{&from, &*list}};
+    while (!pending.empty()) {
+        auto [src, dst] = pending.back();
+        pending.pop_back();
+        dst->reserve(src->size());
+        for (const SExpr& item : *src) {
+            if (item.list) {
+                dst->push_back(SExpr{List{}});
+                pending.push_back({&*item.list, &*dst->back().list});
+            } else {
+                dst->push_back(SExpr{*item.atom});
+            }
+        }
+    }
+}
+
+// Frees a non-empty list. Deeper than SEXPR_RECURSION_LIMIT, subtrees are
+// detached onto a heap stack and freed one list at a time, their children's
+// lists already moved out.
+inline void SExpr::release_list() noexcept {
+    thread_local size_t depth = 0;
+    if (depth < SEXPR_RECURSION_LIMIT) {
+        ++depth;
+        list.reset();
+        --depth;
+        return;
+    }
+    std::vector<List> pending;
+    pending.push_back(std::move(*list));
+    while (!pending.empty()) {
+        List next = std::move(pending.back());
+        pending.pop_back();
+        for (SExpr& item : next) {
+            if (item.list && !item.list->empty()) pending.push_back(std::move(*item.list));
+        }
+    }
+}
+
 // A Lambda stores parameter names and body expression
-// With interning, all string_views point to the global SymbolTable,
+// With interning, all string_views point to the Context's SymbolTable,
 // so Lambda can be safely copied without lifetime issues.
 struct Lambda {
     std::vector<std::string_view> params;  // Point into SymbolTable
@@ -152,52 +353,398 @@ struct Lambda {
         } else {
             body.push_back(b);
         }
+        expr_ = body.size() == 1 && body[0].atom.has_value() ? body[0] : SExpr{body};
     }
 
-    SExpr get_body() const {
-        if (body.size() == 1 && body[0].atom.has_value()) {
-            return body[0];
-        }
-        return SExpr{body};
-    }
+    // The expression a call evaluates; built once, so calls don't copy the body
+    const SExpr& get_body() const { return expr_; }
 
     std::string_view get_param(size_t i) const {
         return params[i];
     }
+
+private:
+    SExpr expr_{Atom{0L}};
+};
+
+#ifdef MINILISP_THREADS
+// Purity and cost of one function (see PURITY AND COST ANALYSIS)
+struct FunctionInfo {
+    bool pure = false;   // No side effects anywhere in its call graph
+    size_t cost = 0;     // Static cost estimate; COST_UNBOUNDED if recursive
+};
+#endif
+
+// =============================================================================
+// FUNCTION STORE (RCU)
+// =============================================================================
+// Evaluations look functions up constantly; definitions are rare but must be
+// atomic - a reader sees either the old or the new version, never a mix.
+// The store is therefore read-copy-update:
+//
+// - Readers load the current immutable Snapshot with one atomic load and scan
+//   it. No locks, no reference counting on the hot path.
+// - Writers (serialised by a mutex) copy the snapshot, apply the change, and
+//   publish the copy with an atomic exchange. Lambdas are shared between
+//   snapshots, so a copy is one pointer per function.
+// - The replaced snapshot is retired, not freed: a reader may still hold a
+//   Lambda* from it. Readers announce themselves with a ReadGuard (taken by
+//   eval_toplevel for the whole evaluation); a retired snapshot is freed
+//   once every reader that could have seen it has left (epoch-based
+//   reclamation, see EpochRegistry) - by the write itself, or else by the
+//   first such reader to find, as its outermost ReadGuard ends, that none
+//   is left. Readers check one atomic counter and take the write lock only
+//   while something is retired.
+//
+// Lookups outside any ReadGuard are only safe while no one else can write.
+// =============================================================================
+
+#ifdef MINILISP_THREADS
+// Process-wide reader registry for epoch-based reclamation. A thread holds a
+// slot while it is inside a read section, set to the global epoch it observed
+// when its outermost section began. Something retired at epoch E may be freed
+// once no slot holds an epoch <= E. Slots come in blocks; when every slot is
+// taken, the reader appends a block, so any number of threads can read at once.
+class EpochRegistry {
+public:
+    static EpochRegistry& instance() {
+        static EpochRegistry registry;
+        return registry;
+    }
+
+    ~EpochRegistry() {
+        for (Block* b = first_.next.load(); b;) {
+            Block* next = b->next.load();
+            delete b;
+            b = next;
+        }
+    }
+
+    void enter() {
+        Reader& reader = this_reader();
+        if (reader.depth++ == 0) {
+            reader.slot = claim(reader.last);
+            reader.slot->epoch.store(global_.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+            // Order the announcement before any snapshot load that follows
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    }
+
+    // True when the outermost read section ended
+    bool exit() {
+        Reader& reader = this_reader();
+        if (--reader.depth != 0) return false;
+        // seq_cst: a writer reclaiming concurrently either sees the slot
+        // cleared or has published what it retired before the caller looks
+        reader.slot->epoch.store(0, std::memory_order_seq_cst);
+        reader.slot->used.store(false, std::memory_order_release);
+        reader.last = reader.slot;
+        reader.slot = nullptr;
+        return true;
+    }
+
+    // Called by a writer after unpublishing something; returns its retire epoch
+    uint64_t advance() { return global_.fetch_add(1, std::memory_order_seq_cst); }
+
+    bool safe_to_free(uint64_t retire_epoch) const {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        for (const Block* b = &first_; b; b = b->next.load(std::memory_order_acquire)) {
+            for (const auto& slot : b->slots) {
+                uint64_t e = slot.epoch.load(std::memory_order_acquire);
+                if (e != 0 && e <= retire_epoch) return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> epoch{0};
+        std::atomic<bool> used{false};
+    };
+    static constexpr size_t SLOTS_PER_BLOCK = 64;
+    struct Block {
+        Slot slots[SLOTS_PER_BLOCK];
+        std::atomic<Block*> next{nullptr};
+    };
+    struct Reader {
+        size_t depth = 0;      // Nesting of read sections
+        Slot* slot = nullptr;  // Held while depth > 0
+        Slot* last = nullptr;  // Tried first by the next outermost enter()
+    };
+
+    static Reader& this_reader() {
+        thread_local Reader reader;
+        return reader;
+    }
+
+    static bool try_claim(Slot& slot) {
+        bool expected = false;
+        return !slot.used.load(std::memory_order_relaxed) &&
+               slot.used.compare_exchange_strong(expected, true, std::memory_order_acquire);
+    }
+
+    // A free slot, appending a block if none is left; never waits
+    Slot* claim(Slot* hint) {
+        if (hint && try_claim(*hint)) return hint;
+        for (Block* b = &first_;;) {
+            for (auto& slot : b->slots) {
+                if (try_claim(slot)) return &slot;
+            }
+            Block* next = b->next.load(std::memory_order_acquire);
+            if (!next) {
+                auto* fresh = new Block;
+                if (b->next.compare_exchange_strong(next, fresh, std::memory_order_acq_rel)) {
+                    next = fresh;
+                } else {
+                    delete fresh;  // Another reader appended first; `next` is theirs
+                }
+            }
+            b = next;
+        }
+    }
+
+    std::atomic<uint64_t> global_{1};
+    Block first_;
 };
+#else
+// Single-threaded builds: the only reader that can overlap a write is the
+// writer's own thread (a defun evaluated inside a function body), so a
+// nesting counter is enough.
+class EpochRegistry {
+public:
+    static EpochRegistry& instance() {
+        static EpochRegistry registry;
+        return registry;
+    }
+    void enter() { ++depth_; }
+    bool exit() { return --depth_ == 0; }
+    uint64_t advance() { return 0; }
+    bool safe_to_free(uint64_t) const { return depth_ == 0; }
+
+private:
+    size_t depth_ = 0;
+};
+#endif
 
-// Global function storage - separate from Env to avoid copy issues
-struct FunctionStore {
-    std::vector<std::pair<std::string_view, Lambda>> functions;  // Names are interned
+class FunctionStore {
+public:
+    struct Entry {
+        std::string_view name;               // Interned
+        std::shared_ptr<const Lambda> fn;    // Shared between snapshots
+    };
+    struct Snapshot {
+        std::vector<Entry> functions;
+#ifdef MINILISP_THREADS
+        // Per function, in the same order; filled by the first info() call
+        mutable std::vector<FunctionInfo> analysis;
+        mutable std::once_flag analyzed;
+        mutable std::atomic<size_t> pins{0};  // Live Pins; a pinned snapshot isn't freed
+#endif
 
-    const Lambda* lookup(std::string_view name) const {
-        for (auto it = functions.rbegin(); it != functions.rend(); ++it) {
-            if (it->first == name) return &it->second;
+        const Lambda* find(std::string_view name) const {
+            for (auto it = functions.rbegin(); it != functions.rend(); ++it) {
+                if (it->name == name) return it->fn.get();
+            }
+            return nullptr;
         }
-        return nullptr;
+    };
+
+    // RAII read-side critical section on `store`; nests freely. The
+    // outermost one frees what it was the last to hold back.
+    struct ReadGuard {
+        explicit ReadGuard(FunctionStore& store) : store_(store) { EpochRegistry::instance().enter(); }
+        ~ReadGuard() {
+            if (EpochRegistry::instance().exit()) store_.reclaim_after_read();
+        }
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+
+    private:
+        FunctionStore& store_;
+    };
+
+#ifdef MINILISP_THREADS
+    // Keeps one snapshot alive outside any ReadGuard, so an evaluation spread
+    // over many read sections (a queued, sliced service request) sees the
+    // functions as they were when it was pinned. Move-only.
+    class Pin {
+    public:
+        Pin() = default;
+        Pin(Pin&& other) noexcept
+            : store_(std::exchange(other.store_, nullptr)), snap_(std::exchange(other.snap_, nullptr)) {}
+        Pin& operator=(Pin&& other) noexcept {
+            if (this != &other) {
+                release();
+                store_ = std::exchange(other.store_, nullptr);
+                snap_ = std::exchange(other.snap_, nullptr);
+            }
+            return *this;
+        }
+        ~Pin() { release(); }
+
+        const Snapshot* get() const { return snap_; }
+
+    private:
+        friend class FunctionStore;
+        Pin(FunctionStore* store, const Snapshot* snap) : store_(store), snap_(snap) {}
+        void release() {
+            if (!snap_) return;
+            snap_->pins.fetch_sub(1, std::memory_order_seq_cst);
+            store_->reclaim_after_read();  // It may have been retired meanwhile
+            snap_ = nullptr;
+        }
+        FunctionStore* store_ = nullptr;
+        const Snapshot* snap_ = nullptr;
+    };
+
+    // Pin the current snapshot. The read section keeps it from being freed
+    // until the pin count, checked by reclaim(), does.
+    Pin pin() {
+        ReadGuard guard(*this);
+        const Snapshot* snap = current_.load(std::memory_order_acquire);
+        snap->pins.fetch_add(1, std::memory_order_seq_cst);
+        return Pin(this, snap);
+    }
+#endif
+
+    FunctionStore() : current_(new Snapshot{}) {}
+
+    ~FunctionStore() {
+        delete current_.load(std::memory_order_relaxed);
+        for (auto& r : retired_) delete r.snapshot;
     }
 
+    FunctionStore(const FunctionStore&) = delete;
+    FunctionStore& operator=(const FunctionStore&) = delete;
+
+    // Lock-free; the result stays valid until the caller's ReadGuard ends
+    const Lambda* lookup(std::string_view name) const {
+        return current_.load(std::memory_order_acquire)->find(name);
+    }
+
+    // Current snapshot; valid until the caller's ReadGuard ends
+    const Snapshot& snapshot() const { return *current_.load(std::memory_order_acquire); }
+
     void define(std::string_view name, Lambda fn) {
-        // Remove existing definition with same name
-        functions.erase(
-            std::remove_if(functions.begin(), functions.end(),
-                [&name](const auto& p) { return p.first == name; }),
-            functions.end()
-        );
-        // Name should already be interned by caller
-        functions.push_back({name, std::move(fn)});
+        update([&](std::vector<Entry>& fns) {
+            // Replace any existing definition with the same name
+            fns.erase(std::remove_if(fns.begin(), fns.end(),
+                          [&name](const Entry& e) { return e.name == name; }),
+                      fns.end());
+            // Name should already be interned by caller
+            fns.push_back({name, std::make_shared<const Lambda>(std::move(fn))});
+        });
+    }
+
+    // Forget one definition (no-op if `name` isn't defined)
+    void undefine(std::string_view name) {
+        if (!lookup(name)) return;
+        update([&](std::vector<Entry>& fns) {
+            fns.erase(std::remove_if(fns.begin(), fns.end(),
+                          [&name](const Entry& e) { return e.name == name; }),
+                      fns.end());
+        });
+    }
+
+    void clear() {
+        update([](std::vector<Entry>& fns) { fns.clear(); });
+    }
+
+    size_t size() const { return snapshot().functions.size(); }
+
+#ifdef MINILISP_THREADS
+    // Purity and cost of `name`'s current definition; nullopt if undefined.
+    // A definition can change the analysis of every caller, so it is made
+    // for a whole snapshot, once, when first asked for - defining functions
+    // costs nothing extra, and only --par-args ever asks.
+    std::optional<FunctionInfo> info(std::string_view name) const {
+        const Snapshot* snap = current_.load(std::memory_order_acquire);
+        std::call_once(snap->analyzed, [snap] { snap->analysis = analyze(snap->functions); });
+        for (size_t i = snap->functions.size(); i-- > 0;) {
+            if (snap->functions[i].name == name) return snap->analysis[i];
+        }
+        return std::nullopt;
+    }
+#endif
+
+    // Retired snapshots not yet freed (for tests and monitoring)
+    size_t retired_count() const { return retired_size_.load(std::memory_order_acquire); }
+
+private:
+#ifdef MINILISP_THREADS
+    using WriteLock = std::lock_guard<std::mutex>;
+    std::mutex write_mutex_;
+#else
+    struct NoMutex {};
+    struct WriteLock { explicit WriteLock(NoMutex&) {} };
+    NoMutex write_mutex_;
+#endif
+
+    struct Retired {
+        const Snapshot* snapshot;
+        uint64_t epoch;
+    };
+
+    // Copy-on-write: apply `change` to a private copy, then publish it
+    template <typename F>
+    void update(F&& change) {
+        WriteLock lock(write_mutex_);
+        auto next = std::make_unique<Snapshot>();
+        next->functions = current_.load(std::memory_order_relaxed)->functions;
+        change(next->functions);
+        const Snapshot* old = current_.exchange(next.release(), std::memory_order_seq_cst);
+        retired_.push_back({old, EpochRegistry::instance().advance()});
+        retired_size_.store(retired_.size(), std::memory_order_seq_cst);
+        reclaim();
+    }
+
+    // Free retired snapshots no reader can still see (write lock held)
+    void reclaim() {
+        auto& registry = EpochRegistry::instance();
+        retired_.erase(std::remove_if(retired_.begin(), retired_.end(), [&](const Retired& r) {
+            if (!registry.safe_to_free(r.epoch)) return false;
+#ifdef MINILISP_THREADS
+            if (r.snapshot->pins.load(std::memory_order_seq_cst) != 0) return false;
+#endif
+            delete r.snapshot;
+            return true;
+        }), retired_.end());
+        retired_size_.store(retired_.size(), std::memory_order_release);
+    }
+
+    // A reader left its outermost read section, or a pin was released
+    void reclaim_after_read() {
+        if (retired_size_.load(std::memory_order_seq_cst) == 0) return;
+        WriteLock lock(write_mutex_);
+        reclaim();
     }
 
-    void clear() { functions.clear(); }
-    size_t size() const { return functions.size(); }
+#ifdef MINILISP_THREADS
+    static std::vector<FunctionInfo> analyze(const std::vector<Entry>& fns);  // See FunctionAnalysis
+#endif
+
+    std::atomic<const Snapshot*> current_;
+    std::vector<Retired> retired_;
+    std::atomic<size_t> retired_size_{0};  // retired_.size(), readable without the lock
 };
 
+struct Context; // Forward declaration - Env points back at its owner
+struct Actor;   // Lightweight process (see ACTORS)
+class SourceMap;  // Parsed node -> file:line:col (see SOURCE LOCATIONS)
+
 // Environment for variable bindings only (can be safely copied)
 struct Env {
     std::vector<std::pair<std::string_view, SExpr>> bindings;
-    FunctionStore* fn_store;  // Pointer to shared function store
+    Context* ctx;       // Owning interpreter context (functions, limits)
+    size_t depth = 0;   // Nested user-function calls below the top level
+    bool inline_futures = false;  // (future x) just evaluates x (time-sliced mode)
+    Actor* actor = nullptr;       // Process running this evaluation; nullptr = top level
+#ifdef MINILISP_THREADS
+    size_t* fuel = nullptr;       // Reductions left before preemption; nullptr = unlimited
+#endif
 
-    Env(FunctionStore* store) : fn_store(store) {}
+    Env(Context* c) : ctx(c) {}
 
     const SExpr* lookup(std::string_view name) const {
         for (auto it = bindings.rbegin(); it != bindings.rend(); ++it) {
@@ -206,115 +753,557 @@ struct Env {
         return nullptr;
     }
 
-    const Lambda* lookup_fn(std::string_view name) const {
-        return fn_store ? fn_store->lookup(name) : nullptr;
-    }
+    const Lambda* lookup_fn(std::string_view name) const;
 
     void define(std::string_view name, SExpr value) {
         bindings.push_back({name, std::move(value)});
     }
 
-    void define_fn(std::string_view name, Lambda fn) {
-        if (fn_store) fn_store->define(name, std::move(fn));
-    }
-
-    void clear() {
-        bindings.clear();
-        if (fn_store) fn_store->clear();
-    }
+    void define_fn(std::string_view name, Lambda fn);
+    void clear();
 };
 
+#ifdef MINILISP_THREADS
+// =============================================================================
+// WORK-STEALING TASK POOL
+// =============================================================================
+// Each worker owns a Chase-Lev deque: it pushes and pops tasks at the bottom
+// (LIFO, cache-warm), while idle workers steal from the top (FIFO, oldest and
+// usually largest work first). Threads outside the pool submit through a
+// mutex-protected injection queue.
+//
+// Tasks are intrusive and allocation-free: the spawner owns the Task objects
+// (typically on its stack) and keeps them alive until wait() sees the pending
+// counter reach zero. A waiting thread never blocks - it keeps running other
+// tasks, so nested fork-join cannot deadlock the pool.
+//
+// Deque algorithm: Le, Pop, Cohen, Zappa Nardelli, "Correct and Efficient
+// Work-Stealing for Weak Memory Models" (PPoPP 2013), fixed capacity. A push
+// into a full deque fails and the caller runs the task inline instead.
+// =============================================================================
 
-// --- 2. Parser (String -> AST) ---
+struct Task {
+    void (*fn)(Task*) = nullptr;
+    std::atomic<size_t>* pending = nullptr;  // Decremented once fn returns
+};
 
-// Helper to throw errors (can be used at compile-time or runtime)
-// In C++20, throw in constexpr is allowed as long as it's not executed at compile-time
-constexpr void p_assert(bool cond, [[maybe_unused]] const char* msg) {
-    if (!cond) {
-#ifdef WASM_BUILD
-        __builtin_trap();
-#else
-        throw std::runtime_error(msg);
-#endif
+class WorkStealingDeque {
+public:
+    WorkStealingDeque() {
+        for (auto& slot : buffer_) slot.store(nullptr, std::memory_order_relaxed);
     }
-}
 
-// Helper to skip whitespace
-constexpr void skip_ws(std::string_view& s) {
-    while (!s.empty() && (s[0] == ' ' || s[0] == '\n' || s[0] == '\t')) {
-        s.remove_prefix(1);
+    // Owner only
+    bool push(Task* t) {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t top = top_.load(std::memory_order_acquire);
+        if (b - top >= CAPACITY) return false;
+        buffer_[b & MASK].store(t, std::memory_order_relaxed);
+        bottom_.store(b + 1, std::memory_order_release);  // Publishes the slot to thieves
+        return true;
     }
-}
 
-// Forward-declare main parse function
-constexpr SExpr parse(std::string_view& s);
+    // Owner only
+    Task* pop() {
+        int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = top_.load(std::memory_order_relaxed);
+        if (top > b) {  // Empty
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        Task* t = buffer_[b & MASK].load(std::memory_order_relaxed);
+        if (top == b) {  // Last element - race against thieves
+            if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                              std::memory_order_relaxed)) {
+                t = nullptr;
+            }
+            bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+        return t;
+    }
 
-// Simple string-to-long
-constexpr long s_to_l(std::string_view s) {
-    long res = 0;
-    bool neg = false;
-    if (!s.empty() && s[0] == '-') {
-        neg = true;
-        s.remove_prefix(1);
+    // Any thread
+    Task* steal() {
+        int64_t top = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom_.load(std::memory_order_acquire);
+        if (top >= b) return nullptr;
+        Task* t = buffer_[top & MASK].load(std::memory_order_relaxed);
+        if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                          std::memory_order_relaxed)) {
+            return nullptr;  // Lost the race; caller tries elsewhere
+        }
+        return t;
     }
-    for (char c : s) {
-        if (c >= '0' && c <= '9') {
-            res = res * 10 + (c - '0');
-        } else {
-            p_assert(false, "Invalid number");
+
+    size_t size() const {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t top = top_.load(std::memory_order_relaxed);
+        return b > top ? static_cast<size_t>(b - top) : 0;
+    }
+
+private:
+    static constexpr int64_t CAPACITY = 1 << 12;
+    static constexpr int64_t MASK = CAPACITY - 1;
+    alignas(64) std::atomic<int64_t> top_{0};
+    alignas(64) std::atomic<int64_t> bottom_{0};
+    std::atomic<Task*> buffer_[CAPACITY];
+};
+
+class TaskPool {
+public:
+    // `workers` background threads; the thread calling wait() is one more.
+    // Default: one per hardware thread, minus the caller. Threads start on
+    // first submit, so an unused pool costs nothing.
+    explicit TaskPool(size_t workers = default_workers()) : num_workers_(workers) {}
+
+    ~TaskPool() {
+        stopping_.store(true, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            idle_cv_.notify_all();
         }
+        for (auto& t : threads_) t.join();
     }
-    return neg ? -res : res;
-}
 
-// Parses an atom (number or symbol)
-constexpr Atom parse_atom(std::string_view& s) {
-    size_t len = 0;
-    while (len < s.size() && s[len] != ' ' && s[len] != ')' && s[len] != '\'' && s[len] != '\n' && s[len] != '\t') {
-        len++;
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    static size_t default_workers() {
+        unsigned hw = std::thread::hardware_concurrency();
+        return hw > 1 ? hw - 1 : 0;
     }
-    p_assert(len > 0, "Empty atom");
-    auto val = s.substr(0, len);
-    s.remove_prefix(len);
 
-    // Try to parse as a number
-    bool is_num = !val.empty();
-    size_t start_idx = 0;
+    // Threads that can execute tasks concurrently (workers + the waiter)
+    size_t concurrency() const { return num_workers_ + 1; }
 
-    if (val[0] == '-') {
-        if (val.size() == 1) { // Just "-", that's a symbol
-            is_num = false;
+    // Queue `t`; `*t->pending` must already count it
+    void submit(Task* t) {
+        start();
+        if (current_pool_ == this) {
+            if (!deques_[current_index_]->push(t)) run(t);  // Full: run inline
         } else {
-            start_idx = 1; // Check digits from index 1
+            std::lock_guard<std::mutex> lock(mutex_);
+            injected_.push_back(t);
+            injected_size_.store(injected_.size(), std::memory_order_relaxed);
         }
-    } else if (val[0] < '0' || val[0] > '9') {
-        is_num = false; // Doesn't start with a digit or '-', so not a number
+        if (sleeping_.load(std::memory_order_relaxed) > 0) idle_cv_.notify_one();
     }
-    
-    // If we still think it's a number, check all relevant chars
-    if (is_num) {
-        if (val.size() == start_idx) { // e.g., it was just "-"
-             is_num = false;
-        } else {
-            for(size_t i = start_idx; i < val.size(); ++i) {
-                if (val[i] < '0' || val[i] > '9') {
-                    is_num = false; // Found a non-digit
-                    break;
-                }
+
+    // Help run tasks until `pending` reaches zero
+    void wait(std::atomic<size_t>& pending) {
+        while (pending.load(std::memory_order_acquire) != 0) {
+            if (Task* t = find_work()) {
+                run(t);
+            } else {
+                std::this_thread::yield();
             }
         }
     }
-    
-    if (is_num) {
-        return s_to_l(val);
+
+    // Run one queued task on the calling thread; false if none was found
+    bool try_run_one() {
+        start();
+        Task* t = find_work();
+        if (t) run(t);
+        return t != nullptr;
     }
-    
-    // Otherwise, it's a symbol
-    return val;
-}
 
-// Parses a list: (op arg1 arg2 ...)
-constexpr List parse_list(std::string_view& s) {
+    // True if the calling thread's own queue holds fewer than `n` tasks.
+    // Lazy task creation: only expose more parallelism when it would be used.
+    bool local_queue_below(size_t n) const {
+        if (current_pool_ != this) return injected_size_.load(std::memory_order_relaxed) < n;
+        return deques_[current_index_]->size() < n;
+    }
+
+    // Run body(i) for every i in [0, n) across the pool; blocks until done.
+    // The first exception thrown by any body is rethrown here.
+    template <typename F>
+    void parallel_for(size_t n, F&& body) {
+        struct ForTask : Task {
+            F* body;
+            size_t index;
+            std::exception_ptr* error;
+            std::mutex* error_mutex;
+        };
+        std::vector<ForTask> tasks(n);
+        std::atomic<size_t> pending{n};
+        std::exception_ptr error;
+        std::mutex error_mutex;
+        for (size_t i = 0; i < n; ++i) {
+            auto& t = tasks[i];
+            t.pending = &pending;
+            t.body = &body;
+            t.index = i;
+            t.error = &error;
+            t.error_mutex = &error_mutex;
+            t.fn = [](Task* base) {
+                auto* self = static_cast<ForTask*>(base);
+                try {
+                    (*self->body)(self->index);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(*self->error_mutex);
+                    if (!*self->error) *self->error = std::current_exception();
+                }
+            };
+        }
+        // Submit in reverse so the owner pops index 0 first and thieves take the tail
+        for (size_t i = n; i-- > 1;) submit(&tasks[i]);
+        if (n > 0) {
+            tasks[0].fn(&tasks[0]);
+            pending.fetch_sub(1, std::memory_order_acq_rel);
+        }
+        wait(pending);
+        if (error) std::rethrow_exception(error);
+    }
+
+private:
+    static void run(Task* t) {
+        auto* pending = t->pending;  // `t` may be freed once pending drops
+        t->fn(t);
+        pending->fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    void start() {
+        std::call_once(started_, [this] {
+            for (size_t i = 0; i < num_workers_; ++i) {
+                deques_.push_back(std::make_unique<WorkStealingDeque>());
+            }
+            for (size_t i = 0; i < num_workers_; ++i) {
+                threads_.emplace_back([this, i] { worker_loop(i); });
+            }
+        });
+    }
+
+    // Own deque, then the injection queue, then steal round-robin
+    Task* find_work() {
+        size_t self = current_pool_ == this ? current_index_ : deques_.size();
+        if (self < deques_.size()) {
+            if (Task* t = deques_[self]->pop()) return t;
+        }
+        if (injected_size_.load(std::memory_order_relaxed) > 0) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!injected_.empty()) {
+                Task* t = injected_.front();
+                injected_.pop_front();
+                injected_size_.store(injected_.size(), std::memory_order_relaxed);
+                return t;
+            }
+        }
+        size_t start_at = self < deques_.size() ? self + 1 : steal_hint_++;
+        for (size_t i = 0; i < deques_.size(); ++i) {
+            size_t victim = (start_at + i) % deques_.size();
+            if (victim == self) continue;
+            if (Task* t = deques_[victim]->steal()) return t;
+        }
+        return nullptr;
+    }
+
+    void worker_loop(size_t index) {
+        current_pool_ = this;
+        current_index_ = index;
+        size_t idle_spins = 0;
+        while (!stopping_.load(std::memory_order_acquire)) {
+            if (Task* t = find_work()) {
+                run(t);
+                idle_spins = 0;
+                continue;
+            }
+            if (++idle_spins < 64) {
+                std::this_thread::yield();
+                continue;
+            }
+            // Park briefly; submit() wakes us, the timeout covers lost wakeups
+            std::unique_lock<std::mutex> lock(mutex_);
+            sleeping_.fetch_add(1, std::memory_order_relaxed);
+            idle_cv_.wait_for(lock, std::chrono::milliseconds(1));
+            sleeping_.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    size_t num_workers_;
+    std::once_flag started_;
+    std::vector<std::unique_ptr<WorkStealingDeque>> deques_;  // One per worker
+    std::vector<std::thread> threads_;
+    std::deque<Task*> injected_;
+    std::atomic<size_t> injected_size_{0};
+    std::mutex mutex_;
+    std::condition_variable idle_cv_;
+    std::atomic<size_t> sleeping_{0};
+    std::atomic<bool> stopping_{false};
+    std::atomic<size_t> steal_hint_{0};
+
+    inline static thread_local TaskPool* current_pool_ = nullptr;
+    inline static thread_local size_t current_index_ = 0;
+};
+
+// =============================================================================
+// FUTURES
+// =============================================================================
+// (future expr) hands expr to the TaskPool and immediately yields a handle;
+// (touch x) - or any strict use of x - waits for the value. Handles are lists
+// of the form (#<future> index), recognised by the identity of the tag's
+// storage, so a user symbol spelled "#<future>" is never mistaken for one.
+//
+// Cells live in a per-Context arena for the duration of one top-level
+// evaluation. Tasks may outlive the call that spawned them (a handle can be
+// returned upward), so the arena is only cleared after every spawned task has
+// finished - see eval_toplevel().
+// =============================================================================
+
+inline constexpr char FUTURE_TAG_STORAGE[] = "#<future>";
+inline constexpr std::string_view FUTURE_TAG{FUTURE_TAG_STORAGE};
+
+struct FutureCell : Task {
+    std::optional<SExpr> expr;    // Copied: the spawning frame's AST may die first
+    std::optional<Env> env;       // Private copy of the spawner's bindings
+    std::optional<SExpr> value;
+    std::exception_ptr error;
+    std::atomic<size_t> unresolved{1};  // Reaches 0 once value/error is set
+};
+
+class FutureArena {
+public:
+    // Spawned-but-unfinished tasks; doubles as their Task::pending counter
+    std::atomic<size_t> outstanding{0};
+
+    std::pair<FutureCell*, size_t> create() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cells_.push_back(std::make_unique<FutureCell>());
+        return {cells_.back().get(), cells_.size() - 1};
+    }
+
+    FutureCell* get(size_t index) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return index < cells_.size() ? cells_[index].get() : nullptr;
+    }
+
+    // Only once outstanding == 0
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cells_.clear();
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<FutureCell>> cells_;
+};
+#endif // MINILISP_THREADS
+
+// =============================================================================
+// INTERPRETER CONTEXT (ISOLATE)
+// =============================================================================
+// Everything an interpreter instance mutates lives here: the symbol table, the
+// function store, the top-level environment and its resource limits. By
+// default nothing is shared between two Contexts, so a process can host any
+// number of them and drive each one from its own thread without locking.
+// Contexts may instead share one FunctionStore (see the constructor); the
+// store is safe to read and write from several threads (see FUNCTION STORE),
+// and everything else stays per-Context.
+//
+// A Context must not move once an Env points at it, so it is non-copyable.
+// The WASM build keeps exactly one (see get_context() in wasm.cpp); the
+// native REPL creates one on the stack.
+// =============================================================================
+
+class TaskPool;    // Work-stealing scheduler (threaded builds only)
+class ActorSystem; // Processes spawned in this context (see ACTORS)
+
+// Per-context resource limits, checked by the evaluator
+struct Limits {
+    // Maximum nesting of user-function calls. Deep recursion would otherwise
+    // overflow the native stack and kill every tenant in the process.
+    // Each call costs ~1-2KB of stack, so 3000 fits an 8MB thread stack
+    // even in a -O0 debug build.
+    size_t max_depth = 3000;
+
+    // pmap/preduce run sequentially on lists shorter than this; splitting
+    // small inputs costs more in task overhead than it saves.
+    size_t par_cutoff = 8;
+
+    // Evaluate independent operands in parallel when at least two of them are
+    // calls to pure user functions costing >= par_args_min_cost (see
+    // FunctionStore::analyze) and none of them has side effects. Off by
+    // default: it changes which error is reported first when several operands
+    // fail.
+    bool par_args = false;
+    size_t par_args_min_cost = 64;
+
+    // parse_program() parses in parallel from this input size up
+    size_t par_parse_min_bytes = 256 * 1024;
+
+    // Actors: reduction steps per scheduling slice, and messages a mailbox
+    // holds before senders have to wait (rounded up to a power of two)
+    size_t actor_slice = 2000;
+    size_t mailbox_capacity = 64;
+};
+
+struct Context {
+private:
+    FunctionStore own_functions_;
+public:
+    SymbolTable symbols;
+    FunctionStore& functions;  // Own store, or one shared with other contexts
+    Env env;        // Top-level bindings
+    Limits limits;
+    TaskPool* pool = nullptr;  // Workers for parallel builtins; nullptr = sequential
+    // While set, errors name the file:line:col of the form that failed
+    const SourceMap* locations = nullptr;
+#ifdef MINILISP_THREADS
+    FutureArena futures;       // Cells for (future ...) in the current evaluation
+    // While set, functions are looked up in this pinned snapshot instead of
+    // the store's current one; a definition made here re-pins it
+    FunctionStore::Pin* pinned = nullptr;
+#endif
+#ifndef MINIMAL_BUILD
+    // Created by the first spawn/send/receive (see actors_of). Last member:
+    // its processes use everything above.
+    std::unique_ptr<ActorSystem> actors;
+#ifdef MINILISP_THREADS
+    std::once_flag actors_created;  // Threads may reach actors_of together
+#endif
+#endif
+
+    // With `shared`, definitions are read from and published to that store
+    // (which must outlive the Context) instead of a private one. Lambdas keep
+    // views into the defining Context's symbols, so sharing contexts must
+    // also outlive the store's use.
+    explicit Context(FunctionStore* shared = nullptr)
+        : functions(shared ? *shared : own_functions_), env(this) {}
+    Context(const Context&) = delete;
+    Context& operator=(const Context&) = delete;
+    ~Context();  // Defined once ActorSystem is complete
+
+    std::string_view intern(std::string_view s) { return symbols.intern(s); }
+
+    // Forget all definitions (interned symbols are kept - ASTs may still use them).
+    // With a shared store this clears it for every context.
+    void reset() { env.clear(); }
+};
+
+inline const Lambda* Env::lookup_fn(std::string_view name) const {
+    if (!ctx) return nullptr;
+#ifdef MINILISP_THREADS
+    if (ctx->pinned) [[unlikely]] return ctx->pinned->get()->find(name);
+#endif
+    return ctx->functions.lookup(name);
+}
+
+inline void Env::define_fn(std::string_view name, Lambda fn) {
+    if (!ctx) return;
+    ctx->functions.define(name, std::move(fn));
+#ifdef MINILISP_THREADS
+    if (ctx->pinned) *ctx->pinned = ctx->functions.pin();  // See its own definition
+#endif
+}
+
+inline void Env::clear() {
+    bindings.clear();
+    if (!ctx) return;
+    ctx->functions.clear();
+#ifdef MINILISP_THREADS
+    if (ctx->pinned) *ctx->pinned = ctx->functions.pin();
+#endif
+}
+
+#ifdef MINIMAL_BUILD
+inline Context::~Context() = default;
+#endif
+
+
+
+// --- 2. Parser (String -> AST) ---
+
+// Helper to throw errors (can be used at compile-time or runtime)
+// In C++20, throw in constexpr is allowed as long as it's not executed at compile-time
+constexpr void p_assert(bool cond, [[maybe_unused]] const char* msg) {
+    if (!cond) {
+#ifdef WASM_BUILD
+        __builtin_trap();
+#else
+        throw std::runtime_error(msg);
+#endif
+    }
+}
+
+// Helper to skip whitespace
+constexpr void skip_ws(std::string_view& s) {
+    while (!s.empty() && (s[0] == ' ' || s[0] == '\n' || s[0] == '\t')) {
+        s.remove_prefix(1);
+    }
+}
+
+// Forward-declare main parse function
+constexpr SExpr parse(std::string_view& s);
+
+// Simple string-to-long
+constexpr long s_to_l(std::string_view s) {
+    long res = 0;
+    bool neg = false;
+    if (!s.empty() && s[0] == '-') {
+        neg = true;
+        s.remove_prefix(1);
+    }
+    for (char c : s) {
+        if (c >= '0' && c <= '9') {
+            res = res * 10 + (c - '0');
+        } else {
+            p_assert(false, "Invalid number");
+        }
+    }
+    return neg ? -res : res;
+}
+
+// Parses an atom (number or symbol)
+constexpr Atom parse_atom(std::string_view& s) {
+    size_t len = 0;
+    while (len < s.size() && s[len] != ' ' && s[len] != ')' && s[len] != '\'' && s[len] != '\n' && s[len] != '\t') {
+        len++;
+    }
+    p_assert(len > 0, "Empty atom");
+    auto val = s.substr(0, len);
+    s.remove_prefix(len);
+
+    // Try to parse as a number
+    bool is_num = !val.empty();
+    size_t start_idx = 0;
+
+    if (val[0] == '-') {
+        if (val.size() == 1) { // Just "-", that's a symbol
+            is_num = false;
+        } else {
+            start_idx = 1; // Check digits from index 1
+        }
+    } else if (val[0] < '0' || val[0] > '9') {
+        is_num = false; // Doesn't start with a digit or '-', so not a number
+    }
+    
+    // If we still think it's a number, check all relevant chars
+    if (is_num) {
+        if (val.size() == start_idx) { // e.g., it was just "-"
+             is_num = false;
+        } else {
+            for(size_t i = start_idx; i < val.size(); ++i) {
+                if (val[i] < '0' || val[i] > '9') {
+                    is_num = false; // Found a non-digit
+                    break;
+                }
+            }
+        }
+    }
+    
+    if (is_num) {
+        return s_to_l(val);
+    }
+    
+    // Otherwise, it's a symbol
+    return val;
+}
+
+// Parses a list: (op arg1 arg2 ...)
+constexpr List parse_list(std::string_view& s) {
     s.remove_prefix(1); // Eat '('
     List list;
     while (true) {
@@ -355,25 +1344,15 @@ constexpr SExpr parse(std::string_view& s) {
 // RUNTIME PARSER WITH INTERNING
 // =============================================================================
 // This parser is used for WASM and runtime evaluation. It interns all symbols
-// into the global SymbolTable, ensuring string_views remain valid forever.
+// into the Context's SymbolTable, ensuring string_views remain valid for as
+// long as the Context lives.
 // The constexpr parser above is used for compile-time evaluation where
 // string_views point into compile-time string literals (always valid).
 // =============================================================================
 
-// Forward declarations for interning parser
-SExpr parse_interned(std::string_view& s);
-
-// Parse atom with interning - symbols go into the global table
-Atom parse_atom_interned(std::string_view& s) {
-    size_t len = 0;
-    while (len < s.size() && s[len] != ' ' && s[len] != ')' &&
-           s[len] != '\'' && s[len] != '\n' && s[len] != '\t') {
-        len++;
-    }
-    p_assert(len > 0, "Empty atom");
-    auto val = s.substr(0, len);
-    s.remove_prefix(len);
-
+// Atom for the text of one token: a number, or a symbol interned into the
+// context's table
+Atom intern_atom(std::string_view val, Context& ctx) {
     // Check if it's a number
     bool is_num = !val.empty();
     size_t start_idx = 0;
@@ -406,74 +1385,840 @@ Atom parse_atom_interned(std::string_view& s) {
     }
 
     // INTERN the symbol - this is the key difference from constexpr parse
-    return get_symbol_table()->intern(val);
+    return ctx.intern(val);
 }
 
-// Parse list with interning
-List parse_list_interned(std::string_view& s) {
-    s.remove_prefix(1); // Eat '('
-    List list;
+// Parse atom with interning - symbols go into the context's table
+Atom parse_atom_interned(std::string_view& s, Context& ctx) {
+    size_t len = 0;
+    while (len < s.size() && s[len] != ' ' && s[len] != ')' &&
+           s[len] != '\'' && s[len] != '\n' && s[len] != '\t') {
+        len++;
+    }
+    p_assert(len > 0, "Empty atom");
+    auto val = s.substr(0, len);
+    s.remove_prefix(len);
+    return intern_atom(val, ctx);
+}
+
+// Main interning parse function. Unfinished lists wait on an explicit
+// stack rather than the call stack, so nesting depth is bounded only by
+// memory; errors match the recursive constexpr parse().
+SExpr parse_interned(std::string_view& s, Context& ctx) {
+    struct Open {
+        List list;
+        bool quote;  // (quote ...) waiting for its one operand
+    };
+    std::vector<Open> open;
     while (true) {
         skip_ws(s);
-        p_assert(!s.empty(), "Unterminated list");
-        if (s[0] == ')') {
+        bool in_list = !open.empty() && !open.back().quote;
+        p_assert(!s.empty(), in_list ? "Unterminated list" : "Unexpected end of input");
+
+        // Handle ' (quote) sugar
+        if (s[0] == '\'') {
+            s.remove_prefix(1); // Eat '
+            List quote_list;
+            quote_list.reserve(2);
+            quote_list.push_back(SExpr{Atom{ctx.intern("quote")}});
+            open.push_back({std::move(quote_list), true});
+            continue;
+        }
+        if (s[0] == '(') {
+            s.remove_prefix(1); // Eat '('
+            open.push_back({List{}, false});
+            continue;
+        }
+
+        std::optional<SExpr> value;
+        if (in_list && s[0] == ')') {
             s.remove_prefix(1); // Eat ')'
-            return list;
+            value.emplace(std::move(open.back().list));
+            open.pop_back();
+        } else {
+            value.emplace(parse_atom_interned(s, ctx));
+        }
+        // A finished value completes any quotes waiting for it
+        while (!open.empty() && open.back().quote) {
+            open.back().list.push_back(std::move(*value));
+            value.emplace(std::move(open.back().list));
+            open.pop_back();
         }
-        list.push_back(parse_interned(s));
+        if (open.empty()) return std::move(*value);
+        open.back().list.push_back(std::move(*value));
     }
 }
 
-// Main interning parse function
-SExpr parse_interned(std::string_view& s) {
+// Skip whitespace, then report whether any input is left
+inline bool has_more_forms(std::string_view& s) {
     skip_ws(s);
-    p_assert(!s.empty(), "Unexpected end of input");
+    return !s.empty();
+}
 
-    // Handle ' (quote) sugar
-    if (s[0] == '\'') {
-        s.remove_prefix(1); // Eat '
-        List quote_list;
-        // Intern "quote" symbol
-        quote_list.push_back(SExpr{Atom{get_symbol_table()->intern("quote")}});
-        quote_list.push_back(parse_interned(s));
-        return SExpr{quote_list};
-    }
+// --- Bulk loading ---
+// Rule files hold tens of thousands of independent top-level forms. Loading
+// them is two passes: a structural index of the whole input (where every
+// token starts and every atom ends, found 64 bytes at a time), then parsing
+// from that index, which for large inputs runs in chunks of forms on the
+// Context's TaskPool. Symbols are interned into the shared, sharded
+// SymbolTable, so the resulting ASTs are interchangeable with ones from
+// parse_interned().
 
-    if (s[0] == '(') {
-        return SExpr{parse_list_interned(s)};
-    } else {
-        return SExpr{parse_atom_interned(s)};
+// One bit per byte of a 64-byte block for each character class the grammar
+// cares about
+struct BlockMasks {
+    uint64_t ws;     // ' ', '\n', '\t'
+    uint64_t open;   // '('
+    uint64_t close;  // ')'
+    uint64_t quote;  // '\''
+};
+
+// Portable version: eight bytes per step (SWAR). Bytes equal to `c` become
+// 0x80 - exactly, with no carries between bytes - and a multiply gathers the
+// eight flags into one byte.
+inline uint64_t match_bytes_swar(const char* p, char c) {
+    constexpr uint64_t LOW7 = 0x7F7F7F7F7F7F7F7FULL;
+    uint64_t mask = 0;
+    for (int w = 0; w < 8; ++w) {
+        uint64_t x;
+        std::memcpy(&x, p + w * 8, 8);
+        x ^= 0x0101010101010101ULL * static_cast<unsigned char>(c);
+        uint64_t zero = ~(((x & LOW7) + LOW7) | x | LOW7);
+        mask |= (((zero >> 7) * 0x0102040810204080ULL) >> 56) << (w * 8);
     }
+    return mask;
 }
 
+inline BlockMasks classify_block_swar(const char* p) {
+    return {match_bytes_swar(p, ' ') | match_bytes_swar(p, '\n') | match_bytes_swar(p, '\t'),
+            match_bytes_swar(p, '('), match_bytes_swar(p, ')'), match_bytes_swar(p, '\'')};
+}
 
-// --- 3. Evaluator (AST -> Value) ---
+inline BlockMasks classify_block(const char* p) {
+#if defined(__AVX2__)
+    auto match = [](__m256i lo, __m256i hi, char c) {
+        __m256i v = _mm256_set1_epi8(c);
+        uint64_t l = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, v)));
+        uint64_t h = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, v)));
+        return l | (h << 32);
+    };
+    __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+    return {match(lo, hi, ' ') | match(lo, hi, '\n') | match(lo, hi, '\t'),
+            match(lo, hi, '('), match(lo, hi, ')'), match(lo, hi, '\'')};
+#elif defined(__SSE2__)
+    __m128i in[4];
+    for (int i = 0; i < 4; ++i) in[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * i));
+    auto match = [&in](char c) {
+        __m128i v = _mm_set1_epi8(c);
+        uint64_t mask = 0;
+        for (int i = 0; i < 4; ++i) {
+            mask |= static_cast<uint64_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(in[i], v)) & 0xFFFF) << (16 * i);
+        }
+        return mask;
+    };
+    return {match(' ') | match('\n') | match('\t'), match('('), match(')'), match('\'')};
+#else
+    return classify_block_swar(p);
+#endif
+}
 
-constexpr SExpr eval(const SExpr& expr); // Forward declare
+// Where every token of a source text starts: each '(' that opens a list,
+// each ')' and '\'', and each atom's first byte - ascending, as 32-bit
+// offsets (so the input must be under 4 GiB). Atom ends come from a bitmap
+// of terminators (whitespace, ')' and '\'') rather than a second list.
+struct TokenIndex {
+    std::unique_ptr<uint32_t[]> starts;
+    size_t count = 0;
+    size_t capacity = 0;
+    std::vector<uint64_t> terminators;  // Also set at src.size()
 
-// Helper to extract a long from an evaluated SExpr
-constexpr long get_long(const SExpr& e) {
-    p_assert(e.atom.has_value(), "Expected a number");
-    const auto& atom = *e.atom;
-    p_assert(std::holds_alternative<long>(atom), "Expected a number");
-    return std::get<long>(atom);
+    size_t size() const { return count; }
+    uint32_t operator[](size_t i) const { return starts[i]; }
+
+    // One past the last byte of the atom starting at `pos`
+    size_t atom_end(size_t pos) const {
+        size_t w = pos / 64;
+        uint64_t bits = terminators[w] & (~0ULL << (pos % 64));
+        while (!bits) bits = terminators[++w];
+        return w * 64 + std::countr_zero(bits);
+    }
+};
+
+// Build the index a 64-byte block at a time. Atoms end only at whitespace,
+// ')' or '\'', so each maximal run of other bytes is some '(' that open
+// lists followed by at most one atom ("((f(g" is two opens and the atom
+// "f(g"); a carry-propagating add finds each run's leading '(' chain. Three
+// bits carry state across blocks, and the last block is padded with spaces.
+// Positions are written in groups of four without checking the count first
+// (as simdjson does), so the buffer keeps 64 entries of slack.
+template <BlockMasks (*Classify)(const char*) = classify_block>
+TokenIndex index_tokens(std::string_view src) {
+    p_assert(src.size() < UINT32_MAX, "Source too large to index");
+    TokenIndex index;
+    index.capacity = src.size() / 4 + 128;
+    index.starts.reset(new uint32_t[index.capacity]);
+    index.terminators.resize(src.size() / 64 + 1);
+    uint64_t prev_run = 0, prev_open = 0;  // Bit 63 of the last block
+    char tail[64];
+    for (size_t base = 0; base <= src.size(); base += 64) {
+        const char* block = src.data() + base;
+        if (src.size() - base < 64) {
+            std::memset(tail, ' ', sizeof(tail));
+            if (base < src.size()) std::memcpy(tail, block, src.size() - base);
+            block = tail;
+        }
+        BlockMasks m = Classify(block);
+        uint64_t ends = m.ws | m.close | m.quote;
+        uint64_t run = ~ends;
+        uint64_t run_start = run & ~((run << 1) | prev_run);
+        uint64_t lead = (run_start | prev_open) & m.open;       // Where each '(' chain begins
+        uint64_t opens = ((m.open + lead) ^ m.open) & m.open;   // Whole chains
+        uint64_t atom_start = run & ~opens & ((opens << 1) | run_start | prev_open);
+        prev_run = run >> 63;
+        prev_open = opens >> 63;
+        index.terminators[base / 64] = ends;
+
+        uint64_t bits = opens | m.close | m.quote | atom_start;
+        if (index.count + 64 > index.capacity) {
+            index.capacity *= 2;
+            std::unique_ptr<uint32_t[]> grown(new uint32_t[index.capacity]);
+            std::memcpy(grown.get(), index.starts.get(), index.count * sizeof(uint32_t));
+            index.starts = std::move(grown);
+        }
+        uint32_t* out = index.starts.get() + index.count;
+        uint32_t at = static_cast<uint32_t>(base);
+        size_t n = static_cast<size_t>(std::popcount(bits));
+        for (size_t i = 0; i < n; i += 4) {
+            out[i] = at + std::countr_zero(bits);
+            bits &= bits - 1;
+            out[i + 1] = at + std::countr_zero(bits);
+            bits &= bits - 1;
+            out[i + 2] = at + std::countr_zero(bits);
+            bits &= bits - 1;
+            out[i + 3] = at + std::countr_zero(bits);
+            bits &= bits - 1;
+        }
+        index.count += n;
+    }
+    return index;
+}
+
+// Index of the first token of every top-level form, then tokens.size().
+// Mirrors parse_interned(), so each form parses the same way in isolation as
+// in sequence; malformed input still yields a form, and parsing it reports
+// the error (a stray ')' is a one-token form). With `ends`, also the byte
+// offset where each form's text ends.
+inline std::vector<uint32_t> index_forms(std::string_view src, const TokenIndex& tokens,
+                                         std::vector<size_t>* ends = nullptr) {
+    std::vector<uint32_t> forms;
+    size_t t = 0;
+    while (t < tokens.size()) {
+        forms.push_back(static_cast<uint32_t>(t));
+        size_t depth = 0;
+        size_t end = src.size();                  // Unterminated
+        while (t < tokens.size()) {
+            char c = src[tokens[t]];
+            if (c == '\'') {
+                ++t;                              // Quote prefixes the next datum
+                continue;
+            }
+            if (c == '(') {
+                ++depth;
+                ++t;
+                continue;
+            }
+            if (c == ')') {
+                if (depth > 0) --depth;
+                end = tokens[t] + 1;
+            } else if (depth == 0 && ends) {
+                end = tokens.atom_end(tokens[t]);
+            }
+            ++t;
+            if (depth == 0) break;
+            end = src.size();
+        }
+        if (ends) ends->push_back(end);
+    }
+    forms.push_back(static_cast<uint32_t>(tokens.size()));
+    return forms;
 }
 
 // =============================================================================
-// WASM STRING COMPARISON WORKAROUND
+// SOURCE LOCATIONS
 // =============================================================================
-// In WASM, string_view::operator== with string literals doesn't work
-// reliably for interned symbols. This helper performs explicit char-by-char
-// comparison which works correctly in both native and WASM builds.
-// Marked constexpr so it works for compile-time evaluation too.
-// Using __attribute__((noinline)) to prevent WASM optimizer issues.
+// parse_program(src, ctx, &map) records where each list starts in a SourceMap
+// kept beside the AST, so SExpr stays the same size and parsing without a map
+// costs nothing. A List's element buffer stays put when its SExpr is moved,
+// so the buffer's address names the node for as long as the AST lives. Copies
+// are new nodes without a location; this includes function bodies, which
+// defun copies. Recording is one 16-byte entry per list, plus one memchr pass
+// over the source for line starts.
+//
+// While ctx.locations points at a map, an error leaving eval_with_env becomes
+// a SourceError. It names the innermost list being evaluated that the map
+// knows: the failing call, or for an error inside a function, the top-level
+// form that called it. Syntax errors from parse_program with a map name the
+// token where parsing stopped.
 // =============================================================================
-#ifdef WASM_BUILD
-__attribute__((noinline))
-#endif
-constexpr bool str_eq(std::string_view sv, const char* s) {
-    size_t len = 0;
-    while (s[len]) len++;
+
+class SourceError : public std::runtime_error {
+public:
+    SourceError(std::string location, const std::string& message)
+        : std::runtime_error(location + ": " + message),
+          location_(std::move(location)), message_(message) {}
+
+    const std::string& location() const { return location_; }  // file:line:col
+    const std::string& message() const { return message_; }
+
+private:
+    std::string location_;
+    std::string message_;
+};
+
+class SourceMap {
+public:
+    struct Location {
+        uint32_t line;    // 1-based
+        uint32_t column;  // 1-based, in bytes
+    };
+
+    struct Entry {
+        const SExpr* node;  // The List's element buffer
+        uint32_t offset;    // Byte offset of its '(' (or ')
+    };
+
+    explicit SourceMap(std::string name = "<input>") : name_(std::move(name)) {}
+
+    const std::string& name() const { return name_; }
+
+    // Lists recorded
+    size_t size() const {
+        size_t n = entries_.size();
+        for (const auto& part : added_) n += part.size();
+        return n;
+    }
+
+    // Start over for `src` (called by parse_program)
+    void reset(std::string_view src) {
+        entries_.clear();
+        added_.clear();
+        line_starts_.assign(1, 0);
+        const char* end = src.data() + src.size();
+        for (const char* p = src.data(); p != end;) {
+            p = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+            if (!p) break;
+            line_starts_.push_back(static_cast<uint32_t>(++p - src.data()));
+        }
+    }
+
+    // Add a parse's entries. They are merged and sorted by the next locate(),
+    // so parsing never pays for it.
+    void add(std::vector<Entry>&& entries) { added_.push_back(std::move(entries)); }
+
+    Location at(uint32_t offset) const {
+        auto line = std::upper_bound(line_starts_.begin(), line_starts_.end(), offset) - line_starts_.begin();
+        return {static_cast<uint32_t>(line), offset - line_starts_[line - 1] + 1};
+    }
+
+    // Where a parsed list came from, if this map recorded it. Safe to call
+    // from several threads; the first call sorts the entries.
+    std::optional<Location> locate(const List& list) const {
+        if (list.empty()) return std::nullopt;
+        {
+#ifdef MINILISP_THREADS
+            std::lock_guard<std::mutex> lock(sort_mutex_);
+#endif
+            if (!added_.empty()) {
+                for (auto& part : added_) entries_.insert(entries_.end(), part.begin(), part.end());
+                added_.clear();
+                std::sort(entries_.begin(), entries_.end(),
+                          [](const Entry& a, const Entry& b) { return a.node < b.node; });
+            }
+        }
+        auto it = std::lower_bound(entries_.begin(), entries_.end(), list.data(),
+                                   [](const Entry& e, const SExpr* node) { return e.node < node; });
+        if (it == entries_.end() || it->node != list.data()) return std::nullopt;
+        return at(it->offset);
+    }
+
+    std::string describe(Location loc) const {
+        return name_ + ":" + std::to_string(loc.line) + ":" + std::to_string(loc.column);
+    }
+
+private:
+    std::string name_;
+    std::vector<uint32_t> line_starts_{0};  // Offset of each line's first byte
+    mutable std::vector<Entry> entries_;    // Sorted by node
+    mutable std::vector<std::vector<Entry>> added_;  // Not yet in entries_
+#ifdef MINILISP_THREADS
+    mutable std::mutex sort_mutex_;
+#endif
+};
+
+// Working storage for parse_indexed(), reused from form to form
+struct ParseScratch {
+    struct Open {
+        size_t mark;  // Where the list's elements start in `items`
+        size_t pos;   // Byte offset of its '(' or '\''
+        bool quote;   // (quote ...) waiting for its one operand
+    };
+    std::vector<SExpr> items;
+    std::vector<Open> open;
+};
+
+// parse_interned() over tokens [t, end), without recursion. The elements of
+// unfinished lists wait on `scratch.items`, so each List is allocated once,
+// at its final size. With `located`, every non-empty list is recorded there.
+SExpr parse_indexed(std::string_view src, const TokenIndex& tokens, size_t& t, size_t end,
+                    Context& ctx, ParseScratch& scratch,
+                    std::vector<SourceMap::Entry>* located = nullptr) {
+    // A failed parse may have left work behind
+    scratch.items.clear();
+    scratch.open.clear();
+    auto& items = scratch.items;
+    auto& open = scratch.open;
+    while (true) {
+        bool in_list = !open.empty() && !open.back().quote;
+        p_assert(t < end, in_list ? "Unterminated list" : "Unexpected end of input");
+        size_t pos = tokens[t++];
+        char c = src[pos];
+        if (c == '\'' || c == '(') {
+            open.push_back({items.size(), pos, c == '\''});
+            continue;
+        }
+
+        std::optional<SExpr> value;
+        if (in_list && c == ')') {
+            List list(std::make_move_iterator(items.begin() + open.back().mark),
+                      std::make_move_iterator(items.end()));
+            items.erase(items.begin() + open.back().mark, items.end());
+            if (located && !list.empty()) located->push_back({list.data(), static_cast<uint32_t>(open.back().pos)});
+            open.pop_back();
+            value.emplace(std::move(list));
+        } else {
+            p_assert(c != ')', "Empty atom");
+            value.emplace(intern_atom(src.substr(pos, tokens.atom_end(pos) - pos), ctx));
+        }
+        // A finished value completes any quotes waiting for it
+        while (!open.empty() && open.back().quote) {
+            List quote_list;
+            quote_list.reserve(2);
+            quote_list.push_back(SExpr{Atom{ctx.intern("quote")}});
+            quote_list.push_back(std::move(*value));
+            if (located) located->push_back({quote_list.data(), static_cast<uint32_t>(open.back().pos)});
+            open.pop_back();
+            value.emplace(std::move(quote_list));
+        }
+        if (open.empty()) return std::move(*value);
+        items.push_back(std::move(*value));
+    }
+}
+
+// The source text of every top-level form, in order
+inline std::vector<std::string_view> split_toplevel_forms(std::string_view src) {
+    TokenIndex tokens = index_tokens(src);
+    std::vector<size_t> ends;
+    std::vector<uint32_t> forms = index_forms(src, tokens, &ends);
+    std::vector<std::string_view> out;
+    for (size_t f = 0; f < ends.size(); ++f) {
+        size_t begin = tokens[forms[f]];
+        out.push_back(src.substr(begin, ends[f] - begin));
+    }
+    return out;
+}
+
+// Parse every form. Forms are grouped into chunks of similar byte size; with
+// a TaskPool and at least Limits::par_parse_min_bytes of input the chunks are
+// parsed in parallel, each into its own vector. A syntax error is reported
+// for the earliest bad form, as a sequential parse would. With `locations`,
+// the map is reset for `src` and records every list (see SOURCE LOCATIONS).
+inline std::vector<SExpr> parse_program(std::string_view src, Context& ctx,
+                                        SourceMap* locations = nullptr) {
+    TokenIndex tokens = index_tokens(src);
+    std::vector<uint32_t> first_token = index_forms(src, tokens);
+    size_t count = first_token.size() - 1;
+    if (locations) locations->reset(src);
+    auto parse_range = [&](size_t begin, size_t end, std::vector<SExpr>& out,
+                           std::vector<SourceMap::Entry>* located) {
+        out.reserve(out.size() + (end - begin));
+        // A list takes at least two tokens; untouched capacity costs no memory
+        if (located) located->reserve((first_token[end] - first_token[begin]) / 2);
+        ParseScratch scratch;
+        for (size_t f = begin; f < end; ++f) {
+            size_t t = first_token[f];
+            [[maybe_unused]] bool parsed = false;
+#ifndef WASM_BUILD
+            try {
+#endif
+                out.push_back(parse_indexed(src, tokens, t, first_token[f + 1], ctx, scratch, located));
+                parsed = true;
+                p_assert(t == first_token[f + 1], "Unexpected input after form");
+#ifndef WASM_BUILD
+            } catch (const std::runtime_error& e) {
+                if (!locations) throw;
+                // The stray token after the form, or the last token read
+                size_t at = tokens[parsed ? t : std::min<size_t>(t, first_token[f + 1]) - 1];
+                throw SourceError(locations->describe(locations->at(static_cast<uint32_t>(at))), e.what());
+            }
+#endif
+        }
+    };
+
+    std::vector<SExpr> program;
+#ifdef MINILISP_THREADS
+    TaskPool* pool = ctx.pool;
+    if (pool && src.size() >= ctx.limits.par_parse_min_bytes && count > 1) {
+        // Chunk boundaries by bytes, so one huge form doesn't unbalance the split
+        size_t chunks = std::min(count, pool->concurrency() * 4);
+        std::vector<size_t> first(chunks + 1, count);
+        first[0] = 0;
+        size_t c = 1;
+        for (size_t f = 0; f < count && c < chunks; ++f) {
+            if (tokens[first_token[f]] >= c * src.size() / chunks) first[c++] = f;
+        }
+        for (; c < chunks; ++c) first[c] = count;
+
+        std::vector<std::vector<SExpr>> parsed(chunks);
+        std::vector<std::vector<SourceMap::Entry>> located(locations ? chunks : 0);
+        std::vector<std::exception_ptr> errors(chunks);
+        pool->parallel_for(chunks, [&](size_t k) {
+            try {
+                parse_range(first[k], first[k + 1], parsed[k], locations ? &located[k] : nullptr);
+            } catch (...) {
+                errors[k] = std::current_exception();
+            }
+        });
+        for (auto& error : errors) {
+            if (error) std::rethrow_exception(error);
+        }
+        program.reserve(count);
+        for (auto& chunk : parsed) {
+            for (auto& form : chunk) program.push_back(std::move(form));
+        }
+        for (auto& entries : located) locations->add(std::move(entries));
+        return program;
+    }
+#endif
+    std::vector<SourceMap::Entry> located;
+    parse_range(0, count, program, locations ? &located : nullptr);
+    if (locations) locations->add(std::move(located));
+    return program;
+}
+
+#ifndef MINIMAL_BUILD
+// --- Binary S-expressions ---
+// Services exchanging ASTs can skip printing and re-parsing text. Layout:
+//
+//   "MLB1"                                  magic
+//   varint count, count x (varint len, bytes)   symbol table
+//   varint count, count x node              top-level forms
+//
+// Varints are unsigned LEB128. A node is one varint tag whose low two bits
+// give its kind: 0 an integer (zigzag value above them), 1 a symbol (table
+// index), 2 a list (element count; the elements follow), 3 an integer too
+// large to share its tag (zigzag value in a second varint).
+// decode_binary() reads symbol names straight out of the buffer - which can
+// be a MappedFile - and interns each once, so a form is never copied as text.
+
+namespace binary_format {
+inline constexpr char MAGIC[4] = {'M', 'L', 'B', '1'};
+enum Kind : uint64_t { INT = 0, SYMBOL = 1, LIST = 2, BIG_INT = 3 };
+
+inline void put_varint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>((v & 0x7F) | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+inline uint64_t zigzag(long v) {
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v < 0 ? -1 : 0);
+}
+
+inline long unzigzag(uint64_t v) {
+    return static_cast<long>((v >> 1) ^ (~(v & 1) + 1));
+}
+
+// Reads from a buffer it doesn't own; every read is bounds-checked
+struct Reader {
+    const unsigned char* p;
+    const unsigned char* end;
+
+    uint64_t varint() {
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            p_assert(p < end, "Truncated binary S-expression");
+            unsigned char b = *p++;
+            v |= static_cast<uint64_t>(b & 0x7F) << shift;
+            if (b < 0x80) return v;
+        }
+        p_assert(false, "Bad varint in binary S-expression");
+        return 0;
+    }
+
+    std::string_view bytes(uint64_t n) {
+        p_assert(n <= static_cast<uint64_t>(end - p), "Truncated binary S-expression");
+        std::string_view s(reinterpret_cast<const char*>(p), static_cast<size_t>(n));
+        p += n;
+        return s;
+    }
+};
+} // namespace binary_format
+
+// Symbols get table indexes in order of first use. Nodes are written in
+// prefix order from an explicit stack, so any depth is fine.
+inline void encode_binary_node(const SExpr& root, std::unordered_map<std::string_view, uint64_t>& symbols,
+                               std::string& out) {
+    using namespace binary_format;
+    std::vector<const SExpr*> todo{&root};
+    while (!todo.empty()) {
+        const SExpr& e = *todo.back();
+        todo.pop_back();
+        if (e.atom) {
+            if (std::holds_alternative<long>(*e.atom)) {
+                uint64_t z = zigzag(std::get<long>(*e.atom));
+                if (z >> 62) {
+                    put_varint(out, BIG_INT);
+                    put_varint(out, z);
+                } else {
+                    put_varint(out, (z << 2) | INT);
+                }
+            } else {
+                auto sym = std::get<std::string_view>(*e.atom);
+                uint64_t index = symbols.emplace(sym, symbols.size()).first->second;
+                put_varint(out, (index << 2) | SYMBOL);
+            }
+            continue;
+        }
+        put_varint(out, (static_cast<uint64_t>(e.list->size()) << 2) | LIST);
+        for (auto it = e.list->rbegin(); it != e.list->rend(); ++it) todo.push_back(&*it);
+    }
+}
+
+// Encode top-level forms
+inline std::string encode_binary(std::span<const SExpr> forms) {
+    using namespace binary_format;
+    std::unordered_map<std::string_view, uint64_t> symbols;
+    std::string body;
+    put_varint(body, forms.size());
+    for (const SExpr& form : forms) encode_binary_node(form, symbols, body);
+
+    std::vector<std::string_view> table(symbols.size());
+    size_t table_bytes = 0;
+    for (const auto& [sym, index] : symbols) {
+        table[static_cast<size_t>(index)] = sym;
+        table_bytes += sym.size() + 2;
+    }
+    std::string out(MAGIC, sizeof(MAGIC));
+    out.reserve(out.size() + 10 + table_bytes + body.size());
+    put_varint(out, table.size());
+    for (std::string_view sym : table) {
+        put_varint(out, sym.size());
+        out.append(sym);
+    }
+    out.append(body);
+    return out;
+}
+
+// One encoded node; lists being filled wait on an explicit stack
+inline SExpr decode_binary_node(binary_format::Reader& in, const std::vector<std::string_view>& symbols) {
+    using namespace binary_format;
+    struct Open {
+        List list;
+        uint64_t remaining;
+    };
+    std::vector<Open> open;
+    while (true) {
+        uint64_t tag = in.varint();
+        std::optional<SExpr> value;
+        switch (tag & 3) {
+            case INT:
+                value.emplace(Atom{unzigzag(tag >> 2)});
+                break;
+            case SYMBOL:
+                p_assert((tag >> 2) < symbols.size(), "Bad symbol index in binary S-expression");
+                value.emplace(Atom{symbols[static_cast<size_t>(tag >> 2)]});
+                break;
+            case LIST: {
+                uint64_t n = tag >> 2;
+                // Every element takes at least a byte, so a corrupt count can't over-allocate
+                p_assert(n <= static_cast<uint64_t>(in.end - in.p), "Truncated binary S-expression");
+                List list;
+                list.reserve(static_cast<size_t>(n));
+                if (n > 0) {
+                    open.push_back({std::move(list), n});
+                    continue;
+                }
+                value.emplace(std::move(list));
+                break;
+            }
+            default:
+                value.emplace(Atom{unzigzag(in.varint())});
+        }
+        // Close every list this value completes
+        while (!open.empty()) {
+            open.back().list.push_back(std::move(*value));
+            if (--open.back().remaining > 0) break;
+            value.emplace(std::move(open.back().list));
+            open.pop_back();
+        }
+        if (open.empty()) return std::move(*value);
+    }
+}
+
+// Does `buf` start with the binary format's magic?
+inline bool is_binary_sexpr(std::string_view buf) {
+    return buf.size() >= sizeof(binary_format::MAGIC) &&
+           std::memcmp(buf.data(), binary_format::MAGIC, sizeof(binary_format::MAGIC)) == 0;
+}
+
+// Top-level forms of an encoded buffer; symbols are interned into `ctx`
+inline std::vector<SExpr> decode_binary(std::string_view buf, Context& ctx) {
+    using namespace binary_format;
+    binary_format::Reader in{reinterpret_cast<const unsigned char*>(buf.data()),
+                             reinterpret_cast<const unsigned char*>(buf.data()) + buf.size()};
+    p_assert(is_binary_sexpr(buf), "Not a binary S-expression buffer");
+    in.p += sizeof(MAGIC);
+    uint64_t count = in.varint();
+    p_assert(count <= buf.size(), "Truncated binary S-expression");
+    std::vector<std::string_view> symbols;
+    symbols.reserve(static_cast<size_t>(count));
+    for (uint64_t i = 0; i < count; ++i) symbols.push_back(ctx.intern(in.bytes(in.varint())));
+
+    uint64_t forms = in.varint();
+    p_assert(forms <= buf.size(), "Truncated binary S-expression");
+    std::vector<SExpr> program;
+    program.reserve(static_cast<size_t>(forms));
+    for (uint64_t i = 0; i < forms; ++i) program.push_back(decode_binary_node(in, symbols));
+    p_assert(in.p == in.end, "Unexpected data after binary S-expressions");
+    return program;
+}
+
+#endif // !MINIMAL_BUILD
+
+// =============================================================================
+// PRINTER
+// =============================================================================
+// Values print the way they are read: numbers in decimal, symbols as their
+// names and lists as (a b c), nested to any depth. print_sexpr appends to a
+// std::string, so a caller printing many results reuses one growing buffer.
+// Lists are walked with an explicit stack, so nesting depth costs heap, not
+// call stack. Integers are formatted two digits per division from a table of
+// digit pairs. The minimal build only prints numbers and keeps format_long.
+// =============================================================================
+
+inline constexpr char DIGIT_PAIRS[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// Write `value` in decimal so that it ends just before `end` and return where
+// it starts. Needs 20 bytes before `end` (LONG_MIN).
+inline char* format_long(long value, char* end) {
+    unsigned long n = value < 0 ? 0UL - static_cast<unsigned long>(value) : static_cast<unsigned long>(value);
+    char* p = end;
+    while (n >= 100) {
+        p -= 2;
+        std::memcpy(p, DIGIT_PAIRS + (n % 100) * 2, 2);
+        n /= 100;
+    }
+    if (n >= 10) {
+        p -= 2;
+        std::memcpy(p, DIGIT_PAIRS + n * 2, 2);
+    } else {
+        *--p = static_cast<char>('0' + n);
+    }
+    if (value < 0) *--p = '-';
+    return p;
+}
+
+#ifndef MINIMAL_BUILD
+inline void append_long(std::string& out, long value) {
+    char digits[20];
+    out.append(format_long(value, digits + sizeof(digits)), digits + sizeof(digits));
+}
+
+inline void append_atom(std::string& out, const Atom& atom) {
+    if (std::holds_alternative<long>(atom)) {
+        append_long(out, std::get<long>(atom));
+    } else {
+        out += std::get<std::string_view>(atom);
+    }
+}
+
+// Append `value` with lists as Open item Sep item ... Close and atoms written
+// by `write_atom(out, atom)`; iterative, so any depth is fine
+template <char Open, char Sep, char Close, typename WriteAtom>
+void print_nested(std::string& out, const SExpr& value, WriteAtom write_atom) {
+    if (value.atom) {
+        write_atom(out, *value.atom);
+        return;
+    }
+    std::vector<std::pair<const List*, size_t>> stack;  // List, next item
+    stack.emplace_back(&*value.list, 0);
+    out += Open;
+    while (!stack.empty()) {
+        auto& [list, next] = stack.back();
+        if (next == list->size()) {
+            out += Close;
+            stack.pop_back();
+            continue;
+        }
+        if (next > 0) out += Sep;
+        const SExpr& item = (*list)[next++];
+        if (item.atom) {
+            write_atom(out, *item.atom);
+        } else {
+            out += Open;
+            stack.emplace_back(&*item.list, 0);  // `list` and `next` are dead past here
+        }
+    }
+}
+
+// Append the printed form of `value`: 42, foo, (1 (a b) ())
+inline void print_sexpr(std::string& out, const SExpr& value) {
+    print_nested<'(', ' ', ')'>(out, value, append_atom);
+}
+
+inline std::string print_sexpr(const SExpr& value) {
+    std::string out;
+    print_sexpr(out, value);
+    return out;
+}
+#endif // !MINIMAL_BUILD
+
+
+// --- 3. Evaluator (AST -> Value) ---
+
+constexpr SExpr eval(const SExpr& expr); // Forward declare
+
+// Helper to extract a long from an evaluated SExpr
+constexpr long get_long(const SExpr& e) {
+    p_assert(e.atom.has_value(), "Expected a number");
+    const auto& atom = *e.atom;
+    p_assert(std::holds_alternative<long>(atom), "Expected a number");
+    return std::get<long>(atom);
+}
+
+// =============================================================================
+// WASM STRING COMPARISON WORKAROUND
+// =============================================================================
+// In WASM, string_view::operator== with string literals doesn't work
+// reliably for interned symbols. This helper performs explicit char-by-char
+// comparison which works correctly in both native and WASM builds.
+// Marked constexpr so it works for compile-time evaluation too.
+// Using __attribute__((noinline)) to prevent WASM optimizer issues.
+// =============================================================================
+#ifdef WASM_BUILD
+__attribute__((noinline))
+#endif
+constexpr bool str_eq(std::string_view sv, const char* s) {
+    size_t len = 0;
+    while (s[len]) len++;
     if (sv.size() != len) return false;
     for (size_t i = 0; i < len; i++) {
         if (sv[i] != s[i]) return false;
@@ -481,6 +2226,160 @@ constexpr bool str_eq(std::string_view sv, const char* s) {
     return true;
 }
 
+#ifdef MINILISP_THREADS
+// =============================================================================
+// PURITY AND COST ANALYSIS
+// =============================================================================
+// Used to decide when operands may be evaluated in parallel (Limits::par_args).
+// The side effects in the language are `defun` and message passing, so a
+// function is pure when neither it nor anything it can call defines a function
+// or uses spawn/send/receive/self (which are not in BUILTINS below). The
+// function named by pmap/preduce counts as called. Calls to functions that are
+// not defined yet make a caller impure until they are.
+//
+// Cost is the number of nodes evaluated by one call, following calls into
+// other user functions; anything that can recurse is COST_UNBOUNDED. It is a
+// static estimate - (fib 2) and (fib 30) cost the same - so the evaluator
+// still only spawns when the pool has idle capacity.
+//
+// One pass over every body finds direct impurity and the call graph; impurity
+// then spreads to callers from a worklist, and costs are a memoised DFS, so
+// a snapshot is analysed in time linear in the size of its bodies.
+// =============================================================================
+
+inline constexpr size_t COST_UNBOUNDED = static_cast<size_t>(-1);
+
+inline size_t cost_add(size_t a, size_t b) {
+    return a > COST_UNBOUNDED - b ? COST_UNBOUNDED : a + b;
+}
+
+// Built-in operators and special forms other than defun (all side-effect free)
+bool is_pure_builtin(std::string_view op) {
+    static constexpr const char* BUILTINS[] = {
+        "+", "-", "*", "/", "car", "cdr", "<", ">", "=", "<=", ">=",
+        "quote", "if", "pmap", "preduce", "future", "touch",
+    };
+    for (const char* b : BUILTINS) {
+        if (str_eq(op, b)) return true;
+    }
+    return false;
+}
+
+struct FunctionAnalysis {
+    const std::vector<FunctionStore::Entry>& fns;
+    std::unordered_map<std::string_view, size_t> index;  // Name -> position in fns
+    std::vector<std::vector<size_t>> callers;            // Reverse call graph
+    std::vector<FunctionInfo> info;
+    std::vector<int> state;  // Cost DFS: 0 = unvisited, 1 = in progress, 2 = done
+
+    explicit FunctionAnalysis(const std::vector<FunctionStore::Entry>& f)
+        : fns(f), callers(f.size()), info(f.size()), state(f.size(), 0) {
+        index.reserve(fns.size());
+        for (size_t i = 0; i < fns.size(); ++i) index.emplace(fns[i].name, i);
+    }
+
+    size_t index_of(std::string_view name) const {
+        auto it = index.find(name);
+        return it == index.end() ? fns.size() : it->second;
+    }
+
+    // The function `list` applies besides its operator: the symbol pmap and
+    // preduce take as their first operand
+    static const std::string_view* applied_function(std::string_view op, const List& list) {
+        if (!str_eq(op, "pmap") && !str_eq(op, "preduce")) return nullptr;
+        if (list.size() < 2 || !list[1].atom || !std::holds_alternative<std::string_view>(*list[1].atom)) {
+            return nullptr;
+        }
+        return &std::get<std::string_view>(*list[1].atom);
+    }
+
+    // Record a call from `caller` to `name`; false if `name` isn't defined
+    bool add_call(std::string_view name, size_t caller) {
+        size_t i = index_of(name);
+        if (i == fns.size()) return false;
+        callers[i].push_back(caller);
+        return true;
+    }
+
+    // A body that is a single atom (see Lambda::get_body); else the body is a list
+    static const SExpr* lone_atom(const Lambda& fn) {
+        return fn.body.size() == 1 && fn.body[0].atom.has_value() ? &fn.body[0] : nullptr;
+    }
+
+    // Pass 1: may `list` have side effects by itself? Records the user
+    // functions it calls as callees of function `caller`
+    bool scan(const List& list, size_t caller) {
+        if (list.empty()) return true;
+        bool pure = true;
+        if (list[0].atom.has_value() && std::holds_alternative<std::string_view>(*list[0].atom)) {
+            auto op = std::get<std::string_view>(*list[0].atom);
+            if (str_eq(op, "quote")) return true;
+            if (str_eq(op, "defun")) pure = false;
+            if (!is_pure_builtin(op) && !add_call(op, caller)) pure = false;
+            if (auto fn = applied_function(op, list); fn && !add_call(*fn, caller)) pure = false;
+        }
+        for (size_t i = 1; i < list.size(); ++i) {
+            if (list[i].list.has_value() && !scan(*list[i].list, caller)) pure = false;
+        }
+        return pure;
+    }
+
+    size_t list_cost(const List& list) {
+        if (list.empty()) return 1;
+        size_t total = 1;
+        if (list[0].atom.has_value() && std::holds_alternative<std::string_view>(*list[0].atom)) {
+            auto op = std::get<std::string_view>(*list[0].atom);
+            if (str_eq(op, "quote")) return 1;
+            size_t i = index_of(op);
+            if (i < fns.size()) total = cost_add(total, function_cost(i));
+            if (auto fn = applied_function(op, list); fn && (i = index_of(*fn)) < fns.size()) {
+                total = cost_add(total, function_cost(i));  // At least one element
+            }
+        }
+        for (size_t i = 1; i < list.size(); ++i) {
+            total = cost_add(total, list[i].list.has_value() ? list_cost(*list[i].list) : 1);
+        }
+        return total;
+    }
+
+    size_t function_cost(size_t i) {
+        if (state[i] == 1) return COST_UNBOUNDED;  // Recursion
+        if (state[i] == 2) return info[i].cost;
+        state[i] = 1;
+        const Lambda& fn = *fns[i].fn;
+        info[i].cost = lone_atom(fn) ? 1 : list_cost(fn.body);
+        state[i] = 2;
+        return info[i].cost;
+    }
+
+    void run() {
+        std::vector<size_t> impure;
+        for (size_t i = 0; i < fns.size(); ++i) {
+            const Lambda& fn = *fns[i].fn;
+            info[i].pure = lone_atom(fn) || scan(fn.body, i);
+            if (!info[i].pure) impure.push_back(i);
+        }
+        // Anything that can reach an impure function is impure
+        while (!impure.empty()) {
+            size_t callee = impure.back();
+            impure.pop_back();
+            for (size_t caller : callers[callee]) {
+                if (!info[caller].pure) continue;
+                info[caller].pure = false;
+                impure.push_back(caller);
+            }
+        }
+        for (size_t i = 0; i < fns.size(); ++i) function_cost(i);
+    }
+};
+
+inline std::vector<FunctionInfo> FunctionStore::analyze(const std::vector<Entry>& fns) {
+    FunctionAnalysis analysis(fns);
+    analysis.run();
+    return std::move(analysis.info);
+}
+#endif // MINILISP_THREADS
+
 // apply_op() handles the built-in functions
 // Operands are *already evaluated* SExprs
 // (Using global str_eq function for WASM string comparison)
@@ -595,10 +2494,26 @@ constexpr SExpr eval(const SExpr& expr) {
 // This version supports user-defined functions, defun, if, and comparisons
 SExpr eval_with_env(const SExpr& expr, Env& env);
 
-// Apply built-in ops OR user-defined functions
-// (Using global str_eq function for WASM string comparison)
-SExpr apply_with_env(std::string_view op, std::span<const SExpr> operands, Env& env) {
-    // Comparison operators
+// Special forms, comparisons and (outside the minimal build) message
+// passing are resolved before user functions, so defun rejects their names:
+// a function defined under one could never be called
+bool is_reserved_name(std::string_view name) {
+    static constexpr const char* RESERVED[] = {
+        "quote", "if", "defun", "pmap", "preduce", "future", "touch",
+        "<", ">", "=", "<=", ">=",
+#ifndef MINIMAL_BUILD
+        "spawn", "send", "receive", "self",
+#endif
+    };
+    for (const char* r : RESERVED) {
+        if (str_eq(name, r)) return true;
+    }
+    return false;
+}
+
+// Comparison operators; nullopt if `op` isn't one. They are checked before
+// user functions, so a defun can't shadow them.
+std::optional<SExpr> apply_compare(std::string_view op, std::span<const SExpr> operands) {
     if (str_eq(op, "<")) {
         p_assert(operands.size() == 2, "'<' requires two arguments");
         return SExpr{Atom{get_long(operands[0]) < get_long(operands[1]) ? 1L : 0L}};
@@ -619,56 +2534,369 @@ SExpr apply_with_env(std::string_view op, std::span<const SExpr> operands, Env&
         p_assert(operands.size() == 2, "'>=' requires two arguments");
         return SExpr{Atom{get_long(operands[0]) >= get_long(operands[1]) ? 1L : 0L}};
     }
+    return std::nullopt;
+}
+
+// Environment for calling user function `fn`: the caller's bindings plus the
+// parameters, one level deeper
+Env bind_call(const Lambda& fn, std::span<const SExpr> operands, const Env& env) {
+    p_assert(operands.size() == fn.params.size(), "Wrong number of arguments");
+    p_assert(env.depth < env.ctx->limits.max_depth, "Recursion limit exceeded");
+
+    Env call_env = env;  // Copy current environment
+    call_env.depth = env.depth + 1;
+    for (size_t i = 0; i < fn.params.size(); ++i) {
+        call_env.define(fn.get_param(i), operands[i]);
+    }
+    return call_env;
+}
+
+#ifndef MINIMAL_BUILD
+// Message passing (defined with ActorSystem below)
+SExpr eval_spawn(const List& list, Env& env);
+SExpr spawn_process(std::string_view fn, const List& args, Env& env);  // Arguments evaluated
+std::optional<SExpr> apply_actor(std::string_view op, std::span<const SExpr> operands, Env& env);
+bool actor_try_send(std::span<const SExpr> operands, Env& env);  // false: mailbox full
+std::optional<SExpr> actor_try_receive(Env& env);  // nullopt: empty, actor marked waiting
+#endif
+
+#ifdef MINILISP_THREADS
+// --- Fuel ---
+// With Env::fuel set, every list evaluation burns one unit and the evaluation
+// throws Preempted when none is left. It is also thrown just before the first
+// side effect (defun, spawn, send, receive), so a preempted evaluation has
+// changed nothing and can be rerun from the start by a preemptible evaluator
+// (see EvalService). Preempted is not a std::exception, so error handlers that
+// turn exceptions into Lisp errors let it through.
+struct Preempted {
+    const char* effect = nullptr;  // The side effect refused; null if fuel ran out
+};
+
+inline void burn_fuel(const Env& env) {
+    if (!env.fuel) return;
+    if (*env.fuel == 0) throw Preempted{};
+    --*env.fuel;
+}
+
+inline void before_effect(const Env& env, const char* effect) {
+    if (env.fuel) throw Preempted{effect};
+}
+#else
+inline void burn_fuel(const Env&) {}
+inline void before_effect(const Env&, const char*) {}
+#endif
+
+// Apply built-in ops OR user-defined functions
+// (Using global str_eq function for WASM string comparison)
+SExpr apply_with_env(std::string_view op, std::span<const SExpr> operands, Env& env) {
+    if (auto result = apply_compare(op, operands)) {
+        return std::move(*result);
+    }
+#ifndef MINIMAL_BUILD
+    if (auto result = apply_actor(op, operands, env)) {
+        return std::move(*result);
+    }
+#endif
 
     // Check if it's a user-defined function
     const Lambda* fn_ptr = env.lookup_fn(op);
     if (fn_ptr) {
-        const auto& fn = *fn_ptr;
-        p_assert(operands.size() == fn.params.size(), "Wrong number of arguments");
-
-        // Create new environment with parameter bindings
-        Env call_env = env;  // Copy current environment
-        for (size_t i = 0; i < fn.params.size(); ++i) {
-            call_env.define(fn.get_param(i), operands[i]);
-        }
-
         // Evaluate body in new environment
-        return eval_with_env(fn.get_body(), call_env);
+        Env call_env = bind_call(*fn_ptr, operands, env);
+        return eval_with_env(fn_ptr->get_body(), call_env);
     }
 
     // Fall back to built-in operators
     return apply_op(op, operands);
 }
 
-SExpr eval_with_env(const SExpr& expr, Env& env) {
-    // Case 1: It's an Atom
-    if (expr.atom.has_value()) {
-        const auto& atom = *expr.atom;
-        if (std::holds_alternative<long>(atom)) {
-            return expr; // Numbers evaluate to themselves
-        }
-        if (std::holds_alternative<std::string_view>(atom)) {
-            auto name = std::get<std::string_view>(atom);
-            // Look up in environment
-            const SExpr* val = env.lookup(name);
-            if (val) {
-                return *val;
-            }
-            p_assert(false, "Unbound variable");
-        }
-    }
+// --- Futures ---
+// (future expr) => handle; evaluation continues while expr runs on the pool
+// (touch x)     => value of x, waiting for it if x is a future
+// Every evaluated operand is touched before application, so strict builtins
+// and user functions never see a handle:
+//   (+ (future (fib (- n 1))) (fib (- n 2)))   ; both halves run in parallel
+
+#ifdef MINILISP_THREADS
+bool is_future(const SExpr& e) {
+    if (!e.list.has_value() || e.list->size() != 2) return false;
+    const auto& tag = (*e.list)[0];
+    return tag.atom.has_value() && std::holds_alternative<std::string_view>(*tag.atom) &&
+           std::get<std::string_view>(*tag.atom).data() == FUTURE_TAG.data();
+}
+#endif
+
+// Replace a future handle by its value, helping the pool until it is ready.
+// A no-op for any other value, and in builds without threads.
+void touch([[maybe_unused]] SExpr& e, [[maybe_unused]] Env& env) {
+#ifdef MINILISP_THREADS
+    while (is_future(e)) {
+        FutureCell* cell = env.ctx->futures.get(static_cast<size_t>(get_long((*e.list)[1])));
+        p_assert(cell != nullptr, "Stale future");
+        env.ctx->pool->wait(cell->unresolved);
+        if (cell->error) std::rethrow_exception(cell->error);
+        e = *cell->value;
+    }
+#endif
+}
+
+// Resolve futures anywhere inside a (result) value; walked from an explicit
+// stack, so any depth is fine
+void touch_deep([[maybe_unused]] SExpr& root, [[maybe_unused]] Env& env) {
+#ifdef MINILISP_THREADS
+    touch(root, env);
+    if (!root.list.has_value() || root.list->empty()) return;
+    std::vector<SExpr*> todo{&root};
+    while (!todo.empty()) {
+        SExpr& e = *todo.back();
+        todo.pop_back();
+        if (&e != &root) touch(e, env);
+        if (e.list.has_value()) {
+            for (auto& item : *e.list) todo.push_back(&item);
+        }
+    }
+#endif
+}
+
+// --- Parallel list builtins ---
+// (pmap fn list)          => list of (fn item) for every item, in parallel
+// (preduce fn init list)  => (fn (fn (fn init a) b) c ...) for associative fn
+// `fn` names a defun or builtin and is NOT evaluated (functions aren't values).
+// With a TaskPool on the Context the list is split into chunks that run as
+// work-stealing tasks; without one (or below Limits::par_cutoff) they run
+// sequentially and give the same result.
+
+// Number of chunks to split n items into (1 = run sequentially)
+size_t chunk_count(size_t n, const Env& env) {
+#ifdef MINILISP_THREADS
+    TaskPool* pool = env.ctx->pool;
+    if (pool && n >= env.ctx->limits.par_cutoff) {
+        return std::min(n, pool->concurrency() * 4);
+    }
+#endif
+    (void)n; (void)env;
+    return 1;
+}
+
+// Runs body(chunk, begin, end, env) for each chunk of [0, n). Parallel chunks
+// get a private copy of the environment so no bindings are shared.
+template <typename F>
+void run_chunks(size_t chunks, size_t n, Env& env, F&& body) {
+    if (chunks <= 1) {
+        body(size_t{0}, size_t{0}, n, env);
+        return;
+    }
+#ifdef MINILISP_THREADS
+    env.ctx->pool->parallel_for(chunks, [&](size_t c) {
+        Env task_env = env;
+        body(c, c * n / chunks, (c + 1) * n / chunks, task_env);
+    });
+#endif
+}
+
+std::string_view function_operand(const SExpr& e, const char* msg) {
+    p_assert(e.atom.has_value() && std::holds_alternative<std::string_view>(*e.atom), msg);
+    return std::get<std::string_view>(*e.atom);
+}
+
+SExpr eval_pmap(const List& list, Env& env) {
+    p_assert(list.size() == 3, "'pmap' requires: (pmap fn list)");
+    auto fn = function_operand(list[1], "'pmap' function must be a symbol");
+    SExpr seq = eval_with_env(list[2], env);
+    touch(seq, env);
+    p_assert(seq.list.has_value(), "'pmap' argument must be a list");
+    const List& items = *seq.list;
+
+    List results(items.size(), SExpr{Atom{0L}});
+    run_chunks(chunk_count(items.size(), env), items.size(), env,
+        [&](size_t, size_t begin, size_t end, Env& e) {
+            for (size_t i = begin; i < end; ++i) {
+                results[i] = apply_with_env(fn, std::span<const SExpr>(&items[i], 1), e);
+            }
+        });
+    return SExpr{std::move(results)};
+}
+
+SExpr eval_preduce(const List& list, Env& env) {
+    p_assert(list.size() == 4, "'preduce' requires: (preduce fn init list)");
+    auto fn = function_operand(list[1], "'preduce' function must be a symbol");
+    SExpr acc = eval_with_env(list[2], env);
+    SExpr seq = eval_with_env(list[3], env);
+    touch(acc, env);
+    touch(seq, env);
+    p_assert(seq.list.has_value(), "'preduce' argument must be a list");
+    const List& items = *seq.list;
+
+    // Each chunk folds its own items (starting from its first item, so `init`
+    // needn't be an identity); the partial results are then folded onto init
+    // in chunk order, which is correct for any associative fn.
+    size_t chunks = chunk_count(items.size(), env);
+    std::vector<std::optional<SExpr>> partials(chunks);
+    run_chunks(chunks, items.size(), env,
+        [&](size_t c, size_t begin, size_t end, Env& e) {
+            if (begin == end) return;
+            SExpr part = items[begin];
+            for (size_t i = begin + 1; i < end; ++i) {
+                SExpr args[2] = {std::move(part), items[i]};
+                part = apply_with_env(fn, args, e);
+            }
+            partials[c] = std::move(part);
+        });
+    for (auto& part : partials) {
+        if (!part) continue;
+        SExpr args[2] = {std::move(acc), std::move(*part)};
+        acc = apply_with_env(fn, args, env);
+    }
+    return acc;
+}
+
+SExpr eval_future(const List& list, Env& env) {
+    p_assert(list.size() == 2, "'future' requires exactly one argument");
+#ifdef MINILISP_THREADS
+    // Lazy task creation: spawn only while our own queue is nearly empty,
+    // i.e. when idle workers could actually steal the task. Otherwise a
+    // task would just be popped back by us later - evaluate inline instead.
+    TaskPool* pool = env.ctx->pool;
+    if (pool && !env.inline_futures && pool->local_queue_below(2)) {
+        auto& arena = env.ctx->futures;
+        auto [cell, index] = arena.create();
+        cell->expr = list[1];
+        cell->env = env;
+        cell->pending = &arena.outstanding;
+        cell->fn = [](Task* t) {
+            auto* c = static_cast<FutureCell*>(t);
+            try {
+                c->value = eval_with_env(*c->expr, *c->env);
+                touch(*c->value, *c->env);
+            } catch (...) {
+                c->error = std::current_exception();
+            }
+            c->unresolved.store(0, std::memory_order_release);
+        };
+        arena.outstanding.fetch_add(1, std::memory_order_relaxed);
+        pool->submit(cell);
+
+        List handle;
+        handle.push_back(SExpr{Atom{FUTURE_TAG}});
+        handle.push_back(SExpr{Atom{static_cast<long>(index)}});
+        return SExpr{std::move(handle)};
+    }
+#endif
+    return eval_with_env(list[1], env);
+}
+
+// --- Automatic parallel operands (Limits::par_args) ---
+#ifdef MINILISP_THREADS
+// Is `e` a call to a pure user function that is worth a task?
+bool is_expensive_pure_call(const SExpr& e, const Env& env) {
+    if (!e.list.has_value() || e.list->empty()) return false;
+    const auto& op = (*e.list)[0];
+    if (!op.atom.has_value() || !std::holds_alternative<std::string_view>(*op.atom)) return false;
+    auto info = env.ctx->functions.info(std::get<std::string_view>(*op.atom));
+    return info && info->pure && info->cost >= env.ctx->limits.par_args_min_cost;
+}
+
+// Can evaluating `e` have side effects? Atoms can't; a call is pure when its
+// operator is a pure builtin or user function (see FunctionStore::info), the
+// function pmap/preduce apply is pure, and so are its operands.
+bool is_pure_expr(const SExpr& e, const Env& env) {
+    if (!e.list.has_value() || e.list->empty()) return true;
+    const List& list = *e.list;
+    if (!list[0].atom.has_value() || !std::holds_alternative<std::string_view>(*list[0].atom)) return false;
+    auto op = std::get<std::string_view>(*list[0].atom);
+    if (str_eq(op, "quote")) return true;
+    auto pure_function = [&env](std::string_view name) {
+        auto info = env.ctx->functions.info(name);
+        return info && info->pure;
+    };
+    if (!is_pure_builtin(op) && !pure_function(op)) return false;
+    if (auto fn = FunctionAnalysis::applied_function(op, list); fn && !pure_function(*fn)) return false;
+    for (size_t i = 1; i < list.size(); ++i) {
+        if (!is_pure_expr(list[i], env)) return false;
+    }
+    return true;
+}
+
+// Evaluates the operands list[1..] into `out`, running expensive pure calls
+// as parallel tasks. Returns false (leaving `out` untouched) when fewer than
+// two operands qualify, any operand may have a side effect or the pool has no
+// idle capacity; the caller then evaluates sequentially. With every operand
+// pure, evaluating the cheap ones first only changes which error is reported.
+bool eval_operands_parallel(const List& list, List& out, Env& env) {
+    TaskPool* pool = env.ctx->pool;
+    if (!pool || list.size() < 3 || !pool->local_queue_below(2)) return false;
+
+    std::vector<size_t> expensive;
+    for (size_t i = 1; i < list.size(); ++i) {
+        if (is_expensive_pure_call(list[i], env)) expensive.push_back(i);
+    }
+    if (expensive.size() < 2) return false;
+    for (size_t i = 1; i < list.size(); ++i) {
+        if (!is_pure_expr(list[i], env)) return false;
+    }
+
+    out.assign(list.size() - 1, SExpr{Atom{0L}});
+    for (size_t i = 1, next = 0; i < list.size(); ++i) {
+        if (next < expensive.size() && expensive[next] == i) {
+            ++next;
+            continue;
+        }
+        out[i - 1] = eval_with_env(list[i], env);
+    }
+    pool->parallel_for(expensive.size(), [&](size_t k) {
+        Env task_env = env;
+        out[expensive[k] - 1] = eval_with_env(list[expensive[k]], task_env);
+    });
+    return true;
+}
+
+// Operands with Limits::par_args set: in parallel if eval_operands_parallel
+// allows, else in order. Out of line, to keep it off eval_with_env's hot path.
+__attribute__((noinline)) void eval_operands_par_args(const List& list, List& out, Env& env) {
+    if (eval_operands_parallel(list, out, env)) return;
+    out.reserve(list.size() - 1);
+    for (size_t i = 1; i < list.size(); ++i) out.push_back(eval_with_env(list[i], env));
+}
+#endif
+
+// The operator symbol at the head of a call
+std::string_view list_operator(const List& list) {
+    const auto& op_expr = list[0];
+    p_assert(op_expr.atom.has_value(), "Operator must be an atom");
+    const auto& op_atom = *op_expr.atom;
+    p_assert(std::holds_alternative<std::string_view>(op_atom), "Operator must be a symbol");
+    return std::get<std::string_view>(op_atom);
+}
+
+SExpr eval_with_env(const SExpr& expr, Env& env)
+#if !defined(MINIMAL_BUILD) && !defined(WASM_BUILD)
+try  // Errors are located on the way out (see SOURCE LOCATIONS)
+#endif
+{
+    // Case 1: It's an Atom
+    if (expr.atom.has_value()) {
+        const auto& atom = *expr.atom;
+        if (std::holds_alternative<long>(atom)) {
+            return expr; // Numbers evaluate to themselves
+        }
+        if (std::holds_alternative<std::string_view>(atom)) {
+            auto name = std::get<std::string_view>(atom);
+            // Look up in environment
+            const SExpr* val = env.lookup(name);
+            if (val) {
+                return *val;
+            }
+            p_assert(false, "Unbound variable");
+        }
+    }
 
     // Case 2: It's a List
     if (expr.list.has_value()) {
         const auto& list = *expr.list;
         p_assert(!list.empty(), "Cannot eval empty list");
+        burn_fuel(env);
 
-        // Get operator
-        const auto& op_expr = list[0];
-        p_assert(op_expr.atom.has_value(), "Operator must be an atom");
-        const auto& op_atom = *op_expr.atom;
-        p_assert(std::holds_alternative<std::string_view>(op_atom), "Operator must be a symbol");
-        auto op_str = std::get<std::string_view>(op_atom);
+        auto op_str = list_operator(list);
 
         // --- SPECIAL FORMS ---
 
@@ -682,6 +2910,7 @@ SExpr eval_with_env(const SExpr& expr, Env& env) {
         if (str_eq(op_str, "if")) {
             p_assert(list.size() == 4, "'if' requires exactly 3 arguments: (if cond then else)");
             auto cond = eval_with_env(list[1], env);
+            touch(cond, env);
             long cond_val = get_long(cond);
             return cond_val != 0
                 ? eval_with_env(list[2], env)
@@ -690,6 +2919,7 @@ SExpr eval_with_env(const SExpr& expr, Env& env) {
 
         // 'defun' - define a named function
         if (str_eq(op_str, "defun")) {
+            before_effect(env, "defun");
             p_assert(list.size() == 4, "'defun' requires: (defun name (params...) body)");
 
             // Get function name
@@ -698,41 +2928,2174 @@ SExpr eval_with_env(const SExpr& expr, Env& env) {
             p_assert(std::holds_alternative<std::string_view>(*name_expr.atom),
                      "Function name must be a symbol");
             auto name = std::get<std::string_view>(*name_expr.atom);
+            p_assert(!is_reserved_name(name), "Cannot redefine a built-in form");
+
+            // Get parameters
+            const auto& params_expr = list[2];
+            p_assert(params_expr.list.has_value(), "Parameters must be a list");
+            std::vector<std::string_view> params;
+            for (const auto& p : *params_expr.list) {
+                p_assert(p.atom.has_value(), "Parameter must be a symbol");
+                p_assert(std::holds_alternative<std::string_view>(*p.atom),
+                         "Parameter must be a symbol");
+                params.push_back(std::get<std::string_view>(*p.atom));
+            }
+
+            // Store the function in environment
+            Lambda fn(std::move(params), list[3]);
+            env.define_fn(name, std::move(fn));
+
+            // Return the function name as confirmation
+            return SExpr{Atom{name}};
+        }
+
+        // 'pmap' / 'preduce' - parallel list operations (function name unevaluated)
+        if (str_eq(op_str, "pmap")) {
+            return eval_pmap(list, env);
+        }
+        if (str_eq(op_str, "preduce")) {
+            return eval_preduce(list, env);
+        }
+
+        // 'future' / 'touch' - fork-join parallelism
+        if (str_eq(op_str, "future")) {
+            return eval_future(list, env);
+        }
+        if (str_eq(op_str, "touch")) {
+            p_assert(list.size() == 2, "'touch' requires exactly one argument");
+            auto value = eval_with_env(list[1], env);
+            touch(value, env);
+            return value;
+        }
+
+#ifndef MINIMAL_BUILD
+        // 'spawn' - start a process (function name unevaluated)
+        if (str_eq(op_str, "spawn")) {
+            return eval_spawn(list, env);
+        }
+#endif
+
+        // --- REGULAR FUNCTION APPLICATION ---
+        // Evaluate all operands first
+        List evaluated_operands;
+#ifdef MINILISP_THREADS
+        if (env.ctx->limits.par_args) [[unlikely]] {
+            eval_operands_par_args(list, evaluated_operands, env);
+        } else
+#endif
+        {
+            evaluated_operands.reserve(list.size() - 1);
+            for (size_t i = 1; i < list.size(); ++i) {
+                evaluated_operands.push_back(eval_with_env(list[i], env));
+            }
+        }
+        for (auto& operand : evaluated_operands) {
+            touch(operand, env);  // Join any futures among the operands
+        }
+
+        // Apply the operator
+        return apply_with_env(op_str, evaluated_operands, env);
+    }
+
+    p_assert(false, "Invalid SExpr");
+    return SExpr{Atom{0L}};
+}
+#if !defined(MINIMAL_BUILD) && !defined(WASM_BUILD)
+catch (const SourceError&) {
+    throw;  // Already located by an inner form
+} catch (const std::runtime_error& e) {
+    const SourceMap* map = env.ctx ? env.ctx->locations : nullptr;
+    if (!map || !expr.list) throw;
+    auto loc = map->locate(*expr.list);
+    if (!loc) throw;
+    throw SourceError(map->describe(*loc), e.what());
+}
+#endif
+
+
+// Evaluate one top-level form in the context's global environment. Any
+// futures in the result are resolved, and futures nobody touched are waited
+// for before their cells are released - even if evaluation throws.
+SExpr eval_toplevel(const SExpr& ast, Context& ctx) {
+    // Lambdas looked up during evaluation (including by its futures, which
+    // finish before `scope` ends) must survive concurrent redefinition
+    FunctionStore::ReadGuard read_guard(ctx.functions);
+#ifdef MINILISP_THREADS
+    struct FutureScope {
+        Context& ctx;
+        ~FutureScope() {
+            if (ctx.pool) ctx.pool->wait(ctx.futures.outstanding);
+            ctx.futures.clear();
+        }
+    } scope{ctx};
+#endif
+    SExpr result = eval_with_env(ast, ctx.env);
+    touch_deep(result, ctx.env);
+    return result;
+}
+
+// Parse and evaluate every top-level form in `src`; returns the last result
+SExpr eval_string(std::string_view src, Context& ctx) {
+    SExpr result{Atom{0L}};
+    while (has_more_forms(src)) {
+        auto ast = parse_interned(src, ctx);
+        result = eval_toplevel(ast, ctx);
+    }
+    return result;
+}
+
+#ifdef MINILISP_THREADS
+// eval_string() with at most `fuel` reduction steps; `fuel` is left holding
+// what remains. Throws Preempted when it runs out or before the first side
+// effect; nothing is changed then, so the caller may rerun the source, e.g.
+// as a SlicedEval. Futures would copy the fuel pointer to other threads, so
+// the context must not have a pool.
+SExpr eval_string_fueled(std::string_view src, Context& ctx, size_t& fuel) {
+    p_assert(!ctx.pool, "Fuel-limited evaluation needs a context without a TaskPool");
+    struct FuelScope {
+        Env& env;
+        ~FuelScope() { env.fuel = nullptr; }
+    } scope{ctx.env};
+    ctx.env.fuel = &fuel;
+    return eval_string(src, ctx);
+}
+#endif
+
+#ifndef MINIMAL_BUILD
+// =============================================================================
+// BATCH EVALUATION
+// =============================================================================
+// Applies one function to many argument tuples (records) without building,
+// parsing or dispatching a source string per record:
+//
+//   BatchProgram rule(ctx, "score");       // compile once
+//   rule.run(args, out, &errors);          // args: records x arity longs
+//
+// Construction compiles the function, and every function it calls, to a
+// small stack bytecode over `long` - numbers, parameters, + - * /,
+// comparisons, `if`, quoted numbers and calls between compiled functions -
+// bound to the definitions current at that point. A function using anything
+// else (lists, free variables, futures, actors, defun...) is not compiled:
+// each record is then evaluated as a prebuilt call expression by the
+// interpreter, which still saves the string building and parsing.
+// Results and errors are identical either way.
+//
+// Compiled functions without recursion are also compiled to a lane program
+// that evaluates 4 or 8 records per vector operation (GCC/Clang vector
+// extensions, so SSE/AVX/NEON/wasm-simd as the target allows). Calls are
+// inlined and `if` evaluates both branches and selects per lane; a mask of
+// active lanes keeps a division in the untaken branch from failing. A group
+// in which any active lane fails is rerun record by record on the scalar
+// path, so errors are reported exactly as there.
+// =============================================================================
+
+struct BatchError {
+    size_t record;
+    std::string message;
+};
+
+// Lane program registers: one value per record of a group. The vector types
+// are wrapped so they survive use as template and container arguments.
+typedef long LaneVec4 __attribute__((vector_size(4 * sizeof(long))));
+typedef long LaneVec8 __attribute__((vector_size(8 * sizeof(long))));
+struct LaneReg4 { LaneVec4 v; };
+struct LaneReg8 { LaneVec8 v; };
+
+class BatchProgram {
+public:
+    // compile = false always interprets (for comparison and debugging)
+    BatchProgram(Context& ctx, std::string_view name, bool compile = true)
+        : ctx_(&ctx), max_depth_(ctx.limits.max_depth) {
+        name = ctx.intern(name);
+        FunctionStore::ReadGuard read_guard(ctx.functions);
+        const Lambda* fn = ctx.functions.lookup(name);
+        p_assert(fn, "Unknown function");
+        arity_ = fn->params.size();
+
+        List call;
+        call.push_back(SExpr{Atom{name}});
+        call.resize(arity_ + 1, SExpr{Atom{0L}});
+        call_ = SExpr{std::move(call)};
+
+        if (!compile || !compile_function(name)) {
+            fns_.clear();
+        } else {
+            compile_lanes(name);
+        }
+    }
+
+    size_t arity() const { return arity_; }
+
+    // false: the function uses something the bytecode doesn't cover, and
+    // records are interpreted
+    bool compiled() const { return !fns_.empty(); }
+
+    // Records evaluated side by side: 4 or 8 (default), or 0 for scalar only
+    bool vectorized() const { return lane_width_ != 0 && !lanes_.empty(); }
+    void set_lane_width(size_t width) {
+        p_assert(width == 0 || width == 4 || width == 8, "Lane width must be 0, 4 or 8");
+        lane_width_ = width;
+    }
+
+    // Evaluate `count` records; args holds count * arity() values, record by
+    // record, and out receives count results. Records that fail or return a
+    // non-number get 0 and are listed in `errors` if given. Returns the number
+    // of failed records. (In WASM a failing record traps, like eval.)
+    // Not thread-safe: copy the program for each thread.
+    size_t run(std::span<const long> args, std::span<long> out,
+               [[maybe_unused]] std::vector<BatchError>* errors = nullptr) {
+        size_t count = arity_ ? args.size() / arity_ : out.size();
+        p_assert(count <= out.size() && count * arity_ == args.size(),
+                 "Batch arguments don't match arity and output size");
+        size_t failed = 0, r = 0;
+        if (vectorized()) {
+            r = lane_width_ == 8 ? run_lanes<LaneReg8>(args, out, count, failed, errors)
+                                 : run_lanes<LaneReg4>(args, out, count, failed, errors);
+        }
+        for (; r < count; ++r) {
+            if (!run_scalar(args.data() + r * arity_, r, out[r], errors)) ++failed;
+        }
+        return failed;
+    }
+
+private:
+    enum class Op : uint8_t { CONST, ARG, ADD, SUB, MUL, DIV, LT, GT, EQ, LE, GE, JZ, JMP, CALL, RET };
+
+    struct Insn {
+        Op op;
+        uint32_t a = 0;  // ARG: parameter, ADD/SUB/MUL: operand count, JZ/JMP: target, CALL: function
+        long k = 0;      // CONST value
+    };
+
+    struct Function {
+        std::string_view name;
+        size_t arity = 0;
+        size_t frame = 0;  // Parameters plus the deepest operand stack
+        std::vector<Insn> code;
+    };
+
+    // Record `r` on the scalar path; false (with out = 0) if it failed
+    bool run_scalar(const long* record, size_t r, long& out,
+                    [[maybe_unused]] std::vector<BatchError>* errors) {
+#ifdef WASM_BUILD
+        (void)r;
+        out = run_record(record);
+#else
+        try {
+            out = run_record(record);
+        } catch (const std::exception& e) {
+            out = 0;
+            if (errors) errors->push_back({r, e.what()});
+            return false;
+        }
+#endif
+        return true;
+    }
+
+    long run_record(const long* record) {
+        if (fns_.empty()) {
+            auto& call = *call_.list;
+            for (size_t i = 0; i < arity_; ++i) call[i + 1] = SExpr{Atom{record[i]}};
+            return get_long(eval_toplevel(call_, *ctx_));
+        }
+        if (stack_.size() < fns_[0].frame) stack_.resize(fns_[0].frame);
+        std::copy(record, record + arity_, stack_.begin());
+        return call(0, 0, 0);
+    }
+
+    // Run fns_[f] with its arguments at stack_[base...]
+    long call(uint32_t f, size_t base, size_t depth) {
+        p_assert(depth < max_depth_, "Recursion limit exceeded");
+        const Function& fn = fns_[f];
+        if (stack_.size() < base + fn.frame) {
+            stack_.resize(std::max(stack_.size() * 2, base + fn.frame));
+        }
+        long* s = stack_.data();
+        size_t sp = base + fn.arity;
+        const Insn* code = fn.code.data();
+        for (size_t pc = 0;; ++pc) {
+            const Insn& in = code[pc];
+            switch (in.op) {
+                case Op::CONST: s[sp++] = in.k; break;
+                case Op::ARG: s[sp++] = s[base + in.a]; break;
+                case Op::ADD: {
+                    long r = 0;
+                    for (size_t i = sp - in.a; i < sp; ++i) r += s[i];
+                    sp -= in.a;
+                    s[sp++] = r;
+                    break;
+                }
+                case Op::MUL: {
+                    long r = 1;
+                    for (size_t i = sp - in.a; i < sp; ++i) r *= s[i];
+                    sp -= in.a;
+                    s[sp++] = r;
+                    break;
+                }
+                case Op::SUB: {
+                    sp -= in.a;
+                    long r = s[sp];
+                    for (size_t i = sp + 1; i < sp + in.a; ++i) r -= s[i];
+                    s[sp++] = r;
+                    break;
+                }
+                case Op::DIV:
+                    p_assert(s[sp - 1] != 0, "Division by zero");
+                    s[sp - 2] /= s[sp - 1];
+                    --sp;
+                    break;
+                case Op::LT: --sp; s[sp - 1] = s[sp - 1] < s[sp]; break;
+                case Op::GT: --sp; s[sp - 1] = s[sp - 1] > s[sp]; break;
+                case Op::EQ: --sp; s[sp - 1] = s[sp - 1] == s[sp]; break;
+                case Op::LE: --sp; s[sp - 1] = s[sp - 1] <= s[sp]; break;
+                case Op::GE: --sp; s[sp - 1] = s[sp - 1] >= s[sp]; break;
+                case Op::JZ:
+                    if (s[--sp] == 0) pc = in.a - 1;
+                    break;
+                case Op::JMP: pc = in.a - 1; break;
+                case Op::CALL: {
+                    size_t args = fns_[in.a].arity;
+                    long r = call(in.a, sp - args, depth + 1);
+                    s = stack_.data();  // The callee may have grown the stack
+                    sp -= args;
+                    s[sp++] = r;
+                    break;
+                }
+                case Op::RET: return s[sp - 1];
+            }
+        }
+    }
+
+    // --- Compiler ---
+    // Compiles `name` (and its callees) into fns_; returns its index there,
+    // or nullopt if anything in reach isn't covered by the bytecode. The
+    // entry is reserved before the body is compiled, so callees compiled on
+    // the way get later indexes.
+    std::optional<uint32_t> compile_function(std::string_view name) {
+        const Lambda* fn = ctx_->functions.lookup(name);
+        if (!fn) return std::nullopt;
+        fns_.push_back({name, fn->params.size(), 0, {}});
+        size_t index = fns_.size() - 1;
+        Emitter e{*this, *fn, {}, 0, 0};
+        if (!e.expr(fn->get_body())) return std::nullopt;
+        e.emit({Op::RET});
+        fns_[index].code = std::move(e.code);
+        fns_[index].frame = fn->params.size() + e.max_height;
+        return static_cast<uint32_t>(index);
+    }
+
+    // Index in fns_ of a (possibly not yet compiled) user function
+    std::optional<uint32_t> function_index(std::string_view name) {
+        for (size_t i = 0; i < fns_.size(); ++i) {
+            if (fns_[i].name == name) return static_cast<uint32_t>(i);
+        }
+        return compile_function(name);
+    }
+
+    struct Emitter {
+        BatchProgram& program;
+        const Lambda& fn;
+        std::vector<Insn> code;
+        size_t height;      // Operand stack height at the current point
+        size_t max_height;
+
+        void emit(Insn in, int push = 1) {
+            code.push_back(in);
+            height += push;
+            max_height = std::max(max_height, height);
+        }
+
+        bool expr(const SExpr& e) {
+            if (e.atom.has_value()) {
+                if (std::holds_alternative<long>(*e.atom)) {
+                    emit({Op::CONST, 0, std::get<long>(*e.atom)});
+                    return true;
+                }
+                // Only our own parameters: anything else is dynamically scoped
+                auto name = std::get<std::string_view>(*e.atom);
+                for (size_t i = fn.params.size(); i-- > 0;) {
+                    if (fn.params[i] == name) {
+                        emit({Op::ARG, static_cast<uint32_t>(i)});
+                        return true;
+                    }
+                }
+                return false;
+            }
+            const auto& list = *e.list;
+            if (list.empty() || !list[0].atom.has_value() ||
+                !std::holds_alternative<std::string_view>(*list[0].atom)) {
+                return false;
+            }
+            auto op = std::get<std::string_view>(*list[0].atom);
+            if (str_eq(op, "quote")) {
+                if (list.size() != 2 || !list[1].atom.has_value() ||
+                    !std::holds_alternative<long>(*list[1].atom)) {
+                    return false;
+                }
+                emit({Op::CONST, 0, std::get<long>(*list[1].atom)});
+                return true;
+            }
+            if (str_eq(op, "if")) {
+                if (list.size() != 4 || !expr(list[1])) return false;
+                size_t jz = code.size();
+                emit({Op::JZ}, -1);
+                if (!expr(list[2])) return false;
+                size_t jmp = code.size();
+                emit({Op::JMP}, -1);  // Only one branch's value is ever pushed
+                code[jz].a = static_cast<uint32_t>(code.size());
+                if (!expr(list[3])) return false;
+                code[jmp].a = static_cast<uint32_t>(code.size());
+                return true;
+            }
+            if (str_eq(op, "defun") || str_eq(op, "pmap") || str_eq(op, "preduce") ||
+                str_eq(op, "future") || str_eq(op, "touch") || str_eq(op, "spawn")) {
+                return false;
+            }
+
+            // Application: operands left to right, then the operator
+            uint32_t n = static_cast<uint32_t>(list.size() - 1);
+            for (size_t i = 1; i < list.size(); ++i) {
+                if (!expr(list[i])) return false;
+            }
+            int pop = 1 - static_cast<int>(n);  // n operands in, one result out
+            const std::pair<const char*, Op> compares[] = {
+                {"<", Op::LT}, {">", Op::GT}, {"=", Op::EQ}, {"<=", Op::LE}, {">=", Op::GE}};
+            for (const auto& [name, code_op] : compares) {
+                if (str_eq(op, name)) {
+                    if (n != 2) return false;
+                    emit({code_op}, pop);
+                    return true;
+                }
+            }
+            if (str_eq(op, "self") || str_eq(op, "send") || str_eq(op, "receive")) return false;
+            // User functions shadow the arithmetic builtins, as in apply_with_env
+            if (const Lambda* callee = program.ctx_->functions.lookup(op)) {
+                if (callee->params.size() != n) return false;
+                auto index = program.function_index(op);
+                if (!index) return false;
+                emit({Op::CALL, *index}, pop);
+                return true;
+            }
+            if (str_eq(op, "+")) {
+                emit({Op::ADD, n}, pop);
+            } else if (str_eq(op, "*")) {
+                emit({Op::MUL, n}, pop);
+            } else if (str_eq(op, "-") && n >= 1) {
+                emit({Op::SUB, n}, pop);
+            } else if (str_eq(op, "/") && n == 2) {
+                emit({Op::DIV}, pop);
+            } else {
+                return false;
+            }
+            return true;
+        }
+    };
+
+    // --- Lane program ---
+    // Straight-line code; instruction i writes register lane_base() + i.
+    // Registers below that hold the parameters and then the all-lanes mask.
+    enum class LaneOp : uint8_t {
+        CONST, ADD, SUB, MUL, DIV, LT, GT, EQ, LE, GE,
+        SELECT,  // c != 0 ? a : b
+        WHEN,    // Mask a, narrowed to lanes where b != 0
+        UNLESS,  // Mask a, narrowed to lanes where b == 0
+    };
+
+    struct LaneInsn {
+        LaneOp op;
+        uint32_t a = 0, b = 0, c = 0;  // Registers; DIV: c is the active-lane mask
+        long k = 0;                    // CONST value
+    };
+
+    static constexpr size_t MAX_LANE_INSNS = 4096;  // Bounds inlining
+
+    uint32_t lane_base() const { return static_cast<uint32_t>(arity_ + 1); }
+
+    void compile_lanes(std::string_view name) {
+        const Lambda* fn = ctx_->functions.lookup(name);
+        LaneEmitter e{*this, {}, {name}};
+        std::vector<uint32_t> params(arity_);
+        for (size_t i = 0; i < arity_; ++i) params[i] = static_cast<uint32_t>(i);
+        auto result = e.expr(fn->get_body(), *fn, params, static_cast<uint32_t>(arity_), 0);
+        if (!result) return;
+        lane_result_ = *result;
+        lanes_ = std::move(e.code);
+        drop_dead_lanes();
+    }
+
+    // Remove instructions whose value is never used (divisions stay: their
+    // error check is an effect) and renumber the rest
+    void drop_dead_lanes() {
+        uint32_t base = lane_base();
+        std::vector<bool> live(lanes_.size());
+        auto use = [&](uint32_t reg) {
+            if (reg >= base) live[reg - base] = true;
+        };
+        use(lane_result_);
+        for (size_t i = lanes_.size(); i-- > 0;) {
+            const LaneInsn& in = lanes_[i];
+            if (in.op == LaneOp::DIV) live[i] = true;
+            if (!live[i] || in.op == LaneOp::CONST) continue;
+            use(in.a);
+            use(in.b);
+            if (in.op == LaneOp::DIV || in.op == LaneOp::SELECT) use(in.c);
+        }
+        std::vector<uint32_t> renumber(lanes_.size());
+        std::vector<LaneInsn> kept;
+        auto map = [&](uint32_t reg) { return reg < base ? reg : renumber[reg - base]; };
+        for (size_t i = 0; i < lanes_.size(); ++i) {
+            if (!live[i]) continue;
+            LaneInsn in = lanes_[i];
+            if (in.op != LaneOp::CONST) {
+                in.a = map(in.a);
+                in.b = map(in.b);
+                in.c = map(in.c);
+            }
+            renumber[i] = base + static_cast<uint32_t>(kept.size());
+            kept.push_back(in);
+        }
+        lane_result_ = map(lane_result_);
+        lanes_ = std::move(kept);
+    }
+
+    struct LaneEmitter {
+        BatchProgram& program;
+        std::vector<LaneInsn> code;
+        std::vector<std::string_view> inlining;  // Functions being inlined (no recursion)
+
+        std::optional<uint32_t> emit(LaneInsn in) {
+            if (code.size() >= MAX_LANE_INSNS) return std::nullopt;
+            code.push_back(in);
+            return program.lane_base() + static_cast<uint32_t>(code.size() - 1);
+        }
+
+        // Register holding `e`'s value in the body of `fn`, whose parameters
+        // are in `params`; `mask` marks the lanes that would evaluate it
+        std::optional<uint32_t> expr(const SExpr& e, const Lambda& fn,
+                                     const std::vector<uint32_t>& params, uint32_t mask, size_t depth) {
+            if (e.atom.has_value()) {
+                if (std::holds_alternative<long>(*e.atom)) {
+                    return emit({LaneOp::CONST, 0, 0, 0, std::get<long>(*e.atom)});
+                }
+                auto name = std::get<std::string_view>(*e.atom);
+                for (size_t i = fn.params.size(); i-- > 0;) {
+                    if (fn.params[i] == name) return params[i];
+                }
+                return std::nullopt;
+            }
+            const auto& list = *e.list;
+            if (list.empty() || !list[0].atom.has_value() ||
+                !std::holds_alternative<std::string_view>(*list[0].atom)) {
+                return std::nullopt;
+            }
+            auto op = std::get<std::string_view>(*list[0].atom);
+            if (str_eq(op, "quote")) {
+                if (list.size() != 2 || !list[1].atom.has_value() ||
+                    !std::holds_alternative<long>(*list[1].atom)) {
+                    return std::nullopt;
+                }
+                return emit({LaneOp::CONST, 0, 0, 0, std::get<long>(*list[1].atom)});
+            }
+            if (str_eq(op, "if")) {
+                if (list.size() != 4) return std::nullopt;
+                auto cond = expr(list[1], fn, params, mask, depth);
+                if (!cond) return std::nullopt;
+                auto then_mask = emit({LaneOp::WHEN, mask, *cond});
+                auto else_mask = emit({LaneOp::UNLESS, mask, *cond});
+                if (!then_mask || !else_mask) return std::nullopt;
+                auto then_value = expr(list[2], fn, params, *then_mask, depth);
+                if (!then_value) return std::nullopt;
+                auto else_value = expr(list[3], fn, params, *else_mask, depth);
+                if (!else_value) return std::nullopt;
+                return emit({LaneOp::SELECT, *then_value, *else_value, *cond});
+            }
+            if (str_eq(op, "defun") || str_eq(op, "pmap") || str_eq(op, "preduce") ||
+                str_eq(op, "future") || str_eq(op, "touch") || str_eq(op, "spawn")) {
+                return std::nullopt;
+            }
+
+            std::vector<uint32_t> operands;
+            for (size_t i = 1; i < list.size(); ++i) {
+                auto reg = expr(list[i], fn, params, mask, depth);
+                if (!reg) return std::nullopt;
+                operands.push_back(*reg);
+            }
+            size_t n = operands.size();
+            const std::pair<const char*, LaneOp> compares[] = {
+                {"<", LaneOp::LT}, {">", LaneOp::GT}, {"=", LaneOp::EQ}, {"<=", LaneOp::LE}, {">=", LaneOp::GE}};
+            for (const auto& [name, lane_op] : compares) {
+                if (str_eq(op, name)) {
+                    if (n != 2) return std::nullopt;
+                    return emit({lane_op, operands[0], operands[1]});
+                }
+            }
+            if (str_eq(op, "self") || str_eq(op, "send") || str_eq(op, "receive")) return std::nullopt;
+            if (const Lambda* callee = program.ctx_->functions.lookup(op)) {
+                // Inline; the call would fail the recursion limit at this depth
+                if (callee->params.size() != n || depth + 1 >= program.max_depth_) return std::nullopt;
+                for (auto active : inlining) {
+                    if (active == op) return std::nullopt;
+                }
+                inlining.push_back(op);
+                auto result = expr(callee->get_body(), *callee, operands, mask, depth + 1);
+                inlining.pop_back();
+                return result;
+            }
+            auto fold = [&](LaneOp lane_op, long empty) -> std::optional<uint32_t> {
+                if (n == 0) return emit({LaneOp::CONST, 0, 0, 0, empty});
+                uint32_t acc = operands[0];
+                for (size_t i = 1; i < n; ++i) {
+                    auto next = emit({lane_op, acc, operands[i]});
+                    if (!next) return std::nullopt;
+                    acc = *next;
+                }
+                return acc;
+            };
+            if (str_eq(op, "+")) return fold(LaneOp::ADD, 0);
+            if (str_eq(op, "*")) return fold(LaneOp::MUL, 1);
+            if (str_eq(op, "-") && n >= 1) return fold(LaneOp::SUB, 0);
+            if (str_eq(op, "/") && n == 2) return emit({LaneOp::DIV, operands[0], operands[1], mask});
+            return std::nullopt;
+        }
+    };
+
+    // Run whole groups of records, one per lane of a Reg, through the lane
+    // program; returns the number of records done. Groups with a failing
+    // lane go to run_scalar.
+    template <typename Reg>
+    size_t run_lanes(std::span<const long> args, std::span<long> out, size_t count,
+                     size_t& failed, std::vector<BatchError>* errors) {
+        using Vec = decltype(Reg::v);
+        constexpr size_t W = sizeof(Vec) / sizeof(long);
+        std::vector<Reg> regs(lane_base() + lanes_.size());
+        regs[arity_].v = Vec{} - 1;  // All lanes active
+        const uint32_t base = lane_base();
+        size_t groups = count / W;
+        for (size_t g = 0; g < groups; ++g) {
+            const long* records = args.data() + g * W * arity_;
+            for (size_t p = 0; p < arity_; ++p) {
+                for (size_t l = 0; l < W; ++l) regs[p].v[l] = records[l * arity_ + p];
+            }
+            Vec bad{};
+            for (size_t i = 0; i < lanes_.size(); ++i) {
+                const LaneInsn& in = lanes_[i];
+                Vec& d = regs[base + i].v;
+                switch (in.op) {
+                    case LaneOp::CONST: d = Vec{} + in.k; break;
+                    case LaneOp::ADD: d = regs[in.a].v + regs[in.b].v; break;
+                    case LaneOp::SUB: d = regs[in.a].v - regs[in.b].v; break;
+                    case LaneOp::MUL: d = regs[in.a].v * regs[in.b].v; break;
+                    case LaneOp::DIV: {
+                        Vec a = regs[in.a].v, b = regs[in.b].v;
+                        Vec zero = b == 0, minus_one = b == -1;
+                        bad |= regs[in.c].v & zero;
+                        // Divide by 1 where b is 0 or -1 (no trap), then negate for -1
+                        Vec q = a / ((b & ~(zero | minus_one)) | ((zero | minus_one) & 1));
+                        d = (minus_one & -a) | (~minus_one & q);
+                        break;
+                    }
+                    case LaneOp::LT: d = -(regs[in.a].v < regs[in.b].v); break;
+                    case LaneOp::GT: d = -(regs[in.a].v > regs[in.b].v); break;
+                    case LaneOp::EQ: d = -(regs[in.a].v == regs[in.b].v); break;
+                    case LaneOp::LE: d = -(regs[in.a].v <= regs[in.b].v); break;
+                    case LaneOp::GE: d = -(regs[in.a].v >= regs[in.b].v); break;
+                    case LaneOp::SELECT: {
+                        Vec taken = regs[in.c].v != 0;
+                        d = (taken & regs[in.a].v) | (~taken & regs[in.b].v);
+                        break;
+                    }
+                    case LaneOp::WHEN: d = regs[in.a].v & (regs[in.b].v != 0); break;
+                    case LaneOp::UNLESS: d = regs[in.a].v & (regs[in.b].v == 0); break;
+                }
+            }
+            bool any_bad = false;
+            for (size_t l = 0; l < W; ++l) any_bad |= bad[l] != 0;
+            for (size_t l = 0; l < W; ++l) {
+                size_t r = g * W + l;
+                if (!any_bad) {
+                    out[r] = regs[lane_result_].v[l];
+                } else if (!run_scalar(records + l * arity_, r, out[r], errors)) {
+                    ++failed;
+                }
+            }
+        }
+        return groups * W;
+    }
+
+    Context* ctx_;
+    size_t max_depth_;
+    size_t arity_ = 0;
+    SExpr call_{Atom{0L}};         // (name arg...) for interpreted records
+    std::vector<Function> fns_;    // fns_[0] is the entry point; empty if not compiled
+    std::vector<long> stack_;      // Arguments and operands of every active call
+    std::vector<LaneInsn> lanes_;  // Empty if the function can't run in lanes
+    uint32_t lane_result_ = 0;
+    size_t lane_width_ = 8;
+};
+#endif // !MINIMAL_BUILD
+
+#ifndef MINIMAL_BUILD
+// =============================================================================
+// TIME-SLICED EVALUATION (C++20 COROUTINES)
+// =============================================================================
+// eval_with_env runs to completion, so a long evaluation blocks its host - the
+// browser's event loop in WASM, Ctrl-C handling in the REPL. SlicedEval runs
+// the same language as a chain of coroutines, one frame per nested list
+// evaluation, that suspends after a configurable number of reduction steps
+// (list evaluations) and hands control back to the host:
+//
+//   SlicedEval ev(src, ctx, 10000);
+//   while (!ev.step()) { /* serve other work */ }
+//   SExpr result = ev.result();
+//
+// Frames never resume each other directly: awaiting a child, finishing and
+// yielding all return to a trampoline loop in step(), so a deep evaluation
+// costs heap, not native stack, at any optimisation level. Any number
+// of SlicedEvals may be interleaved on one Context. `future` evaluates its
+// argument in place, and pmap/preduce apply their function item by item.
+// =============================================================================
+
+// Scheduling state shared by every frame of one sliced evaluation
+struct SliceBudget {
+    size_t per_slice;              // Reduction steps between suspensions
+    size_t left = 0;               // Steps left in the current slice
+    bool yielded = false;          // The slice ended at a checkpoint
+    std::coroutine_handle<> next;  // Frame the trampoline resumes next
+
+    // Trampoline: resume frames until the evaluation yields or finishes
+    void run_slice() {
+        left = per_slice;
+        yielded = false;
+        while (next && !yielded) {
+            std::exchange(next, {}).resume();
+        }
+    }
+};
+
+// Ends the current slice unconditionally
+struct SliceYield {
+    SliceBudget& budget;
+    bool await_ready() noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> h) noexcept {
+        budget.next = h;
+        budget.yielded = true;
+    }
+    void await_resume() noexcept {}
+};
+
+// Awaited once per reduction step; ends the slice when its budget is spent
+struct SliceCheckpoint : SliceYield {
+    bool await_ready() noexcept {
+        if (budget.left == 0) return false;
+        --budget.left;
+        return true;
+    }
+};
+
+// Lazily-started coroutine producing one SExpr. Awaiting it runs it to
+// completion (across any number of slices) and then resumes the awaiter.
+// Every such coroutine takes the evaluation's SliceBudget& as a parameter.
+class EvalCoroutine {
+public:
+    struct promise_type;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    struct promise_type {
+        std::optional<SExpr> value;
+#ifndef WASM_BUILD
+        std::exception_ptr error;
+#endif
+        std::coroutine_handle<> continuation;  // Awaiting frame, if any
+        SliceBudget* budget = nullptr;
+
+        // Picks the SliceBudget& out of the coroutine's parameters
+        template <typename... Args>
+        explicit promise_type(Args&... args) { (bind(args), ...); }
+        void bind(SliceBudget& b) { budget = &b; }
+        template <typename T>
+        void bind(T&) {}
+
+        EvalCoroutine get_return_object() { return EvalCoroutine{Handle::from_promise(*this)}; }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        // Hand the awaiter (none for the root) to the trampoline
+        auto final_suspend() noexcept {
+            struct FinalAwaiter {
+                bool await_ready() noexcept { return false; }
+                void await_suspend(Handle h) noexcept {
+                    h.promise().budget->next = h.promise().continuation;
+                }
+                void await_resume() noexcept {}
+            };
+            return FinalAwaiter{};
+        }
+
+        void return_value(SExpr v) { value = std::move(v); }
+
+        void unhandled_exception() {
+#ifdef WASM_BUILD
+            __builtin_trap();  // Unreachable: p_assert traps first
+#else
+            error = std::current_exception();
+#endif
+        }
+    };
+
+    explicit EvalCoroutine(Handle h) : handle_(h) {}
+    EvalCoroutine(EvalCoroutine&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+    EvalCoroutine(const EvalCoroutine&) = delete;
+    EvalCoroutine& operator=(const EvalCoroutine&) = delete;
+    EvalCoroutine& operator=(EvalCoroutine&&) = delete;
+    // Destroying a suspended chain destroys every frame below it as well
+    ~EvalCoroutine() {
+        if (handle_) handle_.destroy();
+    }
+
+    Handle handle() const { return handle_; }
+    bool done() const { return handle_.done(); }
+
+    // Result of a finished coroutine; rethrows its error
+    SExpr take_result() {
+#ifndef WASM_BUILD
+        if (handle_.promise().error) std::rethrow_exception(handle_.promise().error);
+#endif
+        return std::move(*handle_.promise().value);
+    }
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> awaiter) noexcept {
+        handle_.promise().continuation = awaiter;
+        handle_.promise().budget->next = handle_;
+    }
+    SExpr await_resume() { return take_result(); }
+
+private:
+    Handle handle_;
+};
+
+EvalCoroutine apply_sliced(std::string_view op, std::span<const SExpr> operands, Env& env,
+                           SliceBudget& budget);
+
+// eval_with_env as a coroutine. Atoms, quote and defun (which don't evaluate
+// subexpressions) are delegated to eval_with_env.
+EvalCoroutine eval_sliced(const SExpr& expr, Env& env, SliceBudget& budget) {
+    if (!expr.list.has_value()) {
+        co_return eval_with_env(expr, env);
+    }
+    co_await SliceCheckpoint{budget};
+
+    const auto& list = *expr.list;
+    p_assert(!list.empty(), "Cannot eval empty list");
+    auto op_str = list_operator(list);
+
+    if (str_eq(op_str, "if")) {
+        p_assert(list.size() == 4, "'if' requires exactly 3 arguments: (if cond then else)");
+        auto cond = co_await eval_sliced(list[1], env, budget);
+        co_return co_await eval_sliced(get_long(cond) != 0 ? list[2] : list[3], env, budget);
+    }
+    if (str_eq(op_str, "future") || str_eq(op_str, "touch")) {
+        p_assert(list.size() == 2, "'future'/'touch' requires exactly one argument");
+        co_return co_await eval_sliced(list[1], env, budget);
+    }
+    if (str_eq(op_str, "quote") || str_eq(op_str, "defun")) {
+        co_return eval_with_env(expr, env);
+    }
+    // pmap/preduce run sequentially, one sliced call per item, so a long
+    // parallel form still yields to the host between slices
+    if (str_eq(op_str, "pmap")) {
+        p_assert(list.size() == 3, "'pmap' requires: (pmap fn list)");
+        auto fn = function_operand(list[1], "'pmap' function must be a symbol");
+        SExpr seq = co_await eval_sliced(list[2], env, budget);
+        p_assert(seq.list.has_value(), "'pmap' argument must be a list");
+        List results;
+        results.reserve(seq.list->size());
+        for (const auto& item : *seq.list) {
+            results.push_back(co_await apply_sliced(fn, std::span<const SExpr>(&item, 1), env, budget));
+        }
+        co_return SExpr{std::move(results)};
+    }
+    if (str_eq(op_str, "preduce")) {
+        p_assert(list.size() == 4, "'preduce' requires: (preduce fn init list)");
+        auto fn = function_operand(list[1], "'preduce' function must be a symbol");
+        SExpr acc = co_await eval_sliced(list[2], env, budget);
+        SExpr seq = co_await eval_sliced(list[3], env, budget);
+        p_assert(seq.list.has_value(), "'preduce' argument must be a list");
+        for (const auto& item : *seq.list) {
+            SExpr args[2] = {std::move(acc), item};
+            acc = co_await apply_sliced(fn, args, env, budget);
+        }
+        co_return acc;
+    }
+    if (str_eq(op_str, "spawn")) {
+        p_assert(list.size() >= 2, "'spawn' requires: (spawn fn args...)");
+        auto fn = function_operand(list[1], "'spawn' function must be a symbol");
+        List args;
+        args.reserve(list.size() - 2);
+        for (size_t i = 2; i < list.size(); ++i) {
+            args.push_back(co_await eval_sliced(list[i], env, budget));
+        }
+        co_return spawn_process(fn, args, env);
+    }
+
+    // Atoms are evaluated in place: a frame per atom would dominate the cost
+    List evaluated_operands;
+    evaluated_operands.reserve(list.size() - 1);
+    for (size_t i = 1; i < list.size(); ++i) {
+        if (list[i].list.has_value()) {
+            evaluated_operands.push_back(co_await eval_sliced(list[i], env, budget));
+        } else {
+            evaluated_operands.push_back(eval_with_env(list[i], env));
+        }
+    }
+
+    // Inside a process, blocking message operations park it instead of a thread
+    if (env.actor && str_eq(op_str, "receive")) {
+        p_assert(evaluated_operands.empty(), "'receive' takes no arguments");
+        while (true) {
+            if (auto msg = actor_try_receive(env)) co_return std::move(*msg);
+            co_await SliceYield{budget};  // Rescheduled when a message arrives
+        }
+    }
+    if (env.actor && str_eq(op_str, "send")) {
+        while (!actor_try_send(evaluated_operands, env)) {
+            co_await SliceYield{budget};  // Mailbox full: let the receiver run
+        }
+        co_return evaluated_operands[1];
+    }
+
+    co_return co_await apply_sliced(op_str, evaluated_operands, env, budget);
+}
+
+// apply_with_env as a coroutine: user functions run through eval_sliced.
+// `operands` must outlive the awaiting frame's co_await.
+EvalCoroutine apply_sliced(std::string_view op, std::span<const SExpr> operands, Env& env,
+                           SliceBudget& budget) {
+    if (auto result = apply_compare(op, operands)) {
+        co_return std::move(*result);
+    }
+    if (auto result = apply_actor(op, operands, env)) {
+        co_return std::move(*result);
+    }
+    if (const Lambda* fn = env.lookup_fn(op)) {
+        Env call_env = bind_call(*fn, operands, env);
+        // Copied: `fn` may be redefined and reclaimed while this frame is suspended
+        SExpr body = fn->get_body();
+        co_return co_await eval_sliced(body, call_env, budget);
+    }
+    co_return apply_op(op, operands);
+}
+
+// One time-sliced evaluation of every top-level form in a source string
+class SlicedEval {
+public:
+    SlicedEval(std::string_view src, Context& ctx, size_t steps_per_slice)
+        : source_(src), env_(ctx.env), budget_{std::max<size_t>(1, steps_per_slice), 0, false, {}},
+          root_(run(source_, ctx, env_, budget_)) {
+        env_.inline_futures = true;
+        budget_.next = root_.handle();
+    }
+    // Frames hold references to the members, so the object must not move
+    SlicedEval(const SlicedEval&) = delete;
+    SlicedEval& operator=(const SlicedEval&) = delete;
+
+    // Run one slice; true once the evaluation has finished (or failed)
+    bool step() {
+        if (root_.done()) return true;
+        // Lambdas are only held within a slice, so the read section can end with it
+        FunctionStore::ReadGuard read_guard(env_.ctx->functions);
+        budget_.run_slice();
+        return root_.done();
+    }
+
+    bool done() const { return root_.done(); }
+
+    // Reduction steps the last step() ran
+    size_t last_slice_steps() const { return budget_.per_slice - budget_.left; }
+
+    // Value of the last form; rethrows the evaluation's error
+    SExpr result() { return root_.take_result(); }
+
+private:
+    static EvalCoroutine run(std::string_view src, Context& ctx, Env& env, SliceBudget& budget) {
+        SExpr result{Atom{0L}};
+        while (has_more_forms(src)) {
+            auto ast = parse_interned(src, ctx);
+            result = co_await eval_sliced(ast, env, budget);
+        }
+        co_return result;
+    }
+
+    std::string source_;
+    Env env_;
+    SliceBudget budget_;
+    EvalCoroutine root_;
+};
+
+// =============================================================================
+// ACTORS
+// =============================================================================
+// Lightweight processes for message-passing pipelines:
+//
+//   (spawn fn arg...)  => pid; runs (fn arg...) as a new process
+//   (send pid value)   => value; appends a copy of value to pid's mailbox
+//   (receive)          => next message in our mailbox, waiting for one
+//   (self)             => our pid (the top level is pid 0)
+//
+// A process is a sliced evaluation (see above) with its own environment, so
+// processes share nothing but immutable function definitions and messages
+// are plain SExpr values copied on send. Mailboxes are bounded lock-free
+// MPSC queues; a process that receives from an empty mailbox or sends to a
+// full one gives up its slice instead of blocking a thread.
+//
+// Scheduling is cooperative-preemptive: a runnable process runs one slice
+// (Limits::actor_slice reduction steps) at a time. With a TaskPool on the
+// Context each slice is a pool task, so processes run on every worker and
+// keep running between top-level evaluations; without one (WASM) they run
+// on the top-level thread whenever it waits in receive or on a full mailbox.
+// An error ends only the process that raised it.
+// =============================================================================
+
+// Bounded multi-producer single-consumer queue: Vyukov's bounded MPMC ring
+// with the consumer side simplified for a single reader. Capacity is a power
+// of two; try_push fails when full rather than blocking.
+template <typename T>
+class BoundedMpscQueue {
+public:
+    explicit BoundedMpscQueue(size_t capacity)
+        : mask_(std::bit_ceil(std::max<size_t>(capacity, 2)) - 1),
+          cells_(std::make_unique<Cell[]>(mask_ + 1)) {
+        for (size_t i = 0; i <= mask_; ++i) cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    // Any thread
+    bool try_push(T value) {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;  // Full
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::move(value);
+        // seq_cst: pairs with Probe::ready() (see ActorSystem::run_slice)
+        cell->seq.store(pos + 1, std::memory_order_seq_cst);
+        return true;
+    }
+
+    // Consumer only
+    std::optional<T> try_pop() {
+        Cell& cell = cells_[head_ & mask_];
+        if (cell.seq.load(std::memory_order_acquire) != head_ + 1) return std::nullopt;
+        std::optional<T> value = std::move(cell.value);
+        cell.value.reset();
+        cell.seq.store(head_ + mask_ + 1, std::memory_order_release);
+        ++head_;
+        return value;
+    }
+
+    // Consumer only; a concurrent push may complete just after it returns true
+    bool empty() const {
+        return cells_[head_ & mask_].seq.load(std::memory_order_seq_cst) != head_ + 1;
+    }
+
+    // Watches the next slot without touching consumer state, so it stays
+    // safe to query after the consumer role may have passed to another thread
+    struct Probe {
+        const std::atomic<size_t>* seq;
+        size_t ready_value;
+        bool ready() const { return seq->load(std::memory_order_seq_cst) == ready_value; }
+    };
+    Probe probe() const { return {&cells_[head_ & mask_].seq, head_ + 1}; }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        std::optional<T> value;
+    };
+    size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+    alignas(64) std::atomic<size_t> tail_{0};  // Producers
+    alignas(64) size_t head_ = 0;              // Consumer
+};
+
+struct Actor {
+    enum State { RUNNABLE, RUNNING, WAITING, DONE };
+
+    Actor(long id, Context* ctx, size_t mailbox_capacity, size_t slice)
+        : pid(id), env(ctx), budget{slice, 0, false, {}}, mailbox(mailbox_capacity) {
+        env.inline_futures = true;
+        env.actor = this;
+    }
+
+    long pid;
+    Env env;                     // Private: nothing but this process touches it
+    std::optional<SExpr> call;   // (fn 'arg ...)
+    SliceBudget budget;
+    std::optional<EvalCoroutine> root;
+    BoundedMpscQueue<SExpr> mailbox;
+    std::atomic<int> state{RUNNABLE};
+    bool waiting = false;        // Last slice ended in receive on an empty mailbox
+#ifdef MINILISP_THREADS
+    struct SliceTask : Task {
+        Actor* actor;
+        ActorSystem* system;
+    };
+    SliceTask task;              // Reused for every slice scheduled on the pool
+#endif
+};
+
+class ActorSystem {
+public:
+    explicit ActorSystem(Context& ctx) : ctx_(ctx) {
+        // pid 0 is the top level: it has a mailbox but is never scheduled
+        main_ = make_actor(0);
+        main_->state.store(Actor::RUNNING);
+        segment(0)[0].store(main_.get(), std::memory_order_release);
+    }
+
+    ~ActorSystem() {
+        stopping_.store(true, std::memory_order_release);
+#ifdef MINILISP_THREADS
+        if (ctx_.pool) ctx_.pool->wait(scheduled_);  // Slices in flight see stopping_
+#endif
+        for (auto& seg : segments_) {
+            auto* slots = seg.load(std::memory_order_relaxed);
+            if (!slots) continue;
+            for (size_t i = 0; i < SEGMENT_SIZE; ++i) {
+                Actor* a = slots[i].load(std::memory_order_relaxed);
+                if (a != main_.get()) delete a;
+            }
+            delete[] slots;
+        }
+    }
+
+    ActorSystem(const ActorSystem&) = delete;
+    ActorSystem& operator=(const ActorSystem&) = delete;
+
+    long spawn(std::string_view fn, std::span<const SExpr> args) {
+        long pid = next_pid_.fetch_add(1, std::memory_order_relaxed);
+        p_assert(static_cast<size_t>(pid) < SEGMENT_SIZE * SEGMENTS, "Too many processes");
+        Actor* a = make_actor(pid).release();
+
+        List call;
+        call.reserve(args.size() + 1);
+        call.push_back(SExpr{Atom{fn}});
+        for (const auto& arg : args) {
+            List quoted;
+            quoted.push_back(SExpr{Atom{QUOTE}});
+            quoted.push_back(arg);
+            call.push_back(SExpr{std::move(quoted)});
+        }
+        a->call.emplace(std::move(call));
+        a->root.emplace(eval_sliced(*a->call, a->env, a->budget));
+        a->budget.next = a->root->handle();
+
+        segment(static_cast<size_t>(pid) / SEGMENT_SIZE)[pid % SEGMENT_SIZE].store(
+            a, std::memory_order_release);
+        live_.fetch_add(1, std::memory_order_relaxed);
+        schedule(a);
+        return pid;
+    }
+
+    // False if the mailbox is full. Messages to finished processes are dropped.
+    bool try_send(long pid, const SExpr& msg) {
+        Actor* a = find(pid);
+        p_assert(a != nullptr, "Unknown process");
+        if (a->state.load(std::memory_order_acquire) == Actor::DONE) return true;
+        if (!a->mailbox.try_push(msg)) return false;
+        wake(a);
+        return true;
+    }
+
+    // Top-level send: runs other processes while the mailbox is full
+    void send_blocking(long pid, const SExpr& msg) {
+        while (!try_send(pid, msg)) {
+            p_assert(help(), "send would block forever: mailbox full and no process can run");
+        }
+    }
+
+    // Top-level receive: runs other processes until a message arrives
+    SExpr receive_main() {
+        while (true) {
+            if (auto msg = main_->mailbox.try_pop()) return std::move(*msg);
+            if (help()) continue;
+            // Nothing ran: fail only if no process could still send to us
+            if (runnable_.load(std::memory_order_seq_cst) == 0 && main_->mailbox.empty()) {
+                p_assert(false, "receive would block forever: no process can send");
+            }
+        }
+    }
+
+    size_t live() const { return live_.load(std::memory_order_acquire); }
+
+private:
+    static constexpr size_t SEGMENT_SIZE = 1024;
+    static constexpr size_t SEGMENTS = 1024;
+    static constexpr std::string_view QUOTE{"quote"};
+
+    std::unique_ptr<Actor> make_actor(long pid) {
+        auto a = std::make_unique<Actor>(pid, &ctx_, ctx_.limits.mailbox_capacity,
+                                         ctx_.limits.actor_slice);
+#ifdef MINILISP_THREADS
+        a->task.actor = a.get();
+        a->task.system = this;
+        a->task.pending = &scheduled_;
+        a->task.fn = [](Task* t) {
+            auto* slice = static_cast<Actor::SliceTask*>(t);
+            slice->system->run_slice(slice->actor);
+        };
+#endif
+        return a;
+    }
+
+    // Lock-free pid -> Actor table, allocated a segment at a time
+    std::atomic<Actor*>* segment(size_t index) {
+        auto* slots = segments_[index].load(std::memory_order_acquire);
+        if (slots) return slots;
+        auto* fresh = new std::atomic<Actor*>[SEGMENT_SIZE];
+        for (size_t i = 0; i < SEGMENT_SIZE; ++i) fresh[i].store(nullptr, std::memory_order_relaxed);
+        if (segments_[index].compare_exchange_strong(slots, fresh, std::memory_order_acq_rel)) {
+            return fresh;
+        }
+        delete[] fresh;
+        return slots;
+    }
+
+    Actor* find(long pid) {
+        if (pid < 0 || static_cast<size_t>(pid) >= SEGMENT_SIZE * SEGMENTS) return nullptr;
+        auto* slots = segments_[static_cast<size_t>(pid) / SEGMENT_SIZE].load(std::memory_order_acquire);
+        return slots ? slots[pid % SEGMENT_SIZE].load(std::memory_order_acquire) : nullptr;
+    }
+
+    // A waiting process with mail becomes runnable again (once)
+    void wake(Actor* a) {
+        int expected = Actor::WAITING;
+        if (a->state.load(std::memory_order_seq_cst) == Actor::WAITING &&
+            a->state.compare_exchange_strong(expected, Actor::RUNNABLE, std::memory_order_seq_cst)) {
+            schedule(a);
+        }
+    }
+
+    // `a` is RUNNABLE and owned by nobody: hand it to a runner
+    void schedule(Actor* a) {
+        runnable_.fetch_add(1, std::memory_order_seq_cst);
+#ifdef MINILISP_THREADS
+        if (ctx_.pool) {
+            scheduled_.fetch_add(1, std::memory_order_relaxed);
+            ctx_.pool->submit(&a->task);
+            return;
+        }
+#endif
+        run_queue_.push_back(a);
+    }
+
+    // Run some process work on this thread; false if there was none
+    bool help() {
+#ifdef MINILISP_THREADS
+        if (ctx_.pool) {
+            if (ctx_.pool->try_run_one()) return true;
+            std::this_thread::yield();
+            return false;
+        }
+#endif
+        if (run_queue_.empty()) return false;
+        Actor* a = run_queue_.front();
+        run_queue_.pop_front();
+        run_slice(a);
+        return true;
+    }
+
+    void run_slice(Actor* a) {
+        if (stopping_.load(std::memory_order_acquire)) return;
+        a->state.store(Actor::RUNNING, std::memory_order_relaxed);
+        a->waiting = false;
+        {
+            FunctionStore::ReadGuard read_guard(ctx_.functions);
+            a->budget.run_slice();
+        }
+
+        if (a->root->done()) {
+            // Free the frames now; the shell stays for concurrent senders
+            a->root.reset();
+            a->env.bindings.clear();
+            a->state.store(Actor::DONE, std::memory_order_release);
+            live_.fetch_sub(1, std::memory_order_acq_rel);
+        } else if (a->waiting) {
+            // Publish WAITING, then re-check: a message pushed before a sender
+            // could see WAITING would otherwise never wake us. Once WAITING is
+            // visible a sender may reschedule `a` elsewhere, hence the probe.
+            auto probe = a->mailbox.probe();
+            a->state.store(Actor::WAITING, std::memory_order_seq_cst);
+            if (probe.ready()) wake(a);
+        } else {
+            a->state.store(Actor::RUNNABLE, std::memory_order_relaxed);
+            schedule(a);  // Preempted: back of the queue
+        }
+        runnable_.fetch_sub(1, std::memory_order_seq_cst);
+    }
+
+    Context& ctx_;
+    std::unique_ptr<Actor> main_;
+    std::atomic<std::atomic<Actor*>*> segments_[SEGMENTS] = {};
+    std::atomic<long> next_pid_{1};
+    std::atomic<size_t> live_{0};
+    std::atomic<size_t> runnable_{0};   // RUNNABLE or RUNNING processes
+    std::atomic<bool> stopping_{false};
+    std::deque<Actor*> run_queue_;      // Used only without a TaskPool (one thread)
+#ifdef MINILISP_THREADS
+    std::atomic<size_t> scheduled_{0};  // Slices submitted to the pool, not yet run
+#endif
+};
+
+inline Context::~Context() = default;
+
+inline ActorSystem& actors_of(Context& ctx) {
+#ifdef MINILISP_THREADS
+    std::call_once(ctx.actors_created, [&ctx] { ctx.actors = std::make_unique<ActorSystem>(ctx); });
+#else
+    if (!ctx.actors) ctx.actors = std::make_unique<ActorSystem>(ctx);
+#endif
+    return *ctx.actors;
+}
+
+SExpr eval_spawn(const List& list, Env& env) {
+    before_effect(env, "spawn");
+    p_assert(list.size() >= 2, "'spawn' requires: (spawn fn args...)");
+    auto fn = function_operand(list[1], "'spawn' function must be a symbol");
+    List args;
+    args.reserve(list.size() - 2);
+    for (size_t i = 2; i < list.size(); ++i) {
+        args.push_back(eval_with_env(list[i], env));
+        touch(args.back(), env);
+    }
+    return spawn_process(fn, args, env);
+}
+
+SExpr spawn_process(std::string_view fn, const List& args, Env& env) {
+    return SExpr{Atom{actors_of(*env.ctx).spawn(fn, args)}};
+}
+
+bool actor_try_send(std::span<const SExpr> operands, Env& env) {
+    p_assert(operands.size() == 2, "'send' requires: (send pid value)");
+    return actors_of(*env.ctx).try_send(get_long(operands[0]), operands[1]);
+}
+
+std::optional<SExpr> actor_try_receive(Env& env) {
+    auto msg = env.actor->mailbox.try_pop();
+    if (!msg) env.actor->waiting = true;
+    return msg;
+}
+
+// send/receive/self reached outside a process's own sliced frames (top
+// level, or nested in pmap inside a process)
+std::optional<SExpr> apply_actor(std::string_view op, std::span<const SExpr> operands, Env& env) {
+    if (str_eq(op, "self")) {
+        p_assert(operands.empty(), "'self' takes no arguments");
+        return SExpr{Atom{env.actor ? env.actor->pid : 0L}};
+    }
+    if (str_eq(op, "send")) {
+        before_effect(env, "send");
+        if (env.actor) {
+            p_assert(actor_try_send(operands, env), "Mailbox full");
+        } else {
+            p_assert(operands.size() == 2, "'send' requires: (send pid value)");
+            actors_of(*env.ctx).send_blocking(get_long(operands[0]), operands[1]);
+        }
+        return operands[1];
+    }
+    if (str_eq(op, "receive")) {
+        before_effect(env, "receive");
+        p_assert(operands.empty(), "'receive' takes no arguments");
+        p_assert(!env.actor, "'receive' inside pmap/preduce of a process");
+        return actors_of(*env.ctx).receive_main();
+    }
+    return std::nullopt;
+}
+
+// =============================================================================
+// INCREMENTAL DOCUMENTS
+// =============================================================================
+// The playground's editor holds a whole program, and re-running all of it
+// after every edit repeats work the edit didn't touch. A LiveDocument
+// remembers, for each top-level form, its text, AST, the function it defines
+// (if it is a top-level defun), the symbols it mentions and its last result.
+// update() with the edited text then:
+// - parses only forms whose text is new; unchanged forms keep their AST,
+//   wherever they moved;
+// - finds the names whose definitions changed - defined, edited, removed or
+//   reordered among several defuns of one name - and removes definitions no
+//   form provides any more;
+// - re-evaluates, in document order, the new forms, the defuns of those
+//   names, and every other form mentioning a function whose behaviour
+//   changed: a changed name, or one whose body mentions such a function.
+// A defun nested inside an expression can't be tracked this way, so while the
+// document contains one every update re-evaluates every form.
+// =============================================================================
+class LiveDocument {
+public:
+    struct Form {
+        std::string text;
+        uint64_t hash = 0;
+        SExpr ast{Atom{0L}};
+        std::string_view defines;                // Top-level defun's name, or empty
+        std::vector<std::string_view> mentions;  // Every symbol, sorted, unique
+        SExpr value{Atom{0L}};                   // Result of its last evaluation
+        std::string error;                       // Why it failed (native builds)
+        bool parsed = false;
+        bool evaluated = false;                  // By the last update()
+    };
+
+    struct Stats {
+        size_t forms = 0;
+        size_t parsed = 0;
+        size_t evaluated = 0;
+    };
+
+    explicit LiveDocument(Context& ctx) : ctx_(&ctx) {}
+
+    Stats update(std::string_view src) {
+        Stats stats;
+        std::vector<Form> old = std::move(forms_);
+        forms_.clear();
+
+        // Unchanged forms, found by text, keep their AST and value
+        std::vector<std::pair<uint64_t, size_t>> by_hash;
+        for (size_t i = 0; i < old.size(); ++i) by_hash.push_back({old[i].hash, i});
+        std::sort(by_hash.begin(), by_hash.end());
+        std::vector<bool> kept(old.size(), false);
+        std::vector<bool> fresh;
+        for (std::string_view text : split_toplevel_forms(src)) {
+            uint64_t h = text_hash(text);
+            auto it = std::lower_bound(by_hash.begin(), by_hash.end(), std::make_pair(h, size_t{0}));
+            for (; it != by_hash.end() && it->first == h; ++it) {
+                if (!kept[it->second] && old[it->second].text == text) break;
+            }
+            if (it != by_hash.end() && it->first == h) {
+                kept[it->second] = true;
+                forms_.push_back(std::move(old[it->second]));
+                fresh.push_back(false);
+            } else {
+                forms_.push_back(parse_form(text, h));
+                fresh.push_back(true);
+                ++stats.parsed;
+            }
+        }
+
+        // Names whose sequence of defining texts changed
+        auto before = definers(old), after = definers(forms_);
+        std::vector<std::string_view> changed;
+        for (size_t i = 0, j = 0; i < before.size() || j < after.size();) {
+            std::string_view name = j == after.size() || (i < before.size() && before[i].first < after[j].first)
+                                        ? before[i].first : after[j].first;
+            size_t i_end = i, j_end = j;
+            while (i_end < before.size() && before[i_end].first == name) ++i_end;
+            while (j_end < after.size() && after[j_end].first == name) ++j_end;
+            if (i_end - i != j_end - j || !std::equal(before.begin() + i, before.begin() + i_end, after.begin() + j)) {
+                changed.push_back(name);
+                if (j_end == j) ctx_->functions.undefine(name);  // No form defines it now
+            }
+            i = i_end;
+            j = j_end;
+        }
+
+        // Functions that behave differently: changed ones and their callers
+        std::vector<std::string_view> stale = changed;
+        for (bool grew = true; grew;) {
+            grew = false;
+            for (const Form& f : forms_) {
+                if (f.defines.empty() || std::binary_search(stale.begin(), stale.end(), f.defines)) continue;
+                if (mentions_any(f, stale)) {
+                    stale.push_back(f.defines);
+                    sort_unique(stale);
+                    grew = true;
+                }
+            }
+        }
+
+        bool everything = false;
+        for (const Form& f : forms_) {
+            if (!f.defines.empty()) continue;
+            for (std::string_view m : f.mentions) everything = everything || str_eq(m, "defun");
+        }
+        for (size_t i = 0; i < forms_.size(); ++i) {
+            Form& f = forms_[i];
+            f.evaluated = everything || fresh[i] ||
+                          (f.defines.empty() ? mentions_any(f, stale)
+                                             : std::binary_search(changed.begin(), changed.end(), f.defines));
+            if (!f.evaluated) continue;
+            evaluate(f);
+            ++stats.evaluated;
+        }
+        stats.forms = forms_.size();
+        return stats;
+    }
+
+    const std::vector<Form>& forms() const { return forms_; }
+
+    // Forget the document (not the definitions it made)
+    void clear() { forms_.clear(); }
+
+private:
+    static uint64_t text_hash(std::string_view s) {
+        uint64_t h = 14695981039346656037ull;  // FNV-1a
+        for (char c : s) {
+            h ^= static_cast<unsigned char>(c);
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+
+    static void sort_unique(std::vector<std::string_view>& names) {
+        std::sort(names.begin(), names.end());
+        names.erase(std::unique(names.begin(), names.end()), names.end());
+    }
+
+    // (name, text hash) of every top-level defun, by name, in document order
+    static std::vector<std::pair<std::string_view, uint64_t>> definers(const std::vector<Form>& forms) {
+        std::vector<std::pair<std::string_view, uint64_t>> out;
+        for (const Form& f : forms) {
+            if (!f.defines.empty()) out.push_back({f.defines, f.hash});
+        }
+        std::stable_sort(out.begin(), out.end(),
+                         [](const auto& a, const auto& b) { return a.first < b.first; });
+        return out;
+    }
+
+    static bool mentions_any(const Form& f, const std::vector<std::string_view>& names) {
+        for (std::string_view m : f.mentions) {
+            if (std::binary_search(names.begin(), names.end(), m)) return true;
+        }
+        return false;
+    }
+
+    // Every symbol in `root`; walked from an explicit stack, so any depth is fine
+    static void collect_symbols(const SExpr& root, std::vector<std::string_view>& out) {
+        std::vector<const SExpr*> todo{&root};
+        while (!todo.empty()) {
+            const SExpr& e = *todo.back();
+            todo.pop_back();
+            if (e.list) {
+                for (const SExpr& item : *e.list) todo.push_back(&item);
+            } else if (std::holds_alternative<std::string_view>(*e.atom)) {
+                out.push_back(std::get<std::string_view>(*e.atom));
+            }
+        }
+    }
+
+    Form parse_form(std::string_view text, uint64_t h) {
+        Form f;
+        f.text = std::string(text);
+        f.hash = h;
+#ifndef WASM_BUILD
+        try {
+#endif
+            std::string_view rest(f.text);
+            f.ast = parse_interned(rest, *ctx_);
+            p_assert(!has_more_forms(rest), "Unexpected input after form");
+            f.parsed = true;
+#ifndef WASM_BUILD
+        } catch (const std::exception& e) {
+            f.error = e.what();
+            return f;
+        }
+#endif
+        const List* list = f.ast.list ? &*f.ast.list : nullptr;
+        if (list && list->size() > 1 && (*list)[0].atom && (*list)[1].atom &&
+            std::holds_alternative<std::string_view>(*(*list)[0].atom) &&
+            std::holds_alternative<std::string_view>(*(*list)[1].atom) &&
+            str_eq(std::get<std::string_view>(*(*list)[0].atom), "defun")) {
+            f.defines = std::get<std::string_view>(*(*list)[1].atom);
+        }
+        collect_symbols(f.ast, f.mentions);
+        sort_unique(f.mentions);
+        return f;
+    }
+
+    void evaluate(Form& f) {
+        if (!f.parsed) return;  // Keeps its syntax error
+#ifndef WASM_BUILD
+        f.error.clear();
+        try {
+            f.value = eval_toplevel(f.ast, *ctx_);
+        } catch (const std::exception& e) {
+            f.value = SExpr{Atom{0L}};
+            f.error = e.what();
+        }
+#else
+        f.value = eval_toplevel(f.ast, *ctx_);
+#endif
+    }
+
+    Context* ctx_;
+    std::vector<Form> forms_;
+};
+#endif // !MINIMAL_BUILD
+
+#if !defined(MINIMAL_BUILD) && !defined(WASM_BUILD)
+// =============================================================================
+// SCRIPT FILES
+// =============================================================================
+// `lisp_repl script.lisp` maps the file read-only and hands the mapping to
+// parse_program() as one string_view: forms are scanned and parsed in place
+// (in parallel when the Context has a TaskPool) and only symbol names are
+// copied, into the SymbolTable. A file written by encode_binary() is decoded
+// instead of parsed. Either way the program owns no pointers into the file,
+// so the mapping is released before evaluation starts.
+// =============================================================================
+
+// Read-only mapping of a whole file; view() is valid while this object lives
+class MappedFile {
+public:
+    explicit MappedFile(const char* path) {
+        int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) throw std::runtime_error("Cannot open script file");
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Cannot stat script file");
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ > 0) {
+            void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("Cannot map script file");
+            }
+            data_ = static_cast<const char*>(p);
+            // The scan pass reads the file front to back before parsing starts
+            ::madvise(p, size_, MADV_WILLNEED);
+        }
+        ::close(fd);  // The mapping keeps the file alive
+    }
+
+    ~MappedFile() {
+        if (data_) ::munmap(const_cast<char*>(data_), size_);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::string_view view() const { return {data_, size_}; }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Parse every top-level form of the file at `path` - source text, or forms
+// encoded with encode_binary(). `locations` records where text forms came
+// from; binary files have no locations.
+inline std::vector<SExpr> load_script(const char* path, Context& ctx, SourceMap* locations = nullptr) {
+    MappedFile file(path);
+    if (is_binary_sexpr(file.view())) return decode_binary(file.view(), ctx);
+    return parse_program(file.view(), ctx, locations);
+}
+
+// Load a script and evaluate its forms in order; returns the last result
+// (0 for an empty script, as eval_string does). Errors are SourceErrors
+// naming path:line:col.
+inline SExpr run_script(const char* path, Context& ctx) {
+    SourceMap locations(path);
+    std::vector<SExpr> program = load_script(path, ctx, &locations);
+    struct LocationScope {
+        Context& ctx;
+        const SourceMap* outer;
+        ~LocationScope() { ctx.locations = outer; }
+    } scope{ctx, std::exchange(ctx.locations, &locations)};
+    SExpr result{Atom{0L}};
+    for (const SExpr& form : program) result = eval_toplevel(form, ctx);
+    return result;
+}
+
+// =============================================================================
+// BATCH PIPELINE
+// =============================================================================
+// `lisp_repl --batch` streams forms from stdin to results on stdout without
+// the REPL's per-line costs (a getline and a flushing std::endl per
+// expression). Input is read in 64 KiB blocks and split into top-level forms
+// with the structural index, so forms may span lines or share one. Results
+// collect in an output buffer that is written when it fills, whenever the
+// input runs dry - so a coprocess gets its answers before it sends more - and
+// at EOF. Every form yields exactly one line, its value or "Error: ...", so
+// output line N answers input form N.
+// =============================================================================
+
+// Buffered writer for a file descriptor
+class FdWriter {
+public:
+    static constexpr size_t CAPACITY = 64 * 1024;
+
+    explicit FdWriter(int fd) : fd_(fd) { buf_.reserve(CAPACITY); }
+    ~FdWriter() { flush(); }
+
+    FdWriter(const FdWriter&) = delete;
+    FdWriter& operator=(const FdWriter&) = delete;
+
+    std::string& buffer() { return buf_; }
+
+    // Write the buffer out if it has reached CAPACITY
+    void maybe_flush() {
+        if (buf_.size() >= CAPACITY) flush();
+    }
+
+    void flush() {
+        const char* p = buf_.data();
+        size_t left = buf_.size();
+        while (left > 0) {
+            ssize_t n = ::write(fd_, p, left);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;  // Reader went away; drop the output
+            p += n;
+            left -= static_cast<size_t>(n);
+        }
+        buf_.clear();
+    }
+
+private:
+    int fd_;
+    std::string buf_;
+};
+
+// Append up to 64 KiB read from `fd` to `pending`; false at EOF (or error)
+inline bool read_block(int fd, std::string& pending) {
+    constexpr size_t BLOCK = 64 * 1024;
+    size_t old_size = pending.size();
+    pending.resize(old_size + BLOCK);
+    ssize_t n;
+    do {
+        n = ::read(fd, pending.data() + old_size, BLOCK);
+    } while (n < 0 && errno == EINTR);
+    pending.resize(old_size + static_cast<size_t>(n > 0 ? n : 0));
+    return n > 0;
+}
+
+// Byte-at-a-time list depth with index_tokens' rules ('(' inside an atom is
+// part of it). run_pipeline feeds it each block read while the form at the
+// end of its input is unfinished, and indexes the input again only once the
+// depth is back at zero, so one large form is scanned in linear time.
+struct FormDepth {
+    size_t depth = 0;
+    bool in_atom = false;
+
+    // Scan `text`; true if it ends a list at depth zero or leaves the depth there
+    bool feed(std::string_view text) {
+        bool closed = false;
+        for (char c : text) {
+            if (c == ' ' || c == '\n' || c == '\t' || c == '\'') {
+                in_atom = false;
+            } else if (c == ')') {
+                in_atom = false;
+                if (depth > 0 && --depth == 0) closed = true;
+            } else if (c == '(' && !in_atom) {
+                ++depth;
+            } else {
+                in_atom = true;
+            }
+        }
+        return closed || depth == 0;
+    }
+};
+
+// Evaluate every form read from `in_fd`, writing one line per form to
+// `out_fd`. Returns the number of forms that failed.
+inline size_t run_pipeline(int in_fd, int out_fd, Context& ctx) {
+    FdWriter out(out_fd);
+    std::string pending;         // Input not yet evaluated
+    ParseScratch scratch;  // For parse_indexed
+    size_t failures = 0;
+    bool eof = false;
+    while (true) {
+        TokenIndex tokens = index_tokens(pending);
+        std::vector<size_t> ends;
+        std::vector<uint32_t> first_token = index_forms(pending, tokens, &ends);
+        size_t complete = ends.size();
+        // An atom reaching the end of the input read so far may continue in
+        // the next block; a list closed by its ')' is complete
+        if (!eof && complete > 0 && ends.back() == pending.size() && pending.back() != ')') --complete;
+        for (size_t f = 0; f < complete; ++f) {
+            std::string& buf = out.buffer();
+            try {
+                size_t t = first_token[f];
+                SExpr ast = parse_indexed(pending, tokens, t, first_token[f + 1], ctx, scratch);
+                print_sexpr(buf, eval_toplevel(ast, ctx));
+            } catch (const std::exception& e) {
+                buf += "Error: ";
+                buf += e.what();
+                ++failures;
+            }
+            buf += '\n';
+            out.maybe_flush();
+        }
+        if (eof) return failures;
+        pending.erase(0, complete > 0 ? ends[complete - 1] : 0);
+
+        out.flush();  // Input ran dry: answer what has been asked so far
+        // Read on until the unfinished form could be complete
+        FormDepth scan;
+        scan.feed(pending);
+        size_t scanned;
+        do {
+            scanned = pending.size();
+            eof = !read_block(in_fd, pending);
+        } while (!eof && !scan.feed(std::string_view(pending).substr(scanned)));
+    }
+}
+
+// =============================================================================
+// NDJSON PROTOCOL
+// =============================================================================
+// `lisp_repl --ndjson` is for embedding the interpreter as a subprocess. Each
+// line in is one JSON request and each line out one response:
+//
+//   {"id": 7, "src": "(fib 20)", "options": {"fuel": 100000}}
+//   {"id":7,"ok":true,"result":6765,"ns":81234}
+//   {"id":8,"ok":false,"error":"Unbound variable","ns":1200}
+//
+// `id` (any JSON scalar) is echoed verbatim. `src` may hold several forms;
+// the last one's value is the result: a number, a symbol as a string or a
+// list as an array. `ns` is the evaluation time. Options:
+//   fuel   at most this many reduction steps (0: unlimited). A request with
+//          a fuel limit may not defun, spawn, send or receive.
+//   reset  true: forget every definition before evaluating
+// Requests share one Context and are answered in order. Clients may write
+// any number of requests before reading (pipelining); as in --batch, output
+// is buffered and written whenever input runs dry. A line that isn't a valid
+// request gets an error response, with its id if that was read before the
+// error and a null id otherwise.
+// =============================================================================
+
+struct NdjsonRequest {
+    std::string id = "null";  // Raw JSON text
+    std::string src;
+    size_t fuel = 0;
+    bool reset = false;
+};
+
+// Just enough of a JSON reader for requests; errors throw "Bad request: ..."
+class JsonCursor {
+public:
+    explicit JsonCursor(std::string_view s) : s_(s) {}
+
+    bool consume(char c) {
+        skip_ws();
+        if (i_ < s_.size() && s_[i_] == c) {
+            ++i_;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char c) { p_assert(consume(c), "Bad request: malformed JSON"); }
+
+    bool at_end() {
+        skip_ws();
+        return i_ == s_.size();
+    }
+
+    std::string string() {
+        expect('"');
+        std::string out;
+        while (true) {
+            p_assert(i_ < s_.size(), "Bad request: unterminated string");
+            char c = s_[i_++];
+            if (c == '"') return out;
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            p_assert(i_ < s_.size(), "Bad request: unterminated string");
+            switch (char e = s_[i_++]) {
+                case 'n': out += '\n'; break;
+                case 't': out += '\t'; break;
+                case 'r': out += '\r'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'u': append_utf8(out, code_point()); break;
+                default:
+                    p_assert(e == '"' || e == '\\' || e == '/', "Bad request: bad escape");
+                    out += e;
+            }
+        }
+    }
+
+    // Raw text of a string, number, true, false or null, safe to echo
+    std::string_view scalar() {
+        skip_ws();
+        size_t start = i_;
+        if (i_ < s_.size() && s_[i_] == '"') {
+            string();
+            return s_.substr(start, i_ - start);
+        }
+        while (i_ < s_.size() && (std::isalnum(static_cast<unsigned char>(s_[i_])) ||
+                                  s_[i_] == '-' || s_[i_] == '+' || s_[i_] == '.')) {
+            ++i_;
+        }
+        std::string_view text = s_.substr(start, i_ - start);
+        p_assert(text == "true" || text == "false" || text == "null" || is_number(text),
+                 "Bad request: expected a value");
+        return text;
+    }
+
+    size_t unsigned_number() {
+        std::string_view text = scalar();
+        size_t value = 0;
+        auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+        p_assert(ec == std::errc() && end == text.data() + text.size(), "Bad request: expected a count");
+        return value;
+    }
+
+    bool boolean() {
+        std::string_view text = scalar();
+        p_assert(text == "true" || text == "false", "Bad request: expected true or false");
+        return text == "true";
+    }
+
+    // Skip a value of any type
+    void skip() {
+        skip_ws();
+        if (consume('{') || consume('[')) {
+            char close = s_[i_ - 1] == '{' ? '}' : ']';
+            if (consume(close)) return;
+            do {
+                if (close == '}') {
+                    string();
+                    expect(':');
+                }
+                skip();
+            } while (consume(','));
+            expect(close);
+            return;
+        }
+        scalar();
+    }
+
+private:
+    // -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+    static bool is_number(std::string_view t) {
+        size_t i = 0;
+        auto digits = [&] {
+            size_t from = i;
+            while (i < t.size() && t[i] >= '0' && t[i] <= '9') ++i;
+            return i - from;
+        };
+        if (i < t.size() && t[i] == '-') ++i;
+        size_t int_start = i;
+        size_t n = digits();
+        if (n == 0 || (n > 1 && t[int_start] == '0')) return false;
+        if (i < t.size() && t[i] == '.') {
+            ++i;
+            if (digits() == 0) return false;
+        }
+        if (i < t.size() && (t[i] == 'e' || t[i] == 'E')) {
+            ++i;
+            if (i < t.size() && (t[i] == '+' || t[i] == '-')) ++i;
+            if (digits() == 0) return false;
+        }
+        return i == t.size();
+    }
+
+    void skip_ws() {
+        while (i_ < s_.size() && (s_[i_] == ' ' || s_[i_] == '\t' || s_[i_] == '\r' || s_[i_] == '\n')) ++i_;
+    }
+
+    uint32_t hex4() {
+        p_assert(s_.size() - i_ >= 4, "Bad request: bad \\u escape");
+        uint32_t v = 0;
+        auto [end, ec] = std::from_chars(s_.data() + i_, s_.data() + i_ + 4, v, 16);
+        p_assert(ec == std::errc() && end == s_.data() + i_ + 4, "Bad request: bad \\u escape");
+        i_ += 4;
+        return v;
+    }
+
+    uint32_t code_point() {
+        uint32_t cp = hex4();
+        if (cp >= 0xD800 && cp < 0xDC00 && s_.substr(i_, 2) == "\\u") {
+            i_ += 2;
+            uint32_t low = hex4();
+            p_assert(low >= 0xDC00 && low < 0xE000, "Bad request: bad surrogate pair");
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+        }
+        return cp;
+    }
+
+    static void append_utf8(std::string& out, uint32_t cp) {
+        if (cp < 0x80) {
+            out += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            out += static_cast<char>(0xC0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += static_cast<char>(0xE0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
 
-            // Get parameters
-            const auto& params_expr = list[2];
-            p_assert(params_expr.list.has_value(), "Parameters must be a list");
-            std::vector<std::string_view> params;
-            for (const auto& p : *params_expr.list) {
-                p_assert(p.atom.has_value(), "Parameter must be a symbol");
-                p_assert(std::holds_alternative<std::string_view>(*p.atom),
-                         "Parameter must be a symbol");
-                params.push_back(std::get<std::string_view>(*p.atom));
+    std::string_view s_;
+    size_t i_ = 0;
+};
+
+// Fills `req` field by field, so a request that fails after its id keeps it
+inline void parse_ndjson_request(std::string_view line, NdjsonRequest& req) {
+    JsonCursor in(line);
+    in.expect('{');
+    bool has_src = false;
+    if (!in.consume('}')) {
+        do {
+            std::string key = in.string();
+            in.expect(':');
+            if (key == "id") {
+                req.id = std::string(in.scalar());
+            } else if (key == "src") {
+                req.src = in.string();
+                has_src = true;
+            } else if (key == "options") {
+                in.expect('{');
+                if (in.consume('}')) continue;
+                do {
+                    std::string option = in.string();
+                    in.expect(':');
+                    if (option == "fuel") {
+                        req.fuel = in.unsigned_number();
+                    } else if (option == "reset") {
+                        req.reset = in.boolean();
+                    } else {
+                        in.skip();  // Unknown options are ignored
+                    }
+                } while (in.consume(','));
+                in.expect('}');
+            } else {
+                in.skip();
             }
+        } while (in.consume(','));
+        in.expect('}');
+    }
+    p_assert(in.at_end(), "Bad request: data after the object");
+    p_assert(has_src, "Bad request: missing \"src\"");
+}
 
-            // Store the function in environment
-            Lambda fn(std::move(params), list[3]);
-            env.define_fn(name, std::move(fn));
+// Append `s` as a JSON string
+inline void append_json_string(std::string& out, std::string_view s) {
+    out += '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char esc[8];
+            std::snprintf(esc, sizeof(esc), "\\u%04x", static_cast<unsigned char>(c));
+            out += esc;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
 
-            // Return the function name as confirmation
-            return SExpr{Atom{name}};
+inline void append_json_value(std::string& out, const SExpr& value) {
+    print_nested<'[', ',', ']'>(out, value, [](std::string& o, const Atom& atom) {
+        if (std::holds_alternative<long>(atom)) {
+            append_long(o, std::get<long>(atom));
+        } else {
+            append_json_string(o, std::get<std::string_view>(atom));
         }
+    });
+}
 
-        // --- REGULAR FUNCTION APPLICATION ---
-        // Evaluate all operands first
-        List evaluated_operands;
-        evaluated_operands.reserve(list.size() - 1);
-        for (size_t i = 1; i < list.size(); ++i) {
-            evaluated_operands.push_back(eval_with_env(list[i], env));
+// Answer one request line, appending the response line to `out`; false if it failed
+inline bool answer_ndjson(std::string_view line, Context& ctx, std::string& out) {
+    NdjsonRequest req;
+    auto start = std::chrono::steady_clock::now();
+    bool ok = true;
+    std::string error;
+    std::optional<SExpr> result;
+    try {
+        parse_ndjson_request(line, req);
+        start = std::chrono::steady_clock::now();
+        if (req.reset) ctx.reset();
+        if (req.fuel == 0) {
+            result = eval_string(req.src, ctx);
+        } else {
+            // Fuel-limited evaluation runs without the pool (see eval_string_fueled);
+            // it is put back however the evaluation ends
+            struct PoolScope {
+                Context& ctx;
+                TaskPool* pool = std::exchange(ctx.pool, nullptr);
+                ~PoolScope() { ctx.pool = pool; }
+            } scope{ctx};
+            size_t left = req.fuel;
+            try {
+                result = eval_string_fueled(req.src, ctx, left);
+            } catch (const Preempted& p) {
+                error = p.effect ? "'" + std::string(p.effect) + "' is not allowed with a fuel limit"
+                                 : "Fuel exhausted";
+                ok = false;
+            }
         }
+    } catch (const std::exception& e) {
+        error = e.what();
+        ok = false;
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
 
-        // Apply the operator
-        return apply_with_env(op_str, evaluated_operands, env);
+    out += "{\"id\":";
+    out += req.id;
+    if (ok) {
+        out += ",\"ok\":true,\"result\":";
+        append_json_value(out, *result);
+    } else {
+        out += ",\"ok\":false,\"error\":";
+        append_json_string(out, error);
     }
+    out += ",\"ns\":";
+    append_long(out, static_cast<long>(ns));
+    out += "}\n";
+    return ok;
+}
 
-    p_assert(false, "Invalid SExpr");
-    return SExpr{Atom{0L}};
+// Serve NDJSON requests from `in_fd` until EOF, responses to `out_fd`.
+// Returns the number of failed requests.
+inline size_t run_ndjson(int in_fd, int out_fd, Context& ctx) {
+    FdWriter out(out_fd);
+    std::string pending;
+    size_t failures = 0;
+    bool eof = false;
+    while (true) {
+        size_t begin = 0;
+        while (true) {
+            size_t nl = pending.find('\n', begin);
+            if (nl == std::string::npos) {
+                if (!eof) break;
+                nl = pending.size();  // Last line without a newline
+            }
+            std::string_view line(pending.data() + begin, nl - begin);
+            if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+            if (line.find_first_not_of(" \t") != std::string_view::npos) {
+                failures += answer_ndjson(line, ctx, out.buffer()) ? 0 : 1;
+                out.maybe_flush();
+            }
+            begin = nl + 1;
+            if (begin >= pending.size()) break;
+        }
+        if (eof) return failures;
+        pending.erase(0, std::min(begin, pending.size()));
+        out.flush();  // Input ran dry: answer what has been asked so far
+        eof = !read_block(in_fd, pending);
+    }
 }
+#endif // !MINIMAL_BUILD && !WASM_BUILD
 
 } // namespace MiniLisp
 // --- End of Core Lisp Interpreter ---
@@ -766,35 +5129,27 @@ void write_str(const char* str) {
 }
 
 void write_number(long num) {
-    char buffer[32];
-    int i = 0;
-    bool is_neg = num < 0;
-    if (is_neg) num = -num;
-
-    if (num == 0) {
-        buffer[i++] = '0';
-    } else {
-        char temp[32];
-        int j = 0;
-        while (num > 0) {
-            temp[j++] = '0' + (num % 10);
-            num /= 10;
-        }
-        if (is_neg) buffer[i++] = '-';
-        while (j > 0) {
-            buffer[i++] = temp[--j];
-        }
-    }
-    buffer[i] = '\0';
-    write_str(buffer);
+    char buffer[20];
+    char* start = MiniLisp::format_long(num, buffer + sizeof(buffer));
+    write(STDOUT_FILENO, start, buffer + sizeof(buffer) - start);
 }
 
+// Reads stdin a block at a time; bytes past the newline wait for the next call
 int read_line_posix(char* buffer, int max_len) {
+    static char block[4096];
+    static ssize_t pos = 0, len = 0;
     int i = 0;
-    char c;
     while (i < max_len - 1) {
-        ssize_t n = read(STDIN_FILENO, &c, 1);
-        if (n <= 0 || c == '\n') break;
+        if (pos == len) {
+            len = read(STDIN_FILENO, block, sizeof(block));
+            pos = 0;
+            if (len <= 0) {
+                len = 0;
+                break;
+            }
+        }
+        char c = block[pos++];
+        if (c == '\n') break;
         buffer[i++] = c;
     }
     buffer[i] = '\0';
@@ -837,9 +5192,750 @@ long eval_lisp_runtime(std::string_view s) {
 }
 
 
-#ifndef WASM_BUILD
+#ifdef MINILISP_THREADS
+// =============================================================================
+// EVALUATION SERVICE
+// =============================================================================
+// A fixed pool of worker threads, each owning a private Context. Requests are
+// routed to the least-loaded worker and run without any shared interpreter
+// state, so throughput scales with cores.
+//
+// All workers read one shared, RCU-published FunctionStore. The `defun` forms
+// a request starts with are applied synchronously by submit() in an admin
+// Context; defining evaluates nothing, and the rest of the request runs on a
+// worker like any other. submit() then pins the store's snapshot for the
+// request, so it sees exactly the definitions submitted before it (and its
+// own), whichever worker runs it and however long it waits or runs -
+// redefinition never blocks it or changes a body under it.
+//
+// Requests belong to tenants. Each worker serves its tenants round-robin
+// (deficit round-robin): a tenant keeps the worker for `fuel` reduction steps,
+// running its queued requests in order, then goes to the back of the line.
+// A request first runs on the plain evaluator with `fuel` steps (see
+// eval_string_fueled), so short requests pay nothing extra. One that runs out
+// is restarted as a SlicedEval, continued one `fuel`-step slice per turn of
+// its tenant. An endless request - or a tenant flooding the service - thus
+// only slows others down by its share of the worker.
+//
+// Latency is measured from submit() to completion and split into queue wait
+// and evaluation time; LatencyStats keeps the samples for percentile reports.
+// =============================================================================
+namespace MiniLisp {
+
+using ServiceClock = std::chrono::steady_clock;
+
+struct EvalResponse {
+    uint64_t id;
+    bool ok;
+    std::string result;      // Display form of the value, or the error message
+    uint64_t queue_ns;       // submit() -> first turn on a worker
+    uint64_t eval_ns;        // First turn -> completion, including other tenants' turns
+};
+
+// Does the first form in `src` define something every worker must see?
+inline bool is_definition(std::string_view src) {
+    skip_ws(src);
+    if (src.size() < 7 || src.substr(0, 6) != "(defun") return false;
+    char c = src[6];
+    return c == ' ' || c == '\t' || c == '\n';
+}
+
+// Thread-safe latency sample collector
+class LatencyStats {
+public:
+    void record(uint64_t ns) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        samples_.push_back(ns);
+    }
+
+    size_t count() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return samples_.size();
+    }
+
+    // p in [0, 100]; returns 0 with no samples
+    uint64_t percentile(double p) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (samples_.empty()) return 0;
+        std::vector<uint64_t> sorted = samples_;
+        size_t rank = static_cast<size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+        std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+        return sorted[rank];
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        samples_.clear();
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<uint64_t> samples_;
+};
+
+class EvalService {
+public:
+    // Invoked on a worker thread once per request; must be thread-safe
+    using Callback = std::function<void(const EvalResponse&)>;
+
+    // Reduction steps per turn; short requests finish within their first turn
+    static constexpr size_t DEFAULT_FUEL = 10000;
+
+    // fuel == 0 runs every request to completion in arrival order
+    EvalService(size_t num_workers, Callback on_done, size_t fuel = DEFAULT_FUEL)
+        : on_done_(std::move(on_done)), fuel_(fuel) {
+        if (num_workers == 0) num_workers = 1;
+        workers_.reserve(num_workers);
+        for (size_t i = 0; i < num_workers; ++i) {
+            workers_.push_back(std::make_unique<Worker>(&functions_));
+        }
+        for (auto& w : workers_) {
+            Worker* worker = w.get();
+            worker->thread = std::thread([this, worker] { run(*worker); });
+        }
+    }
+
+    // Requests that haven't completed are abandoned without a response;
+    // drain() first to finish them
+    ~EvalService() {
+        for (auto& w : workers_) {
+            {
+                std::lock_guard<std::mutex> lock(w->mutex);
+                w->stopping = true;
+            }
+            w->cv.notify_one();
+        }
+        for (auto& w : workers_) w->thread.join();
+    }
+
+    EvalService(const EvalService&) = delete;
+    EvalService& operator=(const EvalService&) = delete;
+
+    size_t worker_count() const { return workers_.size(); }
+
+    void submit(uint64_t id, std::string source, uint64_t tenant = 0) {
+        auto job = std::make_unique<Job>();
+        job->id = id;
+        job->tenant = tenant;
+        job->source = std::move(source);
+        job->submitted = ServiceClock::now();
+        if (is_definition(job->source)) define_leading(*job);
+        job->functions = functions_.pin();
+        in_flight_.fetch_add(1, std::memory_order_relaxed);
+
+        // Least-loaded worker; ties go to the lowest index
+        Worker* best = workers_[0].get();
+        for (auto& w : workers_) {
+            if (w->pending.load(std::memory_order_relaxed) <
+                best->pending.load(std::memory_order_relaxed)) {
+                best = w.get();
+            }
+        }
+        enqueue(*best, std::move(job));
+    }
+
+    // Block until every submitted request has completed
+    void drain() {
+        std::unique_lock<std::mutex> lock(drain_mutex_);
+        drain_cv_.wait(lock, [this] {
+            return in_flight_.load(std::memory_order_acquire) == 0;
+        });
+    }
+
+    const LatencyStats& latency() const { return latency_; }
+    // Turns that ended with the request unfinished
+    size_t preemptions() const { return preemptions_.load(std::memory_order_relaxed); }
+    void reset_stats() {
+        latency_.clear();
+        preemptions_.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    struct Job {
+        uint64_t id = 0;
+        uint64_t tenant = 0;
+        std::string source;
+        ServiceClock::time_point submitted;
+        ServiceClock::time_point started;    // First turn
+        size_t turns = 0;
+        std::unique_ptr<SlicedEval> sliced;  // Set once the first turn ran out of fuel
+        // Set by define_leading: the display form of the last leading
+        // definition, or the error that stopped them
+        std::optional<std::string> defined;
+        bool define_failed = false;
+        // Functions as of submit(): later definitions don't reach this job
+        FunctionStore::Pin functions;
+    };
+
+    struct TenantQueue {
+        std::deque<std::unique_ptr<Job>> jobs;
+        size_t spent = 0;  // Reduction steps used in the current turn
+    };
+
+    struct Worker {
+        explicit Worker(FunctionStore* functions) : ctx(functions) {}
+        Context ctx;
+        // Queued jobs by tenant, and the tenants that have any in turn order;
+        // the tenant whose turn it is stays at ready.front() until it ends.
+        // Declared after ctx: a preempted job's SlicedEval refers to it.
+        std::unordered_map<uint64_t, TenantQueue> tenants;
+        std::deque<uint64_t> ready;
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::atomic<size_t> pending{0};
+        bool stopping = false;
+        std::thread thread;
+    };
+
+    void enqueue(Worker& w, std::unique_ptr<Job> job) {
+        w.pending.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(w.mutex);
+            push_job(w, std::move(job));
+        }
+        w.cv.notify_one();
+    }
+
+    // Append to the job's tenant queue (w.mutex held). A tenant that has a
+    // queue entry is already in w.ready.
+    static void push_job(Worker& w, std::unique_ptr<Job> job) {
+        auto [it, added] = w.tenants.try_emplace(job->tenant);
+        if (added) w.ready.push_back(job->tenant);
+        it->second.jobs.push_back(std::move(job));
+    }
+
+    // Next job of the tenant whose turn it is (w.mutex held, w.ready non-empty)
+    static std::unique_ptr<Job> pop_job(Worker& w) {
+        auto& queue = w.tenants.find(w.ready.front())->second;
+        auto job = std::move(queue.jobs.front());
+        queue.jobs.pop_front();
+        return job;
+    }
+
+    // Charge `steps` to the current tenant and end its turn when it has used
+    // its fuel, has no jobs left or its job was preempted (w.mutex held)
+    void end_job(Worker& w, size_t steps, std::unique_ptr<Job> preempted) {
+        uint64_t tenant = w.ready.front();
+        auto it = w.tenants.find(tenant);
+        it->second.spent += steps;
+        if (!preempted && it->second.spent < fuel_ && !it->second.jobs.empty()) return;
+        if (preempted) it->second.jobs.push_back(std::move(preempted));
+        w.ready.pop_front();
+        if (it->second.jobs.empty()) {
+            w.tenants.erase(it);
+        } else {
+            it->second.spent = 0;
+            w.ready.push_back(tenant);
+        }
+    }
+
+    // Apply the job's leading defun forms in the admin context, unfueled, so
+    // that every request submitted afterwards sees them. Only the forms after
+    // them are left in job.source for a worker; an error drops those too.
+    void define_leading(Job& job) {
+        std::lock_guard<std::mutex> lock(admin_mutex_);
+        std::string_view rest(job.source);
+        try {
+            while (is_definition(rest)) {
+                auto ast = parse_interned(rest, admin_);
+                job.defined = print_sexpr(eval_toplevel(ast, admin_));
+            }
+        } catch (const std::exception& e) {
+            job.defined = e.what();
+            job.define_failed = true;
+        }
+        job.source.erase(0, job.source.size() - rest.size());
+    }
+
+    // Run a job in `ctx` for at most `fuel` reduction steps (0 = to completion)
+    // and add the steps used to `steps`. Fills everything but the latency
+    // fields of the response; nullopt if the job was preempted.
+    std::optional<EvalResponse> execute(Job& job, Context& ctx, size_t fuel, size_t& steps) {
+        auto now = ServiceClock::now();
+        if (job.turns++ == 0) job.started = now;
+        EvalResponse resp{job.id, true, {}, 0, 0};
+        struct PinScope {
+            Context& ctx;
+            ~PinScope() { ctx.pinned = nullptr; }
+        } pin_scope{ctx};
+        ctx.pinned = &job.functions;
+        std::string_view rest(job.source);
+        if (job.defined && (job.define_failed || !has_more_forms(rest))) {
+            resp.ok = !job.define_failed;  // Nothing left to evaluate
+            resp.result = *job.defined;
+        } else {
+            try {
+                std::optional<SExpr> value;
+                if (fuel == 0) {
+                    value = eval_string(job.source, ctx);
+                } else if (!job.sliced) {
+                    size_t left = fuel;
+                    try {
+                        value = eval_string_fueled(job.source, ctx, left);
+                    } catch (const Preempted&) {
+                        job.sliced = std::make_unique<SlicedEval>(job.source, ctx, fuel);
+                    }
+                    steps += fuel - left;
+                } else {
+                    if (job.sliced->step()) value = job.sliced->result();
+                    steps += job.sliced->last_slice_steps();
+                }
+                if (!value) {
+                    preemptions_.fetch_add(1, std::memory_order_relaxed);
+                    return std::nullopt;
+                }
+                resp.result = print_sexpr(*value);
+            } catch (const std::exception& e) {
+                resp.ok = false;
+                resp.result = e.what();
+            }
+        }
+        using std::chrono::duration_cast;
+        using std::chrono::nanoseconds;
+        resp.queue_ns = duration_cast<nanoseconds>(job.started - job.submitted).count();
+        resp.eval_ns = duration_cast<nanoseconds>(ServiceClock::now() - job.started).count();
+        return resp;
+    }
+
+    void complete(const Job& job, const EvalResponse& resp) {
+        using std::chrono::duration_cast;
+        using std::chrono::nanoseconds;
+        latency_.record(duration_cast<nanoseconds>(ServiceClock::now() - job.submitted).count());
+        if (on_done_) on_done_(resp);
+    }
+
+    void run(Worker& w) {
+        while (true) {
+            std::unique_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> lock(w.mutex);
+                w.cv.wait(lock, [&w] { return w.stopping || !w.ready.empty(); });
+                if (w.stopping) return;
+                job = pop_job(w);
+            }
+
+            size_t steps = 0;
+            auto resp = execute(*job, w.ctx, fuel_, steps);
+            {
+                std::lock_guard<std::mutex> lock(w.mutex);
+                end_job(w, steps, resp ? nullptr : std::move(job));
+            }
+            if (!resp) continue;
+            w.pending.fetch_sub(1, std::memory_order_relaxed);
+            complete(*job, *resp);
+
+            if (in_flight_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard<std::mutex> lock(drain_mutex_);
+                drain_cv_.notify_all();
+            }
+        }
+    }
+
+    Callback on_done_;
+    size_t fuel_;
+    std::atomic<size_t> preemptions_{0};
+    FunctionStore functions_;  // Shared by every worker and the admin context
+    Context admin_{&functions_};
+    std::mutex admin_mutex_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<size_t> in_flight_{0};
+    std::mutex drain_mutex_;
+    std::condition_variable drain_cv_;
+    LatencyStats latency_;
+};
+
+// `lisp_repl --serve [workers] [fuel]`: one request per stdin line, responses
+// on stdout in completion order as "<id> => <result>" or "<id> !! <error>",
+// followed by a latency summary on stderr at EOF.
+int run_service(size_t num_workers, size_t fuel) {
+    std::mutex out_mutex;
+    EvalService service(num_workers, [&out_mutex](const EvalResponse& r) {
+        std::lock_guard<std::mutex> lock(out_mutex);
+        std::cout << r.id << (r.ok ? " => " : " !! ") << r.result
+                  << "  [queue " << r.queue_ns / 1000 << "us, eval "
+                  << r.eval_ns / 1000 << "us]\n";
+    }, fuel);
+
+    auto start = ServiceClock::now();
+    uint64_t next_id = 1;
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        std::string_view sv(line);
+        if (!has_more_forms(sv)) continue;
+        service.submit(next_id++, std::move(line));
+    }
+    service.drain();
+    std::cout.flush();
+
+    double secs = std::chrono::duration<double>(ServiceClock::now() - start).count();
+    const auto& lat = service.latency();
+    std::cerr << "served " << lat.count() << " requests on "
+              << service.worker_count() << " workers in " << secs << "s ("
+              << (secs > 0 ? lat.count() / secs : 0.0) << " req/s), latency p50 "
+              << lat.percentile(50) / 1000 << "us p99 "
+              << lat.percentile(99) / 1000 << "us, " << service.preemptions()
+              << " preemptions" << std::endl;
+    return 0;
+}
+
+#ifdef __linux__
+// =============================================================================
+// SOCKET SERVER
+// =============================================================================
+// `lisp_repl --listen <path> [workers] [fuel]` serves an EvalService over a
+// Unix domain socket. A single thread runs a non-blocking epoll loop over the
+// listening socket and every connection. It evaluates nothing itself: the
+// only work it does for a request is EvalService::submit(), which for a
+// request starting with `defun` forms parses and stores them - no longer
+// than reading the line - and queues the rest for a worker. Each connected
+// client costs a file descriptor and two buffers, not a thread.
+//
+// Framing is one request per line, answered with one line: the value, or
+// "Error: ..." as in --batch. A client may pipeline requests. Responses come
+// back in request order even when workers finish them out of order. Each
+// connection is its own tenant, so one busy client cannot starve the others
+// (see EvalService).
+//
+// Workers hand finished responses to the loop through a locked list and an
+// eventfd that wakes it. Reading from a connection pauses while it has
+// MAX_PIPELINE requests outstanding or MAX_OUTPUT bytes unsent. A line longer
+// than MAX_LINE is answered with an error, and the connection is then closed.
+// =============================================================================
+class SocketServer {
+public:
+    static constexpr size_t MAX_LINE = 1 << 20;
+    static constexpr size_t MAX_PIPELINE = 1024;
+    static constexpr size_t MAX_OUTPUT = 1 << 20;
+
+    // Listen on `path`, replacing a stale socket file there
+    SocketServer(std::string path, size_t num_workers, size_t fuel = EvalService::DEFAULT_FUEL)
+        : path_(std::move(path)) {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (path_.empty() || path_.size() >= sizeof(addr.sun_path)) {
+            throw std::runtime_error("Socket path is empty or too long");
+        }
+        std::memcpy(addr.sun_path, path_.data(), path_.size());
+        ::unlink(path_.c_str());
+
+        epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+        wake_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (epoll_fd_ < 0 || wake_fd_ < 0 || listen_fd_ < 0) {
+            close_fds();
+            throw std::runtime_error("Cannot create server sockets");
+        }
+        if (::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+            ::listen(listen_fd_, SOMAXCONN) != 0) {
+            close_fds();
+            throw std::runtime_error("Cannot listen on socket path");
+        }
+        watch(listen_fd_, LISTENER, EPOLLIN, EPOLL_CTL_ADD);
+        watch(wake_fd_, WAKE, EPOLLIN, EPOLL_CTL_ADD);
+
+        service_ = std::make_unique<EvalService>(num_workers, [this](const EvalResponse& r) {
+            {
+                std::lock_guard<std::mutex> lock(done_mutex_);
+                done_.push_back(r);
+            }
+            wake();
+        }, fuel);
+    }
+
+    // Outstanding requests are abandoned and connections closed
+    ~SocketServer() {
+        service_.reset();
+        for (auto& [id, conn] : conns_) ::close(conn.fd);
+        close_fds();
+        ::unlink(path_.c_str());
+    }
+
+    SocketServer(const SocketServer&) = delete;
+    SocketServer& operator=(const SocketServer&) = delete;
+
+    // Serve until stop() is called
+    void run() {
+        epoll_event events[256];
+        while (!stopping_.load(std::memory_order_acquire)) {
+            int n = ::epoll_wait(epoll_fd_, events, 256, -1);
+            if (n < 0 && errno != EINTR) throw std::runtime_error("epoll_wait failed");
+            for (int i = 0; i < n; ++i) {
+                uint64_t key = events[i].data.u64;
+                if (key == LISTENER) {
+                    accept_all();
+                } else if (key == WAKE) {
+                    uint64_t count;
+                    [[maybe_unused]] ssize_t r = ::read(wake_fd_, &count, sizeof(count));
+                    deliver();
+                } else if (auto it = conns_.find(key); it != conns_.end()) {
+                    Connection& conn = it->second;
+                    uint32_t ev = events[i].events;
+                    if (ev & (EPOLLHUP | EPOLLERR)) {
+                        close_connection(conn);  // Closed by the client: nobody to answer
+                        continue;
+                    }
+                    if (ev & EPOLLIN) receive(conn);
+                    if ((ev & EPOLLOUT) && conns_.count(key)) send_pending(conn);
+                }
+            }
+        }
+    }
+
+    // Make run() return; callable from any thread
+    void stop() {
+        stopping_.store(true, std::memory_order_release);
+        wake();
+    }
+
+    // Open connections (loop thread only)
+    size_t connections() const { return conns_.size(); }
+    const LatencyStats& latency() const { return service_->latency(); }
+    size_t worker_count() const { return service_->worker_count(); }
+
+private:
+    // epoll keys: connections are numbered from FIRST_CONNECTION and never reused
+    static constexpr uint64_t LISTENER = 0;
+    static constexpr uint64_t WAKE = 1;
+    static constexpr uint64_t FIRST_CONNECTION = 2;
+
+    struct Pending {
+        uint64_t request;      // Service request id; increasing within a connection
+        bool done = false;
+        std::string response;  // Response line, set once done
+    };
+
+    struct Connection {
+        int fd = -1;
+        uint64_t key = 0;
+        uint32_t events = 0;            // Current epoll interest
+        bool eof = false;               // Client finished sending
+        std::string in;                 // Received bytes not yet framed
+        std::string out;                // Response bytes not yet sent
+        std::deque<Pending> pending;    // Submitted requests, oldest first
+    };
+
+    void watch(int fd, uint64_t key, uint32_t events, int op) {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.u64 = key;
+        ::epoll_ctl(epoll_fd_, op, fd, &ev);
+    }
+
+    void wake() {
+        uint64_t one = 1;
+        [[maybe_unused]] ssize_t r = ::write(wake_fd_, &one, sizeof(one));
+    }
+
+    void close_fds() {
+        for (int fd : {listen_fd_, wake_fd_, epoll_fd_}) {
+            if (fd >= 0) ::close(fd);
+        }
+    }
+
+    void accept_all() {
+        while (true) {
+            int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                // Out of descriptors: stop polling the listener (it would spin)
+                // until a connection closes
+                if (errno == EMFILE || errno == ENFILE) {
+                    ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, listen_fd_, nullptr);
+                    accepting_ = false;
+                }
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                return;
+            }
+            uint64_t key = next_key_++;
+            Connection& conn = conns_[key];
+            conn.fd = fd;
+            conn.key = key;
+            conn.events = EPOLLIN;
+            watch(fd, key, EPOLLIN, EPOLL_CTL_ADD);
+        }
+    }
+
+    void close_connection(Connection& conn) {
+        ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, conn.fd, nullptr);
+        ::close(conn.fd);
+        conns_.erase(conn.key);  // Responses still in flight are dropped on arrival
+        if (!accepting_) {
+            watch(listen_fd_, LISTENER, EPOLLIN, EPOLL_CTL_ADD);
+            accepting_ = true;
+        }
+    }
+
+    // One read per readiness event, so a fast sender can't monopolise the loop
+    void receive(Connection& conn) {
+        char buf[65536];
+        ssize_t n = ::read(conn.fd, buf, sizeof(buf));
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR) return;
+            close_connection(conn);
+            return;
+        }
+        if (n == 0) {
+            conn.eof = true;
+        } else {
+            conn.in.append(buf, static_cast<size_t>(n));
+        }
+        submit_lines(conn);
+        send_pending(conn);
+    }
+
+    // Submit complete lines from conn.in, up to the pipeline limit
+    void submit_lines(Connection& conn) {
+        size_t begin = 0;
+        while (conn.pending.size() < MAX_PIPELINE && begin < conn.in.size()) {
+            size_t nl = conn.in.find('\n', begin);
+            if (nl == std::string::npos) {
+                if (conn.in.size() - begin > MAX_LINE) {
+                    // Answered in order; the connection closes once it is sent
+                    conn.pending.push_back({UINT64_MAX, true, "Error: Request too long\n"});
+                    conn.eof = true;
+                    begin = conn.in.size();
+                    break;
+                }
+                if (!conn.eof) break;
+                nl = conn.in.size();  // Last line without a newline
+            }
+            std::string_view line(conn.in.data() + begin, nl - begin);
+            begin = std::min(nl + 1, conn.in.size());
+            if (!has_more_forms(line)) continue;
+            uint64_t request = next_request_++;
+            owners_[request] = conn.key;
+            conn.pending.push_back({request, false, {}});
+            service_->submit(request, std::string(line), conn.key);
+        }
+        conn.in.erase(0, begin);
+    }
+
+    // Route finished responses to their connections
+    void deliver() {
+        std::vector<EvalResponse> done;
+        {
+            std::lock_guard<std::mutex> lock(done_mutex_);
+            done.swap(done_);
+        }
+        for (EvalResponse& r : done) {
+            auto owner = owners_.find(r.id);
+            if (owner == owners_.end()) continue;
+            auto it = conns_.find(owner->second);
+            owners_.erase(owner);
+            if (it == conns_.end()) continue;  // Client went away
+            Connection& conn = it->second;
+            auto p = std::lower_bound(conn.pending.begin(), conn.pending.end(), r.id,
+                                      [](const Pending& a, uint64_t id) { return a.request < id; });
+            p->done = true;
+            p->response = r.ok ? std::move(r.result) : "Error: " + r.result;
+            p->response += '\n';
+            // Pipelined lines were held back while the window was full
+            if (conn.pending.size() >= MAX_PIPELINE) {
+                move_ready(conn);
+                submit_lines(conn);
+            }
+            send_pending(conn);
+        }
+    }
+
+    // Move the finished responses at the front of conn.pending to conn.out
+    static void move_ready(Connection& conn) {
+        while (!conn.pending.empty() && conn.pending.front().done) {
+            conn.out += conn.pending.front().response;
+            conn.pending.pop_front();
+        }
+    }
+
+    void send_pending(Connection& conn) {
+        move_ready(conn);
+        while (!conn.out.empty()) {
+            ssize_t n = ::send(conn.fd, conn.out.data(), conn.out.size(), MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN) break;
+                close_connection(conn);
+                return;
+            }
+            conn.out.erase(0, static_cast<size_t>(n));
+        }
+        update(conn);
+    }
+
+    // Close a finished connection, or match its epoll interest to its state
+    void update(Connection& conn) {
+        if (conn.eof && conn.pending.empty() && conn.out.empty()) {
+            close_connection(conn);
+            return;
+        }
+        uint32_t events = 0;
+        if (!conn.eof && conn.pending.size() < MAX_PIPELINE && conn.out.size() < MAX_OUTPUT) {
+            events |= EPOLLIN;
+        }
+        if (!conn.out.empty()) events |= EPOLLOUT;
+        if (events != conn.events) {
+            watch(conn.fd, conn.key, events, EPOLL_CTL_MOD);
+            conn.events = events;
+        }
+    }
+
+    std::string path_;
+    int epoll_fd_ = -1;
+    int wake_fd_ = -1;
+    int listen_fd_ = -1;
+    bool accepting_ = true;
+    std::atomic<bool> stopping_{false};
+    uint64_t next_key_ = FIRST_CONNECTION;
+    uint64_t next_request_ = 1;
+    std::unordered_map<uint64_t, Connection> conns_;
+    std::unordered_map<uint64_t, uint64_t> owners_;  // Request id -> connection key
+    std::mutex done_mutex_;
+    std::vector<EvalResponse> done_;
+    // Last: its workers call back into done_ until it is destroyed
+    std::unique_ptr<EvalService> service_;
+};
+
+// `lisp_repl --listen <path> [workers] [fuel]`: serve until SIGINT/SIGTERM,
+// then print a latency summary on stderr
+int run_socket_server(const char* path, size_t num_workers, size_t fuel) {
+    static SocketServer* active = nullptr;
+    SocketServer server(path, num_workers, fuel);
+    active = &server;
+    auto on_signal = [](int) { active->stop(); };
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+    std::cerr << "listening on " << path << " with " << server.worker_count() << " workers" << std::endl;
+    server.run();
+    const auto& lat = server.latency();
+    std::cerr << "served " << lat.count() << " requests, latency p50 " << lat.percentile(50) / 1000
+              << "us p99 " << lat.percentile(99) / 1000 << "us" << std::endl;
+    return 0;
+}
+#endif // __linux__
+
+} // namespace MiniLisp
+#endif // MINILISP_THREADS
+
+
+#if !defined(WASM_BUILD) && !defined(MINILISP_NO_MAIN)
+#ifndef MINIMAL_BUILD
+#include <csignal>  // For SIGINT in time-sliced REPL mode
+
+static volatile std::sig_atomic_t repl_interrupted = 0;
+
+// Command-line count `arg` (at least `min`); on anything else prints
+// `usage` and returns nullopt
+static std::optional<size_t> count_arg(std::string_view arg, size_t min, const char* usage) {
+    size_t value = 0;
+    auto [end, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), value);
+    if (ec != std::errc() || end != arg.data() + arg.size() || value < min) {
+        std::cerr << "Error: bad count '" << arg << "'\nUsage: " << usage << std::endl;
+        return std::nullopt;
+    }
+    return value;
+}
+#endif
+
 // 4. Main function to prove it works
-int main() {
+int main([[maybe_unused]] int argc, [[maybe_unused]] char** argv) {
     // --- COMPILE-TIME Evaluation ---
     // This all happens at compile-time!
     constexpr auto val = "(+ 10 (* 2 5))"_lisp;
@@ -862,17 +5958,91 @@ int main() {
     constexpr auto val5 = "(+ (car '(10 5)) (car (cdr '(3 20))))"_lisp;
     static_assert(val5 == 30); // 10 + 20
 
+#ifdef MINILISP_THREADS
+    // Service mode: `lisp_repl --serve [workers] [fuel]` (fuel 0: no preemption)
+    if (argc > 1 && std::string_view(argv[1]) == "--serve") {
+        const char* usage = "lisp_repl --serve [workers>=1] [fuel]";
+        auto workers = argc > 2 ? count_arg(argv[2], 1, usage)
+                                : std::max(1u, std::thread::hardware_concurrency());
+        auto fuel = argc > 3 ? count_arg(argv[3], 0, usage) : MiniLisp::EvalService::DEFAULT_FUEL;
+        if (!workers || !fuel) return 2;
+        return MiniLisp::run_service(*workers, *fuel);
+    }
+#ifdef __linux__
+    // Socket server: `lisp_repl --listen <path> [workers] [fuel]`
+    if (argc > 1 && std::string_view(argv[1]) == "--listen") {
+        const char* usage = "lisp_repl --listen <path> [workers>=1] [fuel]";
+        if (argc < 3) {
+            std::cerr << "Error: missing socket path\nUsage: " << usage << std::endl;
+            return 2;
+        }
+        auto workers = argc > 3 ? count_arg(argv[3], 1, usage)
+                                : std::max(1u, std::thread::hardware_concurrency());
+        auto fuel = argc > 4 ? count_arg(argv[4], 0, usage) : MiniLisp::EvalService::DEFAULT_FUEL;
+        if (!workers || !fuel) return 2;
+        return MiniLisp::run_socket_server(argv[2], *workers, *fuel);
+    }
+#endif
+#endif
+
 #ifndef MINIMAL_BUILD
+    // Batch mode: `lisp_repl --batch` evaluates forms streamed on stdin, one
+    // output line per form; exit status 1 if any failed
+    if (argc > 1 && std::string_view(argv[1]) == "--batch") {
+        MiniLisp::TaskPool batch_pool;
+        MiniLisp::Context batch_ctx;
+        batch_ctx.pool = &batch_pool;
+        return MiniLisp::run_pipeline(STDIN_FILENO, STDOUT_FILENO, batch_ctx) == 0 ? 0 : 1;
+    }
+
+    // NDJSON mode: `lisp_repl --ndjson` answers one JSON request per line
+    // (see NDJSON PROTOCOL). Exits with status 1 if any request failed.
+    if (argc > 1 && std::string_view(argv[1]) == "--ndjson") {
+        MiniLisp::TaskPool ndjson_pool;
+        MiniLisp::Context ndjson_ctx;
+        ndjson_ctx.pool = &ndjson_pool;
+        return MiniLisp::run_ndjson(STDIN_FILENO, STDOUT_FILENO, ndjson_ctx) == 0 ? 0 : 1;
+    }
+
+    // Script mode: `lisp_repl script.lisp` evaluates the file's forms in order
+    // and prints the value of the last one
+    if (argc > 1 && argv[1][0] != '-') {
+        MiniLisp::TaskPool script_pool;  // Parses large scripts in parallel
+        MiniLisp::Context script_ctx;
+        script_ctx.pool = &script_pool;
+        try {
+            std::cout << MiniLisp::print_sexpr(MiniLisp::run_script(argv[1], script_ctx)) << std::endl;
+        } catch (const MiniLisp::SourceError& e) {
+            std::cerr << e.location() << ": Error: " << e.message() << std::endl;
+            return 1;
+        } catch (const std::exception& e) {
+            std::cerr << argv[1] << ": Error: " << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
     std::cout << "Compile-time tests passed!" << std::endl;
 
     // --- RUNTIME Evaluation (REPL) with Environment ---
     std::cout << "\n--- MiniLisp Runtime REPL ---" << std::endl;
-    std::cout << "Supports: defun, if, <, >, =, <=, >=" << std::endl;
+    std::cout << "Supports: defun, if, <, >, =, <=, >=, pmap, preduce, future, touch, spawn, send, receive, self" << std::endl;
     std::cout << "Enter Lisp expression or 'q' to quit." << std::endl;
 
-    MiniLisp::FunctionStore repl_fn_store;
-    MiniLisp::Env repl_env(&repl_fn_store);  // Persistent environment for REPL
+    MiniLisp::TaskPool repl_pool;  // Workers for pmap/preduce (started on first use)
+    MiniLisp::Context repl_ctx;    // Persistent interpreter state for the REPL
+    repl_ctx.pool = &repl_pool;
+    size_t slice_steps = 0;        // --slice N: time-sliced evaluation, Ctrl-C interrupts
+    for (int i = 1; i < argc; ++i) {
+        if (std::string_view(argv[i]) == "--par-args") repl_ctx.limits.par_args = true;
+        if (std::string_view(argv[i]) == "--slice" && i + 1 < argc) {
+            auto steps = count_arg(argv[++i], 1, "lisp_repl [--slice steps>=1] [--par-args]");
+            if (!steps) return 2;
+            slice_steps = *steps;
+        }
+    }
     std::string line;
+    std::string printed;           // Reused for every result
     while (true) {
         std::cout << "> ";
         if (!std::getline(std::cin, line) || line == "q") {
@@ -884,20 +6054,26 @@ int main() {
         try {
             std::string_view sv(line);
             // Use interning parser for runtime - ensures symbol lifetime
-            auto ast = MiniLisp::parse_interned(sv);
-            auto result = MiniLisp::eval_with_env(ast, repl_env);
-
-            // Print result
-            if (result.atom.has_value()) {
-                const auto& atom = *result.atom;
-                if (std::holds_alternative<long>(atom)) {
-                    std::cout << "=> " << std::get<long>(atom) << std::endl;
-                } else {
-                    std::cout << "=> " << std::get<std::string_view>(atom) << std::endl;
+            std::optional<MiniLisp::SExpr> evaluated;
+            if (slice_steps > 0) {
+                // Between slices the REPL notices Ctrl-C and abandons the evaluation
+                MiniLisp::SlicedEval ev(sv, repl_ctx, slice_steps);
+                repl_interrupted = 0;
+                auto previous = std::signal(SIGINT, [](int) { repl_interrupted = 1; });
+                while (!ev.step() && !repl_interrupted) {}
+                std::signal(SIGINT, previous);
+                if (!ev.done()) {
+                    std::cerr << "Interrupted" << std::endl;
+                    continue;
                 }
+                evaluated = ev.result();
             } else {
-                std::cout << "=> (list)" << std::endl;
+                auto ast = MiniLisp::parse_interned(sv, repl_ctx);
+                evaluated = MiniLisp::eval_toplevel(ast, repl_ctx);
             }
+            printed = "=> ";
+            MiniLisp::print_sexpr(printed, *evaluated);
+            std::cout << printed << std::endl;
         } catch (const std::exception& e) {
             std::cerr << "Error: " << e.what() << std::endl;
         }
@@ -929,4 +6105,4 @@ int main() {
 
     return 0;
 }
-#endif // WASM_BUILD
+#endif // !WASM_BUILD && !MINILISP_NO_MAIN
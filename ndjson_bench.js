@@ -0,0 +1,102 @@
+// ndjson_bench.js - Throughput of `lisp_repl --ndjson` over a local pipe
+// =============================================================================
+// Run (make bench-ndjson):
+//   node ndjson_bench.js [requests] [window] [fib_n]
+//
+// Spawns ./lisp_repl --ndjson and keeps up to `window` requests in flight on
+// its stdin (window 1 is strict request/response). Reports requests per second
+// and the round-trip latency percentiles seen by this client. Every response
+// is checked against its request id.
+// =============================================================================
+'use strict';
+
+const fs = require('fs');
+const { spawn } = require('child_process');
+
+// Line-delimited JSON client for one `lisp_repl --ndjson` child process
+class NdjsonClient {
+    constructor(binary = './lisp_repl') {
+        this.child = spawn(binary, ['--ndjson'], { stdio: ['pipe', 'pipe', 'inherit'] });
+        this.pending = new Map();  // Request id -> { resolve, sent }
+        this.nextId = 1;
+        this.partial = '';
+        this.child.stdout.setEncoding('utf8');
+        this.child.stdout.on('data', chunk => {
+            const lines = (this.partial + chunk).split('\n');
+            this.partial = lines.pop();
+            for (const line of lines) {
+                const response = JSON.parse(line);
+                const request = this.pending.get(response.id);
+                this.pending.delete(response.id);
+                request.resolve({ ...response, rtt: process.hrtime.bigint() - request.sent });
+            }
+        });
+    }
+
+    // Resolves with the response object plus `rtt` (round trip, ns)
+    send(src, options) {
+        const id = this.nextId++;
+        return new Promise(resolve => {
+            this.pending.set(id, { resolve, sent: process.hrtime.bigint() });
+            this.child.stdin.write(JSON.stringify(options ? { id, src, options } : { id, src }) + '\n');
+        });
+    }
+
+    close() {
+        return new Promise(resolve => {
+            this.child.on('exit', resolve);
+            this.child.stdin.end();
+        });
+    }
+}
+
+function percentile(sorted, p) {
+    return sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))];
+}
+
+async function benchmark(requests, window, fibN) {
+    const client = new NdjsonClient();
+    await client.send('(defun fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))');
+    const call = `(fib ${fibN})`;
+    const expected = (await client.send(call)).result;
+
+    const rtts = [];
+    let next = 0;
+    const start = process.hrtime.bigint();
+    async function lane() {
+        while (next < requests) {
+            next++;
+            const response = await client.send(call);
+            if (!response.ok || response.result !== expected) {
+                throw new Error(`bad response: ${JSON.stringify(response)}`);
+            }
+            rtts.push(Number(response.rtt) / 1e3);
+        }
+    }
+    await Promise.all(Array.from({ length: window }, lane));
+    const secs = Number(process.hrtime.bigint() - start) / 1e9;
+    await client.close();
+
+    rtts.sort((a, b) => a - b);
+    console.log(String(window).padStart(8) + (requests / secs).toFixed(0).padStart(12) +
+                percentile(rtts, 0.5).toFixed(1).padStart(12) +
+                percentile(rtts, 0.99).toFixed(1).padStart(12));
+}
+
+if (require.main === module) {
+    const [requests = 100000, maxWindow = 256, fibN = 5] = process.argv.slice(2).map(Number);
+    if (!fs.existsSync('./lisp_repl')) {
+        console.error('Error: lisp_repl not found. Run "make" first.');
+        process.exit(1);
+    }
+    (async () => {
+        console.log(`ndjson pipe: ${requests} x (fib ${fibN})`);
+        console.log('window'.padStart(8) + 'req/s'.padStart(12) + 'p50 us'.padStart(12) + 'p99 us'.padStart(12));
+        for (let w = 1; w <= maxWindow; w *= 16) await benchmark(requests, w, fibN);
+    })().catch(e => {
+        console.error('Benchmark error:', e);
+        process.exit(1);
+    });
+}
+
+module.exports = { NdjsonClient };
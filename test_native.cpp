@@ -0,0 +1,1682 @@
+// test_native.cpp - Runtime test suite for the native MiniLisp build
+// =============================================================================
+// Run with: make test
+//
+// The compile-time tests in main.cpp cover the language itself; this suite
+// covers what only exists at runtime:
+// 1. Per-instance interpreter contexts
+// 2. Contexts sharing one FunctionStore
+// 3. Concurrent readers while functions are hot-redefined (RCU store)
+// 4. Time-sliced (coroutine) evaluation
+// 5. Actors (spawn/send/receive), with and without a TaskPool
+// 6. Parallel parsing (parse_program), mapped script files and the concurrent
+//    symbol table
+// 7. pmap/preduce, futures and --par-args, with and without a TaskPool
+// 8. Binary S-expression encoding, the streaming batch pipeline and the
+//    NDJSON protocol
+// 9. Fuel-limited evaluation, preemptive, tenant-fair EvalService turns and
+//    the Unix socket server
+// 10. Batch evaluation (BatchProgram): interpreted, compiled and in SIMD lanes
+// 11. Incremental re-evaluation of an edited document (LiveDocument)
+//
+// Like bench.cpp, it includes main.cpp directly with main() suppressed.
+// =============================================================================
+#define MINILISP_NO_MAIN
+#include "main.cpp"
+
+#include <cstdio>
+#include <limits>
+
+using namespace MiniLisp;
+
+static int passed = 0;
+static int failed = 0;
+
+// Test runner with colored output
+template <typename F>
+static void test(const char* name, F&& fn) {
+    try {
+        fn();
+        std::printf("\x1b[32m  PASS\x1b[0m %s\n", name);
+        ++passed;
+    } catch (const std::exception& e) {
+        std::printf("\x1b[31m  FAIL\x1b[0m %s\n", name);
+        std::printf("       %s\n", e.what());
+        ++failed;
+    }
+}
+
+static void expect(bool cond, const std::string& what) {
+    if (!cond) throw std::runtime_error(what);
+}
+
+static long eval_num(const std::string& src, Context& ctx) {
+    SExpr r = eval_string(src, ctx);
+    expect(r.atom && std::holds_alternative<long>(*r.atom), "expected a number from " + src);
+    return std::get<long>(*r.atom);
+}
+
+static void test_contexts() {
+    std::printf("\nContexts:\n");
+
+    test("definitions are private to a context", [] {
+        Context a, b;
+        eval_string("(defun f (x) (+ x 1))", a);
+        expect(eval_num("(f 1)", a) == 2, "f in a");
+        bool threw = false;
+        try { eval_string("(f 1)", b); } catch (const std::exception&) { threw = true; }
+        expect(threw, "f must be undefined in b");
+    });
+
+    test("contexts on separate threads don't interfere", [] {
+        constexpr int THREADS = 8;
+        std::atomic<int> bad{0};
+        std::vector<std::thread> threads;
+        for (int i = 0; i < THREADS; ++i) {
+            threads.emplace_back([&bad, i] {
+                Context ctx;
+                // Same name, different body in every context
+                eval_string("(defun f (x) (+ x " + std::to_string(i) + "))", ctx);
+                for (long x = 0; x < 2000; ++x) {
+                    if (eval_num("(f " + std::to_string(x) + ")", ctx) != x + i) bad.fetch_add(1);
+                }
+            });
+        }
+        for (auto& t : threads) t.join();
+        expect(bad.load() == 0, std::to_string(bad.load()) + " results from another context");
+    });
+
+    test("reset forgets definitions", [] {
+        Context ctx;
+        eval_string("(defun f (x) x)", ctx);
+        ctx.reset();
+        expect(ctx.functions.size() == 0, "store not empty after reset");
+    });
+
+    test("contexts can share a store", [] {
+        FunctionStore shared;
+        Context a(&shared), b(&shared);
+        eval_string("(defun twice (x) (* 2 x))", a);
+        expect(eval_num("(twice 21)", b) == 42, "b sees a's definition");
+        eval_string("(defun twice (x) (+ x x x))", b);
+        expect(eval_num("(twice 1)", a) == 3, "a sees b's redefinition");
+    });
+}
+
+static void test_rcu() {
+    std::printf("\nRCU FunctionStore:\n");
+
+    test("a looked-up Lambda outlives its redefinition while guarded", [] {
+        Context ctx;
+        eval_string("(defun f (x) (* x 10))", ctx);
+        {
+            FunctionStore::ReadGuard guard(ctx.functions);
+            const Lambda* old = ctx.functions.lookup("f");
+            expect(old != nullptr, "f defined");
+            eval_string("(defun f (x) x)", ctx);
+            expect(ctx.functions.lookup("f") != old, "new version published");
+            expect(old->params.size() == 1 && old->body.size() == 3, "old version intact");
+            expect(ctx.functions.retired_count() == 1, "old snapshot kept while guarded");
+        }
+        expect(ctx.functions.retired_count() == 0, "retired snapshots reclaimed");
+        expect(eval_num("(f 7)", ctx) == 7, "later call sees new body");
+    });
+
+    test("concurrent readers during hot redefinition", [] {
+        FunctionStore shared;
+        Context admin(&shared);
+        eval_string("(defun rule (x) (* 2 x))", admin);
+
+        constexpr int READERS = 4;
+        constexpr int WRITES = 500;
+        std::atomic<bool> done{false};
+        std::atomic<long> bad{0};
+        std::atomic<long> reads{0};
+        std::vector<std::thread> readers;
+        // A reader that stays in one read section until every write is done,
+        // so the last writes cannot free what they retire
+        std::atomic<bool> holding{false};
+        readers.emplace_back([&] {
+            FunctionStore::ReadGuard guard(shared);
+            holding.store(true, std::memory_order_release);
+            while (!done.load(std::memory_order_acquire)) std::this_thread::yield();
+        });
+        while (!holding.load(std::memory_order_acquire)) std::this_thread::yield();
+        for (int i = 0; i < READERS; ++i) {
+            readers.emplace_back([&, i] {
+                Context ctx(&shared);
+                long x = i + 1;
+                std::string call = "(rule " + std::to_string(x) + ")";
+                // Every result must come from exactly one complete version
+                while (!done.load(std::memory_order_acquire)) {
+                    long r = eval_num(call, ctx);
+                    if (r != 2 * x && r != 3 * x) bad.fetch_add(1);
+                    reads.fetch_add(1, std::memory_order_relaxed);
+                }
+            });
+        }
+        for (int w = 0; w < WRITES; ++w) {
+            eval_string(w % 2 ? "(defun rule (x) (* 2 x))" : "(defun rule (x) (* 3 x))", admin);
+            std::this_thread::yield();
+        }
+        size_t retired = shared.retired_count();
+        done.store(true, std::memory_order_release);
+        for (auto& t : readers) t.join();
+
+        expect(bad.load() == 0, std::to_string(bad.load()) + " torn reads");
+        expect(reads.load() > 0, "readers made no progress");
+        expect(shared.size() == 1, "exactly one rule defined");
+        expect(retired > 0, "writes freed snapshots a reader could still see");
+        // With no further writes, the readers' exits free the rest
+        expect(shared.retired_count() == 0, std::to_string(shared.retired_count()) + " retired snapshots left");
+    });
+
+    test("more than 1024 threads can read at once", [] {
+        FunctionStore shared;
+        Context admin(&shared);
+        eval_string("(defun g () 1)", admin);
+        constexpr int THREADS = 1100;
+        std::atomic<int> inside{0};
+        std::atomic<bool> release{false};
+        std::vector<std::thread> threads;
+        for (int i = 0; i < THREADS; ++i) {
+            threads.emplace_back([&] {
+                FunctionStore::ReadGuard guard(shared);
+                inside.fetch_add(1);
+                while (!release.load(std::memory_order_acquire)) std::this_thread::yield();
+            });
+        }
+        while (inside.load() < THREADS) std::this_thread::yield();
+        eval_string("(defun g () 2)", admin);
+        expect(shared.retired_count() == 1, "old snapshot kept while all threads read");
+        release.store(true, std::memory_order_release);
+        for (auto& t : threads) t.join();
+        expect(shared.retired_count() == 0, "retired snapshot freed once every reader left");
+        expect(eval_num("(g)", admin) == 2, "new definition visible");
+    });
+
+    test("service requests see definitions submitted before them", [] {
+        std::mutex m;
+        std::vector<EvalResponse> responses;
+        EvalService service(3, [&](const EvalResponse& r) {
+            std::lock_guard<std::mutex> lock(m);
+            responses.push_back(r);
+        });
+        service.submit(1, "(defun v () 1)");
+        for (uint64_t id = 2; id < 50; ++id) service.submit(id, "(v)");
+        service.submit(50, "(defun v () 2)");
+        for (uint64_t id = 51; id < 100; ++id) service.submit(id, "(v)");
+        service.drain();
+
+        expect(responses.size() == 99, "all requests answered");
+        for (const auto& r : responses) {
+            expect(r.ok, "request " + std::to_string(r.id) + " failed: " + r.result);
+            if (r.id == 1 || r.id == 50) continue;
+            // Each request sees the definitions submitted before it, however long it queued
+            std::string want = r.id < 50 ? "1" : "2";
+            expect(r.result == want, "request " + std::to_string(r.id) + " => " + r.result);
+        }
+    });
+}
+
+// Runs `ev` to completion; returns the number of slices it took
+static size_t run_slices(SlicedEval& ev) {
+    size_t slices = 1;
+    while (!ev.step()) ++slices;
+    return slices;
+}
+
+static void test_sliced() {
+    std::printf("\nTime-sliced evaluation:\n");
+    const char* fib = "(defun fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))";
+
+    test("same result as eval, across many slices", [&] {
+        Context ctx;
+        eval_string(fib, ctx);
+        SlicedEval ev("(fib 15)", ctx, 100);
+        expect(run_slices(ev) > 10, "evaluation was not sliced");
+        SExpr r = ev.result();
+        expect(std::get<long>(*r.atom) == eval_num("(fib 15)", ctx), "result differs");
+    });
+
+    test("interleaved evaluations on one context", [&] {
+        Context ctx;
+        eval_string(fib, ctx);
+        SlicedEval a("(fib 12)", ctx, 7), b("(+ (fib 10) 1)", ctx, 3);
+        bool done_a = false, done_b = false;
+        while (!done_a || !done_b) {
+            if (!done_a) done_a = a.step();
+            if (!done_b) done_b = b.step();
+        }
+        expect(std::get<long>(*a.result().atom) == 144, "a");
+        expect(std::get<long>(*b.result().atom) == 56, "b");
+    });
+
+    test("errors surface from result()", [&] {
+        Context ctx;
+        SlicedEval ev("(+ 1 (car (quote ())))", ctx, 1);
+        run_slices(ev);
+        bool threw = false;
+        try { ev.result(); } catch (const std::runtime_error&) { threw = true; }
+        expect(threw, "expected an error");
+    });
+
+    test("abandoning a suspended evaluation frees its frames", [&] {
+        Context ctx;
+        eval_string(fib, ctx);
+        SlicedEval ev("(fib 20)", ctx, 50);
+        for (int i = 0; i < 10; ++i) ev.step();
+        expect(!ev.done(), "finished too early");
+    });  // ASan reports any leaked frame
+
+    test("deep recursion up to the limit", [] {
+        Context ctx;
+        eval_string("(defun down (n) (if (= n 0) 0 (+ 1 (down (- n 1)))))", ctx);
+        SlicedEval ev("(down 2900)", ctx, 1000);
+        run_slices(ev);
+        expect(std::get<long>(*ev.result().atom) == 2900, "depth");
+    });
+
+    test("redefinition between slices keeps the running body", [] {
+        Context ctx;
+        eval_string("(defun f (n) (if (= n 0) 0 (+ 2 (f (- n 1)))))", ctx);
+        SlicedEval ev("(f 100)", ctx, 10);
+        ev.step();
+        eval_string("(defun f (n) 1000)", ctx);
+        run_slices(ev);
+        // Frames already running finish with the old body; new calls see the new one
+        long r = std::get<long>(*ev.result().atom);
+        expect(r > 1000 && r % 2 == 0, "got " + std::to_string(r));
+    });
+}
+
+// `(* 0 a b)` evaluates a then b: the language has no sequencing form
+static const char* PING_PONG =
+    "(defun ponger (n) (if (= n 0) 0 (ponger (- n (+ 1 (* 0 (send (receive) 0)))))))"
+    "(defun pinger (peer n) (if (= n 0) (send 0 n)"
+    "  (pinger peer (- n (+ 1 (* 0 (send peer (self)) (receive)))))))";
+
+static void test_actors(TaskPool* pool, const char* label) {
+    std::printf("\nActors (%s):\n", label);
+
+    test("top level receives what a process sends", [&] {
+        Context ctx;
+        ctx.pool = pool;
+        eval_string("(defun twice () (send 0 (* 2 (receive))))", ctx);
+        long pid = eval_num("(spawn twice)", ctx);
+        eval_string("(send " + std::to_string(pid) + " 21)", ctx);
+        expect(eval_num("(receive)", ctx) == 42, "reply");
+    });
+
+    test("ping-pong between two processes", [&] {
+        Context ctx;
+        ctx.pool = pool;
+        eval_string(PING_PONG, ctx);
+        eval_string("(spawn pinger (spawn ponger 500) 500)", ctx);
+        expect(eval_num("(receive)", ctx) == 0, "pinger finished");
+    });
+
+    test("token around a ring of 200 processes", [&] {
+        Context ctx;
+        ctx.pool = pool;
+        // Each node forwards the token (incremented) `laps` times
+        eval_string("(defun node (next laps) (if (= laps 0) 0"
+                    "  (node next (- laps (+ 1 (* 0 (send next (+ 1 (receive)))))))))", ctx);
+        std::string spawns;
+        for (int i = 1; i <= 200; ++i) {
+            spawns += "(spawn node " + std::to_string(i == 200 ? 0 : i + 1) + " 3)";
+        }
+        eval_string(spawns, ctx);
+        eval_string("(send 1 0)", ctx);
+        long token = 0;
+        for (int lap = 0; lap < 3; ++lap) {
+            token = eval_num("(receive)", ctx);
+            if (lap < 2) eval_string("(send 1 " + std::to_string(token) + ")", ctx);
+        }
+        expect(token == 600, "token = " + std::to_string(token));
+    });
+
+    test("full mailboxes apply backpressure without losing messages", [&] {
+        Context ctx;
+        ctx.pool = pool;
+        ctx.limits.mailbox_capacity = 2;
+        eval_string("(defun flood (to n) (if (= n 0) 0 (flood to (- n (+ 1 (* 0 (send to n)))))))"
+                    "(defun sum (n acc) (if (= n 0) (send 0 acc) (sum (- n 1) (+ acc (receive)))))", ctx);
+        long sink = eval_num("(spawn sum 300 0)", ctx);
+        eval_string("(spawn flood " + std::to_string(sink) + " 100)"
+                    "(spawn flood " + std::to_string(sink) + " 100)"
+                    "(spawn flood " + std::to_string(sink) + " 100)", ctx);
+        expect(eval_num("(receive)", ctx) == 3 * 5050, "sum of all messages");
+    });
+
+    test("an error ends only its own process", [&] {
+        Context ctx;
+        ctx.pool = pool;
+        eval_string("(defun bad () (car (receive)))"
+                    "(defun good () (send 0 (+ 1 (receive))))", ctx);
+        long bad = eval_num("(spawn bad)", ctx);
+        long good = eval_num("(spawn good)", ctx);
+        eval_string("(send " + std::to_string(bad) + " 1)", ctx);
+        eval_string("(send " + std::to_string(good) + " 1)", ctx);
+        expect(eval_num("(receive)", ctx) == 2, "good replied");
+    });
+
+    test("receive with no possible sender is an error", [&] {
+        Context ctx;
+        ctx.pool = pool;
+        eval_string("(defun idle () (receive))", ctx);
+        eval_string("(spawn idle)", ctx);
+        bool threw = false;
+        try { eval_string("(receive)", ctx); } catch (const std::runtime_error&) { threw = true; }
+        expect(threw, "expected deadlock error");
+    });  // Destroying ctx frees the still-waiting process
+
+    test("message-passing names cannot be redefined", [&] {
+        Context ctx;
+        ctx.pool = pool;
+        for (const char* name : {"self", "send", "receive", "spawn", "if", "<"}) {
+            bool threw = false;
+            try { eval_string(std::string("(defun ") + name + " () 1)", ctx); } catch (const std::runtime_error&) { threw = true; }
+            expect(threw, std::string("defined ") + name);
+            expect(!ctx.functions.lookup(ctx.intern(name)), std::string(name) + " was stored");
+        }
+        expect(eval_num("(self)", ctx) == 0, "self");
+    });
+
+    test("the actor system is created once under concurrent first use", [&] {
+        Context ctx;
+        ctx.pool = pool;
+        std::vector<ActorSystem*> seen(8);
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < seen.size(); ++i) {
+            threads.emplace_back([&ctx, &seen, i] { seen[i] = &actors_of(ctx); });
+        }
+        for (auto& t : threads) t.join();
+        for (ActorSystem* a : seen) expect(a == seen[0] && a == ctx.actors.get(), "two actor systems");
+    });
+}
+
+// Structural equality; interned symbols must be the very same storage
+static bool same_ast(const SExpr& a, const SExpr& b) {
+    if (a.atom.has_value() != b.atom.has_value()) return false;
+    if (a.atom) {
+        if (a.atom->index() != b.atom->index()) return false;
+        if (std::holds_alternative<long>(*a.atom)) return std::get<long>(*a.atom) == std::get<long>(*b.atom);
+        return std::get<std::string_view>(*a.atom).data() == std::get<std::string_view>(*b.atom).data();
+    }
+    if (a.list->size() != b.list->size()) return false;
+    for (size_t i = 0; i < a.list->size(); ++i) {
+        if (!same_ast((*a.list)[i], (*b.list)[i])) return false;
+    }
+    return true;
+}
+
+// Deterministic source with nesting, quotes, odd spacing and atoms containing '('
+static std::string generated_source(size_t forms) {
+    std::string src;
+    uint64_t seed = 12345;
+    auto rnd = [&seed](uint64_t n) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        return (seed >> 33) % n;
+    };
+    const char* atoms[] = {"x", "-7", "42", "fib", "a(b", "+", "-", "rule-1", "q-", "n"};
+    for (size_t f = 0; f < forms; ++f) {
+        size_t depth = 0;
+        src += rnd(4) == 0 ? "'(" : "(";
+        ++depth;
+        while (depth > 0) {
+            switch (rnd(6)) {
+                case 0: src += " ("; ++depth; break;
+                case 1: src += " '"; src += atoms[rnd(10)]; break;
+                case 2: src += ")"; --depth; break;
+                default: src += rnd(3) == 0 ? "\n\t" : " "; src += atoms[rnd(10)]; break;
+            }
+            if (src.size() % 97 == 0 && depth > 0) { src += ")"; --depth; }
+        }
+        src += rnd(2) ? "\n" : "  ";
+    }
+    return src;
+}
+
+static void test_parsing(TaskPool& pool) {
+    std::printf("\nParallel parsing:\n");
+
+    test("form boundaries match the sequential parser", [] {
+        auto forms = split_toplevel_forms(" (a (b c))\n'x 7 '(1 2)(d e)f(g (h) ");
+        std::vector<std::string> want = {"(a (b c))", "'x", "7", "'(1 2)", "(d e)", "f(g", "(h)"};
+        expect(forms.size() == want.size(), std::to_string(forms.size()) + " forms");
+        for (size_t i = 0; i < want.size(); ++i) {
+            expect(forms[i] == want[i], "form " + std::to_string(i) + ": " + std::string(forms[i]));
+        }
+    });
+
+    test("vector and portable byte classification agree", [] {
+        uint64_t seed = 99;
+        char block[64];
+        const char alphabet[] = " \n\t()'a\x80\xff";
+        for (int round = 0; round < 2000; ++round) {
+            for (char& c : block) {
+                seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+                c = round % 2 ? alphabet[(seed >> 33) % 10] : static_cast<char>(seed >> 56);
+            }
+            BlockMasks fast = classify_block(block), swar = classify_block_swar(block);
+            expect(fast.ws == swar.ws && fast.open == swar.open && fast.close == swar.close &&
+                   fast.quote == swar.quote, "masks differ in round " + std::to_string(round));
+        }
+    });
+
+    test("indexed parse matches parse_interned on arbitrary input", [&] {
+        // Random text over the characters that matter, at lengths crossing
+        // 64-byte blocks; either the same forms or the same first error
+        uint64_t seed = 7;
+        auto rnd = [&seed](uint64_t n) {
+            seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+            return (seed >> 33) % n;
+        };
+        const char alphabet[] = "  \n\t(((())'ab1-";
+        for (int round = 0; round < 3000; ++round) {
+            std::string src;
+            size_t len = rnd(200);
+            for (size_t i = 0; i < len; ++i) src += alphabet[rnd(sizeof(alphabet) - 1)];
+            Context ctx;
+            std::vector<SExpr> want;
+            std::string want_error, got_error;
+            try {
+                std::string_view rest(src);
+                while (has_more_forms(rest)) want.push_back(parse_interned(rest, ctx));
+            } catch (const std::runtime_error& e) { want_error = e.what(); }
+            std::vector<SExpr> got;
+            try { got = parse_program(src, ctx); } catch (const std::runtime_error& e) { got_error = e.what(); }
+            std::string where = "input '" + src + "'";
+            expect(got_error == want_error, "error '" + got_error + "' vs '" + want_error + "' for " + where);
+            if (!want_error.empty()) continue;
+            expect(got.size() == want.size(), "form count for " + where);
+            for (size_t i = 0; i < want.size(); ++i) expect(same_ast(got[i], want[i]), "form differs for " + where);
+        }
+    });
+
+    test("parallel parse gives the same ASTs as parse_interned", [&] {
+        std::string src = generated_source(20000);
+        Context ctx;
+        ctx.pool = &pool;
+        ctx.limits.par_parse_min_bytes = 0;
+        std::vector<SExpr> parallel = parse_program(src, ctx);
+        std::string_view rest(src);
+        size_t i = 0;
+        while (has_more_forms(rest)) {
+            SExpr seq = parse_interned(rest, ctx);
+            expect(i < parallel.size(), "parallel parse returned too few forms");
+            expect(same_ast(seq, parallel[i]), "form " + std::to_string(i) + " differs");
+            ++i;
+        }
+        expect(i == parallel.size(), "form count differs");
+    });
+
+    test("the earliest syntax error is reported", [&] {
+        std::string src = generated_source(5000) + " (ok) ) " + generated_source(5000) + " (";
+        Context ctx;
+        ctx.pool = &pool;
+        ctx.limits.par_parse_min_bytes = 0;
+        std::string what;
+        try { parse_program(src, ctx); } catch (const std::runtime_error& e) { what = e.what(); }
+        expect(what == "Empty atom", "got '" + what + "'");
+    });
+
+    test("scripts parse from a mapped file", [&] {
+        std::string path = "/tmp/minilisp_test_" + std::to_string(::getpid()) + ".lisp";
+        auto write_file = [&path](const std::string& text) {
+            std::FILE* f = std::fopen(path.c_str(), "w");
+            expect(f != nullptr, "cannot create " + path);
+            std::fwrite(text.data(), 1, text.size(), f);
+            std::fclose(f);
+        };
+        std::string src = generated_source(5000);
+        write_file(src);
+        Context ctx;
+        ctx.pool = &pool;
+        ctx.limits.par_parse_min_bytes = 0;
+        std::vector<SExpr> mapped = load_script(path.c_str(), ctx);
+        std::vector<SExpr> parsed = parse_program(src, ctx);
+        expect(mapped.size() == parsed.size(), "form count differs");
+        for (size_t i = 0; i < parsed.size(); ++i) {
+            expect(same_ast(mapped[i], parsed[i]), "form " + std::to_string(i) + " differs");
+        }
+
+        write_file("(defun sq (x)\n  (* x x))\n(sq 7)\n(+ (sq 2)\n   1)\n");
+        Context run;
+        long last = get_long(run_script(path.c_str(), run));
+        expect(last == 5, "last result " + std::to_string(last));
+        expect(eval_num("(sq 3)", run) == 9, "definitions persist after the script");
+
+        write_file("");
+        expect(get_long(run_script(path.c_str(), run)) == 0, "empty script");
+        std::remove(path.c_str());
+        bool threw = false;
+        try { load_script(path.c_str(), run); } catch (const std::runtime_error&) { threw = true; }
+        expect(threw, "missing file did not throw");
+    });
+
+    test("source locations of parsed lists and syntax errors", [&] {
+        Context ctx;
+        SourceMap map("rules.lisp");
+        std::vector<SExpr> forms = parse_program("(a\n  (b c)\n 'd)\n\t(e ())", ctx, &map);
+        auto where = [&map](const SExpr& e) {
+            auto loc = map.locate(*e.list);
+            return loc ? map.describe(*loc) : "none";
+        };
+        expect(map.size() == 4, std::to_string(map.size()) + " lists");
+        expect(where(forms[0]) == "rules.lisp:1:1", where(forms[0]));
+        expect(where((*forms[0].list)[1]) == "rules.lisp:2:3", where((*forms[0].list)[1]));
+        expect(where((*forms[0].list)[2]) == "rules.lisp:3:2", "quote: " + where((*forms[0].list)[2]));
+        expect(where(forms[1]) == "rules.lisp:4:2", where(forms[1]));
+        expect(where(SExpr{List(*forms[1].list)}) == "none", "a copy is a new node");
+
+        // Parallel chunks record every list too
+        std::string src = generated_source(20000);
+        ctx.pool = &pool;
+        ctx.limits.par_parse_min_bytes = 0;
+        SourceMap big;
+        forms = parse_program(src, ctx, &big);
+        size_t lists = 0;
+        std::vector<const SExpr*> todo;
+        for (const SExpr& f : forms) todo.push_back(&f);
+        while (!todo.empty()) {
+            const SExpr* e = todo.back();
+            todo.pop_back();
+            if (!e->list || e->list->empty()) continue;
+            ++lists;
+            expect(big.locate(*e->list).has_value(), "unlocated list");
+            for (const SExpr& child : *e->list) todo.push_back(&child);
+        }
+        expect(lists == big.size(), std::to_string(lists) + " lists, " + std::to_string(big.size()) + " recorded");
+
+        std::string what;
+        try {
+            parse_program(src + "\n(ok) (+ 1\n  (x) (q", ctx, &big);
+        } catch (const SourceError& e) {
+            what = e.what();
+        }
+        size_t last_line = std::count(src.begin(), src.end(), '\n') + 3;
+        expect(what == "<input>:" + std::to_string(last_line) + ":8: Unterminated list", what);
+    });
+
+    test("script errors name file:line:col", [&] {
+        std::string path = "/tmp/minilisp_test_" + std::to_string(::getpid()) + ".lisp";
+        auto run = [&path](const std::string& text, Context& ctx) {
+            std::FILE* f = std::fopen(path.c_str(), "w");
+            std::fwrite(text.data(), 1, text.size(), f);
+            std::fclose(f);
+            try {
+                run_script(path.c_str(), ctx);
+            } catch (const SourceError& e) {
+                expect(e.location().rfind(path, 0) == 0, "location " + e.location());
+                return e.location().substr(path.size()) + " " + e.message();
+            }
+            return std::string("no error");
+        };
+        Context ctx;
+        expect(run("(+ 1 2)\n  (+ 3\n     (* 2 zz))", ctx) == ":3:6 Unbound variable", "innermost call");
+        // Function bodies are copies: the error names the calling form
+        expect(run("(defun f (x)\n  (car x))\n(+ 1\n   (f 5))", ctx) == ":4:4 'car' argument must be a list",
+               "call site");
+        expect(run("(+ 1 2))", ctx) == ":1:8 Empty atom", "syntax error");
+        expect(ctx.locations == nullptr, "locations left installed");
+        std::string plain;
+        try { eval_string("(car 1)", ctx); } catch (const std::runtime_error& e) { plain = e.what(); }
+        expect(plain == "'car' argument must be a list", "unlocated error: " + plain);
+        std::remove(path.c_str());
+    });
+
+    test("concurrent interning returns one copy per symbol", [] {
+        SymbolTable table;
+        constexpr int THREADS = 4;
+        std::vector<std::vector<std::string_view>> seen(THREADS);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < THREADS; ++t) {
+            threads.emplace_back([&, t] {
+                for (int i = 0; i < 5000; ++i) {
+                    seen[t].push_back(table.intern("sym" + std::to_string((i * 7 + t) % 5000)));
+                }
+            });
+        }
+        for (auto& th : threads) th.join();
+        expect(table.size() == 5000, std::to_string(table.size()) + " symbols");
+        for (int t = 1; t < THREADS; ++t) {
+            for (auto sv : seen[t]) {
+                expect(table.intern(sv).data() == sv.data(), "duplicate storage for " + std::string(sv));
+            }
+        }
+    });
+    test("printer writes lists, symbols and extreme numbers", [] {
+        Context ctx;
+        std::string src = "(1 (a -5) () (((x))) 0 foo-bar 12345678901)";
+        std::string_view sv(src);
+        expect(print_sexpr(parse_interned(sv, ctx)) == src, "round trip");
+        for (long n : {0L, 7L, -9L, 10L, 99L, 100L, -1000L, std::numeric_limits<long>::max(),
+                       std::numeric_limits<long>::min()}) {
+            expect(print_sexpr(SExpr{Atom{n}}) == std::to_string(n), "number " + std::to_string(n));
+        }
+        std::string out = "=> ";
+        print_sexpr(out, SExpr{Atom{"sym"}});
+        expect(out == "=> sym", "appends to the buffer");
+    });
+
+    test("printer handles deep nesting without recursion", [] {
+        // Built inside out; printing would recurse this deep in a naive printer
+        constexpr size_t DEPTH = 1000000;
+        SExpr value{Atom{1L}};
+        for (size_t i = 0; i < DEPTH; ++i) {
+            List list;
+            list.push_back(std::move(value));
+            value = SExpr{std::move(list)};
+        }
+        std::string out = print_sexpr(value);
+        expect(out == std::string(DEPTH, '(') + "1" + std::string(DEPTH, ')'), "deep list");
+    });
+
+    test("deep nesting parses, encodes and frees without recursion", [&] {
+        // Each level would take a stack frame or more in a recursive parser
+        // or destructor; a million overflows the default 8 MB stack
+        constexpr size_t DEPTH = 1000000;
+        std::string src = std::string(DEPTH, '(') + "x" + std::string(DEPTH, ')');
+        Context ctx;
+        std::string_view sv(src);
+        SExpr deep = parse_interned(sv, ctx);
+        expect(sv.empty() && print_sexpr(deep) == src, "parse_interned");
+
+        ctx.pool = &pool;
+        ctx.limits.par_parse_min_bytes = 0;
+        SourceMap map;
+        std::vector<SExpr> forms = parse_program(src + " " + src, ctx, &map);
+        expect(forms.size() == 2 && print_sexpr(forms[1]) == src, "parse_program");
+        expect(map.size() == 2 * DEPTH, std::to_string(map.size()) + " lists located");
+
+        std::vector<SExpr> decoded = decode_binary(encode_binary(forms), ctx);
+        expect(decoded.size() == 2 && print_sexpr(decoded[0]) == src, "binary round trip");
+
+        SExpr copy = deep;
+        expect(print_sexpr(copy) == src, "copy");
+        copy = forms[0];
+        expect(print_sexpr(copy) == src, "copy assignment");
+        // quote returns a copy of its operand
+        expect(print_sexpr(eval_string("'" + src, ctx)) == src, "quoted");
+        expect(print_sexpr(eval_string("(car (quote (" + src + ")))", ctx)) == src, "car of a quoted list");
+
+        std::string quotes = std::string(DEPTH, '\'') + "y";
+        sv = quotes;
+        std::string printed = print_sexpr(parse_interned(sv, ctx));
+        expect(printed.size() == DEPTH * 8 + 1 && printed.starts_with("(quote (quote ") &&
+                   printed.find("(quote y))") == DEPTH * 7 - 7, "nested quotes");
+
+        std::string what;
+        std::string cut = src.substr(0, src.size() - 1);
+        sv = cut;
+        try { parse_interned(sv, ctx); } catch (const std::runtime_error& e) { what = e.what(); }
+        expect(what == "Unterminated list", "parse_interned: '" + what + "'");
+        what.clear();
+        try { parse_program(cut, ctx); } catch (const std::runtime_error& e) { what = e.what(); }
+        expect(what == "Unterminated list", "parse_program: '" + what + "'");
+    });
+}
+
+static void test_parallel(TaskPool& pool) {
+    std::printf("\nParallel evaluation:\n");
+
+    // Every pmap/preduce case runs without a pool and with one, split into
+    // as many chunks as the pool allows
+    auto with_and_without_pool = [&](auto&& check) {
+        Context seq, par;
+        par.pool = &pool;
+        par.limits.par_cutoff = 1;
+        for (Context* ctx : {&seq, &par}) {
+            eval_string("(defun sq (x) (* x x))", *ctx);
+            eval_string("(defun keep-left (a b) a)", *ctx);
+            eval_string("(defun keep-right (a b) b)", *ctx);
+            eval_string("(defun check (x) (if (= x 37) (car x) x))", *ctx);
+            check(*ctx, ctx == &par ? " (pool)" : " (no pool)");
+        }
+    };
+    std::string upto_100 = "'(";
+    for (int i = 1; i <= 100; ++i) upto_100 += std::to_string(i) + (i < 100 ? " " : ")");
+
+    test("pmap keeps element order", [&] {
+        std::string want = "(";
+        for (int i = 1; i <= 100; ++i) want += std::to_string(i * i) + (i < 100 ? " " : ")");
+        with_and_without_pool([&](Context& ctx, std::string where) {
+            std::string got = print_sexpr(eval_string("(pmap sq " + upto_100 + ")", ctx));
+            expect(got == want, "pmap" + where + " => " + got);
+        });
+    });
+
+    test("preduce folds in list order", [&] {
+        // Associative but not commutative: any reordering changes the result
+        with_and_without_pool([&](Context& ctx, std::string where) {
+            expect(eval_num("(preduce keep-left -1 " + upto_100 + ")", ctx) == -1, "keep-left" + where);
+            expect(eval_num("(preduce keep-right -1 " + upto_100 + ")", ctx) == 100, "keep-right" + where);
+            expect(eval_num("(preduce + 5 " + upto_100 + ")", ctx) == 5055, "sum" + where);
+        });
+    });
+
+    test("empty and one-element lists", [&] {
+        with_and_without_pool([&](Context& ctx, std::string where) {
+            expect(print_sexpr(eval_string("(pmap sq '())", ctx)) == "()", "empty pmap" + where);
+            expect(print_sexpr(eval_string("(pmap sq '(7))", ctx)) == "(49)", "one-element pmap" + where);
+            expect(eval_num("(preduce keep-right 3 '())", ctx) == 3, "empty preduce" + where);
+            expect(eval_num("(preduce keep-right 3 '(9))", ctx) == 9, "one-element preduce" + where);
+        });
+    });
+
+    test("an error in a worker task surfaces from pmap and preduce", [&] {
+        with_and_without_pool([&](Context& ctx, std::string where) {
+            std::string forms[] = {"(pmap check " + upto_100 + ")",
+                                   "(preduce + 0 (pmap check " + upto_100 + "))"};
+            for (const auto& src : forms) {
+                bool threw = false;
+                try { eval_string(src, ctx); } catch (const std::exception&) { threw = true; }
+                expect(threw, src.substr(0, 20) + "... did not fail" + where);
+            }
+            // The context (and its pool) is still usable afterwards
+            expect(eval_num("(preduce + 0 (pmap sq '(1 2 3)))", ctx) == 14, "after the error" + where);
+        });
+    });
+
+    test("futures join to the value of their expression", [&] {
+        const char* pfib = "(defun pfib (n) (if (< n 2) n (+ (future (pfib (- n 1))) (pfib (- n 2)))))";
+        Context seq, par;
+        par.pool = &pool;
+        for (Context* ctx : {&seq, &par}) eval_string(pfib, *ctx);
+        expect(eval_num("(pfib 18)", par) == 2584 && eval_num("(pfib 18)", seq) == 2584, "pfib 18");
+        expect(eval_num("(touch (future (* 6 7)))", par) == 42, "touch");
+        // Nested futures, and a future whose value is another future
+        expect(eval_num("(future (+ (future (* 2 3)) (future (* 3 4))))", par) == 18, "nested");
+        expect(eval_num("(touch (future (future (* 5 5))))", par) == 25, "future of a future");
+    });
+
+    test("a future is touched any number of times; errors surface at touch", [&] {
+        // No workers: every spawned task waits until a touch runs it on the caller
+        TaskPool lazy(0);
+        Context ctx;
+        ctx.pool = &lazy;
+        auto spawn = [&ctx](const char* src) {
+            SExpr f = eval_with_env(parse_program(src, ctx)[0], ctx.env);
+            expect(is_future(f), std::string(src) + " did not spawn a task");
+            return f;
+        };
+        SExpr f = spawn("(future (* 9 9))");
+        for (int i = 0; i < 2; ++i) {
+            SExpr copy = f;
+            touch(copy, ctx.env);
+            expect(std::get<long>(*copy.atom) == 81, "touch " + std::to_string(i));
+        }
+
+        SExpr bad = spawn("(future (car 5))");
+        for (int i = 0; i < 2; ++i) {
+            SExpr copy = bad;
+            bool threw = false;
+            try { touch(copy, ctx.env); } catch (const std::exception&) { threw = true; }
+            expect(threw, "error not raised by touch " + std::to_string(i));
+        }
+        bool threw = false;
+        try { eval_string("(+ 1 (future (car 5)))", ctx); } catch (const std::exception&) { threw = true; }
+        expect(threw, "error not raised through an operand");
+    });
+
+    test("futures are evaluated inline once the queue holds unstolen tasks", [&] {
+        TaskPool lazy(0);
+        Context ctx;
+        ctx.pool = &lazy;
+        std::vector<SExpr> results;
+        for (long i = 1; i <= 4; ++i) {
+            std::string src = "(future (* " + std::to_string(i) + " 10))";
+            results.push_back(eval_with_env(parse_program(src, ctx)[0], ctx.env));
+        }
+        // Nobody steals: the first two become tasks, the rest run in place
+        expect(is_future(results[0]) && is_future(results[1]), "no tasks spawned");
+        expect(!is_future(results[2]) && !is_future(results[3]), "tasks spawned past the queue limit");
+        for (long i = 0; i < 4; ++i) {
+            touch(results[i], ctx.env);
+            expect(std::get<long>(*results[i].atom) == (i + 1) * 10, "result " + std::to_string(i));
+        }
+    });
+
+    test("--par-args gives the same results as sequential evaluation", [&] {
+        const char* defs[] = {
+            "(defun tsum (d) (if (= d 0) 1 (+ (tsum (- d 1)) (tsum (- d 1)))))",
+            "(defun mix (d) (- (* 3 (tsum d)) (tsum (- d 1)) (/ (tsum d) 2)))",
+        };
+        const char* calls[] = {"(tsum 12)", "(+ (tsum 8) (mix 9) (tsum 3))", "(- (mix 6) (mix 7))"};
+        Context seq, par;
+        par.pool = &pool;
+        par.limits.par_args = true;
+        par.limits.par_args_min_cost = 1;
+        for (const char* d : defs) {
+            eval_string(d, seq);
+            eval_string(d, par);
+        }
+        for (const char* c : calls) {
+            expect(eval_num(c, par) == eval_num(c, seq), c);
+        }
+    });
+
+    test("purity and cost follow the call graph", [] {
+        Context ctx;
+        auto info = [&ctx](const char* name) { return *ctx.functions.info(ctx.intern(name)); };
+        eval_string("(defun leaf (x) (* x x))", ctx);
+        eval_string("(defun mid (x) (+ (leaf x) 1))", ctx);
+        eval_string("(defun top (x) (mid (mid x)))", ctx);
+        eval_string("(defun fact (n) (if (< n 2) 1 (* n (fact (- n 1)))))", ctx);
+        eval_string("(defun definer (x) (defun made () x))", ctx);
+        eval_string("(defun uses-definer (x) (+ 1 (definer x)))", ctx);
+        eval_string("(defun later (x) (+ (undefined-yet x) 1))", ctx);
+        eval_string("(defun talker (p) (send p 1))", ctx);
+        eval_string("(defun via-pmap (l) (pmap definer l))", ctx);
+        eval_string("(defun via-preduce (l) (preduce talker 0 l))", ctx);
+        eval_string("(defun via-unknown (l) (pmap nosuch l))", ctx);
+        eval_string("(defun squares (l) (pmap leaf l))", ctx);
+        expect(info("leaf").pure && info("mid").pure && info("top").pure, "pure chain");
+        expect(info("leaf").cost == 3 && info("mid").cost == 7 && info("top").cost == 17,
+               "costs " + std::to_string(info("top").cost));
+        expect(info("fact").pure && info("fact").cost == COST_UNBOUNDED, "recursion is unbounded");
+        expect(!info("definer").pure && !info("uses-definer").pure, "defun is impure, and so are callers");
+        expect(!info("later").pure && !info("talker").pure, "undefined callee or send");
+        expect(!ctx.functions.info(ctx.intern("nosuch")), "undefined name");
+        expect(!info("via-pmap").pure && !info("via-preduce").pure, "pmap/preduce call their function");
+        expect(!info("via-unknown").pure, "pmap of an undefined function");
+        expect(info("squares").pure && info("squares").cost == 6, "squares cost " + std::to_string(info("squares").cost));
+
+        // Redefinitions reach every caller
+        eval_string("(defun leaf (x) (definer x))", ctx);
+        expect(!info("leaf").pure && !info("mid").pure && !info("top").pure, "impurity spreads");
+        eval_string("(defun leaf (x) (leaf x))", ctx);
+        expect(info("top").pure && info("top").cost == COST_UNBOUNDED, "now recursive");
+        eval_string("(defun undefined-yet (x) x)", ctx);
+        expect(info("later").pure && info("later").cost == 5, "a later definition completes a caller");
+        ctx.functions.undefine(ctx.intern("undefined-yet"));
+        expect(!info("later").pure, "undefine");
+    });
+
+    test("impure and recursive callees stay sequential", [&] {
+        Context ctx;
+        ctx.pool = &pool;
+        ctx.limits.par_args = true;
+        ctx.limits.par_args_min_cost = 1;
+        eval_string("(defun step (n) (if (= n 1) (defun counter () 1) (defun counter () 2)))", ctx);
+        eval_string("(defun cheap (x) (+ x 1))", ctx);
+        // Two operands that define functions: run in order, so the last one wins
+        eval_string("(defun two (a b) 0)", ctx);
+        eval_string("(two (step 1) (step 2))", ctx);
+        expect(eval_num("(counter)", ctx) == 2, "defuns ran out of order");
+        eval_string("(defun definer (x) (if (= x 1) (defun made () 1) (defun made () 2)))", ctx);
+        eval_string("(defun via-pmap (l) (pmap definer l))", ctx);
+        eval_string("(two (via-pmap '(1)) (via-pmap '(2)))", ctx);
+        expect(eval_num("(made)", ctx) == 2, "defuns inside pmap ran out of order");
+        // Expensive pure calls next to an operand with a side effect stay in order
+        eval_string("(defun w (d) (if (= d 0) 7 (+ 5 (w (- d 1)))))", ctx);
+        eval_string("(defun first3 (a b c) a)", ctx);
+        expect(eval_num("(first3 (w 5) (w 5) (defun w (d) 42))", ctx) == 32, "defun ran before its left operands");
+        Env env(&ctx);
+        SExpr call = parse_program("(step 1)", ctx)[0];
+        expect(!is_expensive_pure_call(call, env), "impure call qualified");
+        call = parse_program("(cheap 1)", ctx)[0];
+        ctx.limits.par_args_min_cost = 64;
+        expect(!is_expensive_pure_call(call, env), "cheap call qualified");
+        eval_string("(defun spin (n) (if (= n 0) 0 (spin (- n 1))))", ctx);
+        call = parse_program("(spin 3)", ctx)[0];
+        expect(is_expensive_pure_call(call, env), "recursive pure call did not qualify");
+        eval_string("(defun respawn (n) (if (= n 0) (defun counter () 0) (respawn (- n 1))))", ctx);
+        call = parse_program("(respawn 3)", ctx)[0];
+        expect(!is_expensive_pure_call(call, env), "recursive impure call qualified");
+    });
+}
+
+// Run `input` through run_pipeline() (or `run`, e.g. run_ndjson) via
+// temporary files; returns the output
+static std::string pipeline_output(const std::string& input, Context& ctx, size_t* failures = nullptr,
+                                   size_t (*run)(int, int, Context&) = run_pipeline) {
+    std::string base = "/tmp/minilisp_pipe_" + std::to_string(::getpid());
+    std::FILE* f = std::fopen((base + ".in").c_str(), "wb");
+    std::fwrite(input.data(), 1, input.size(), f);
+    std::fclose(f);
+    int in = ::open((base + ".in").c_str(), O_RDONLY);
+    int out = ::open((base + ".out").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    size_t failed = run(in, out, ctx);
+    ::close(in);
+    ::close(out);
+    if (failures) *failures = failed;
+    std::string result;
+    f = std::fopen((base + ".out").c_str(), "rb");
+    char buf[4096];
+    for (size_t n; (n = std::fread(buf, 1, sizeof(buf), f)) > 0;) result.append(buf, n);
+    std::fclose(f);
+    std::remove((base + ".in").c_str());
+    std::remove((base + ".out").c_str());
+    return result;
+}
+
+static void test_pipeline() {
+    std::printf("\nBatch pipeline:\n");
+
+    test("one line per form, wherever the line breaks are", [] {
+        Context ctx;
+        size_t failures = 0;
+        std::string out = pipeline_output("(+ 1 2) (* 3\n 4)\n(defun f (x)\n  (* x x))\n(f 9) (car 1)\nfoo", ctx, &failures);
+        std::string want = "3\n12\nf\n81\nError: 'car' argument must be a list\nError: Unbound variable\n";
+        expect(out == want, "got:\n" + out);
+        expect(failures == 2, std::to_string(failures) + " failures");
+    });
+
+    test("forms spanning 64 KiB read blocks", [] {
+        // Multi-line forms of varying width so block edges fall everywhere
+        std::string input, want;
+        for (long i = 0; input.size() < 300 * 1024; ++i) {
+            input += "(+ " + std::to_string(i) + "\n" + std::string(static_cast<size_t>(i % 37), ' ') + "(* 2 3))";
+            input += i % 3 ? " " : "\n";
+            want += std::to_string(i + 6) + "\n";
+        }
+        Context ctx;
+        expect(pipeline_output(input, ctx) == want, "outputs differ");
+    });
+
+    test("one form larger than many read blocks", [] {
+        // "x(y" is an atom: only the first '(' of each item opens a list
+        std::string input = "(+ 1 2) (car (quote (a(b ";
+        for (int i = 0; input.size() < 2 * 1024 * 1024; ++i) input += "(x(y " + std::to_string(i) + ") ";
+        input += "))) (+ 3 4)";
+        Context ctx;
+        std::string out = pipeline_output(input, ctx);
+        expect(out == "3\na(b\n7\n", "got:\n" + out.substr(0, 200));
+    });
+
+    test("an unterminated last form is reported", [] {
+        Context ctx;
+        expect(pipeline_output("(+ 1 1)\n(+ 1", ctx) == "2\nError: Unterminated list\n", "unterminated");
+        expect(pipeline_output("", ctx).empty(), "empty input");
+    });
+
+    test("a form ending a write is answered before more input", [] {
+        int in[2], out[2];
+        expect(::pipe(in) == 0 && ::pipe(out) == 0, "pipe");
+        Context ctx;
+        std::thread runner([&] {
+            run_pipeline(in[0], out[1], ctx);
+            ::close(out[1]);
+        });
+        // Read one answer line, as a program driving the process would
+        auto answer = [&] {
+            std::string line;
+            char c;
+            while (::read(out[0], &c, 1) == 1 && c != '\n') line += c;
+            return line;
+        };
+        expect(::write(in[1], "(+ 1 2)", 7) == 7, "write");
+        expect(answer() == "3", "a list ending the input was held back");
+        // A bare atom may continue in the next write, so it waits for one
+        expect(::write(in[1], "(* 2 3) 4", 9) == 9, "write");
+        expect(answer() == "6", "second list");
+        expect(::write(in[1], "2\n", 2) == 2, "write");
+        expect(answer() == "42", "the atom was split");
+        ::close(in[1]);
+        runner.join();
+        ::close(in[0]);
+        ::close(out[0]);
+    });
+}
+
+static std::string ndjson_output(const std::string& input, Context& ctx, size_t* failures = nullptr) {
+    std::string out = pipeline_output(input, ctx, failures, run_ndjson);
+    // Timings vary: blank out every "ns" value
+    for (size_t at = 0; (at = out.find("\"ns\":", at)) != std::string::npos;) {
+        at += 5;
+        size_t end = out.find('}', at);
+        out.replace(at, end - at, "0");
+    }
+    return out;
+}
+
+static void test_ndjson() {
+    std::printf("\nNDJSON protocol:\n");
+
+    test("requests are answered in order with their ids", [] {
+        Context ctx;
+        size_t failures = 0;
+        std::string out = ndjson_output(
+            "{\"id\": 1, \"src\": \"(defun sq (x) (* x x)) (sq 12)\"}\n"
+            "{\"src\":\"(quote (1 (a b) 3))\",\"id\":\"two\"}\r\n"
+            "\n"
+            "{\"id\":3.5,\"src\":\"(car 1)\",\"extra\":[1,{\"x\":null}]}\n"
+            "{\"id\":4,\"src\":\"sq\"}",
+            ctx, &failures);
+        std::string want =
+            "{\"id\":1,\"ok\":true,\"result\":144,\"ns\":0}\n"
+            "{\"id\":\"two\",\"ok\":true,\"result\":[1,[\"a\",\"b\"],3],\"ns\":0}\n"
+            "{\"id\":3.5,\"ok\":false,\"error\":\"'car' argument must be a list\",\"ns\":0}\n"
+            "{\"id\":4,\"ok\":false,\"error\":\"Unbound variable\",\"ns\":0}\n";
+        expect(out == want, "got:\n" + out);
+        expect(failures == 2, std::to_string(failures) + " failures");
+    });
+
+    test("string escapes in and out", [] {
+        Context ctx;
+        std::string out = ndjson_output(
+            "{\"id\":\"q\\\"\\u00e9\\ud83d\\ude00\",\"src\":\"(quote\\t(\\u0041 \\\"b))\"}\n", ctx);
+        std::string want = "{\"id\":\"q\\\"\\u00e9\\ud83d\\ude00\",\"ok\":true,\"result\":[\"A\",\"\\\"b\"],\"ns\":0}\n";
+        expect(out == want, "got:\n" + out);
+        JsonCursor in("\"\\u00e9\\ud83d\\ude00\\n\"");
+        expect(in.string() == "\xC3\xA9\xF0\x9F\x98\x80\n", "UTF-8 decoding");
+    });
+
+    test("malformed requests get error responses", [] {
+        Context ctx;
+        size_t failures = 0;
+        std::string out = ndjson_output(
+            "not json\n{\"id\":1}\n{\"id\":2,\"src\":\"(+ 1 1)\"} x\n"
+            "{\"id\":3,\"src\":\"\\q\"}\n{\"id\":4,\"src\":\"(+ 2 2)\"}\n",
+            ctx, &failures);
+        std::string want =
+            "{\"id\":null,\"ok\":false,\"error\":\"Bad request: malformed JSON\",\"ns\":0}\n"
+            "{\"id\":1,\"ok\":false,\"error\":\"Bad request: missing \\\"src\\\"\",\"ns\":0}\n"
+            "{\"id\":2,\"ok\":false,\"error\":\"Bad request: data after the object\",\"ns\":0}\n"
+            "{\"id\":3,\"ok\":false,\"error\":\"Bad request: bad escape\",\"ns\":0}\n"
+            "{\"id\":4,\"ok\":true,\"result\":4,\"ns\":0}\n";
+        expect(out == want, "got:\n" + out);
+        expect(failures == 4, std::to_string(failures) + " failures");
+    });
+
+    test("ids must be JSON scalars and survive later errors", [] {
+        Context ctx;
+        std::string out = ndjson_output(
+            "{\"id\":abc,\"src\":\"1\"}\n{\"id\":01,\"src\":\"1\"}\n{\"id\":1.,\"src\":\"1\"}\n"
+            "{\"id\":-2.5e+3,\"src\":\"1\"}\n{\"id\":true,\"src\":\"1\"}\n"
+            "{\"id\":\"x\",\"src\":\"1\",\"options\":{\"fuel\":-1}}\n"
+            "{\"id\":7,\"src\":\"1\",\"options\":{\"reset\":yes}}\n",
+            ctx);
+        std::string want =
+            "{\"id\":null,\"ok\":false,\"error\":\"Bad request: expected a value\",\"ns\":0}\n"
+            "{\"id\":null,\"ok\":false,\"error\":\"Bad request: expected a value\",\"ns\":0}\n"
+            "{\"id\":null,\"ok\":false,\"error\":\"Bad request: expected a value\",\"ns\":0}\n"
+            "{\"id\":-2.5e+3,\"ok\":true,\"result\":1,\"ns\":0}\n"
+            "{\"id\":true,\"ok\":true,\"result\":1,\"ns\":0}\n"
+            "{\"id\":\"x\",\"ok\":false,\"error\":\"Bad request: expected a count\",\"ns\":0}\n"
+            "{\"id\":7,\"ok\":false,\"error\":\"Bad request: expected a value\",\"ns\":0}\n";
+        expect(out == want, "got:\n" + out);
+    });
+
+    test("fuel and reset options", [] {
+        Context ctx;
+        std::string out = ndjson_output(
+            "{\"id\":1,\"src\":\"(defun fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))\"}\n"
+            "{\"id\":2,\"src\":\"(fib 10)\",\"options\":{\"fuel\":100000}}\n"
+            "{\"id\":3,\"src\":\"(fib 20)\",\"options\":{\"fuel\":100}}\n"
+            "{\"id\":4,\"src\":\"(defun g () 1)\",\"options\":{\"fuel\":100}}\n"
+            "{\"id\":5,\"src\":\"(+ 1 (send 1 (fib 3)))\",\"options\":{\"fuel\":100}}\n"
+            "{\"id\":6,\"src\":\"(fib 5)\",\"options\":{\"reset\":true}}\n",
+            ctx);
+        std::string want =
+            "{\"id\":1,\"ok\":true,\"result\":\"fib\",\"ns\":0}\n"
+            "{\"id\":2,\"ok\":true,\"result\":55,\"ns\":0}\n"
+            "{\"id\":3,\"ok\":false,\"error\":\"Fuel exhausted\",\"ns\":0}\n"
+            "{\"id\":4,\"ok\":false,\"error\":\"'defun' is not allowed with a fuel limit\",\"ns\":0}\n"
+            "{\"id\":5,\"ok\":false,\"error\":\"'send' is not allowed with a fuel limit\",\"ns\":0}\n"
+            "{\"id\":6,\"ok\":false,\"error\":\"Unknown operator\",\"ns\":0}\n";
+        expect(out == want, "got:\n" + out);
+    });
+
+    test("a failed fuel-limited request gives the pool back", [] {
+        TaskPool pool(1);
+        Context ctx;
+        ctx.pool = &pool;
+        std::string out;
+        answer_ndjson("{\"id\":1,\"src\":\"(car 1)\",\"options\":{\"fuel\":100}}", ctx, out);
+        expect(ctx.pool == &pool, "pool lost after an error");
+        answer_ndjson("{\"id\":2,\"src\":\"(defun g () 1)\",\"options\":{\"fuel\":100}}", ctx, out);
+        expect(ctx.pool == &pool, "pool lost after preemption");
+    });
+}
+
+static void test_binary() {
+    std::printf("\nBinary S-expressions:\n");
+
+    test("round trip preserves every form", [] {
+        std::string src = generated_source(3000) +
+                          " (0 -1 1 63 -64 8191 9223372036854775807 -9223372036854775807) () '()";
+        Context ctx;
+        std::vector<SExpr> forms = parse_program(src, ctx);
+        forms.push_back(SExpr{Atom{std::numeric_limits<long>::min()}});
+        std::string bin = encode_binary(forms);
+        expect(bin.size() < src.size(), "encoding is larger than the text");
+        std::vector<SExpr> decoded = decode_binary(bin, ctx);  // Same symbols, same storage
+        expect(decoded.size() == forms.size(), "form count");
+        for (size_t i = 0; i < forms.size(); ++i) {
+            expect(same_ast(decoded[i], forms[i]), "form " + std::to_string(i) + " differs");
+        }
+    });
+
+    test("decoded forms evaluate like parsed ones", [] {
+        Context a, b;
+        std::string src = "(defun fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2))))) (fib 15)";
+        std::vector<SExpr> forms = parse_program(src, a);
+        std::string bin = encode_binary(forms);
+        SExpr last{Atom{0L}};
+        for (const SExpr& form : decode_binary(bin, b)) last = eval_toplevel(form, b);
+        expect(get_long(last) == 610, "fib 15");
+    });
+
+    test("truncated or corrupt buffers are rejected", [] {
+        Context ctx;
+        std::vector<SExpr> forms = parse_program("(a (b -300) c) 'x (d 123456789)", ctx);
+        std::string bin = encode_binary(forms);
+        for (size_t n = 0; n < bin.size(); ++n) {
+            bool threw = false;
+            try { decode_binary(std::string_view(bin).substr(0, n), ctx); } catch (const std::runtime_error&) { threw = true; }
+            expect(threw, "prefix of " + std::to_string(n) + " bytes accepted");
+        }
+        bool threw = false;
+        try { decode_binary(bin + "x", ctx); } catch (const std::runtime_error&) { threw = true; }
+        expect(threw, "trailing byte accepted");
+        std::string bad_symbol = std::string("MLB1") + '\x00' + '\x01' + '\x15';  // Symbol 5 of 0
+        threw = false;
+        try { decode_binary(bad_symbol, ctx); } catch (const std::runtime_error&) { threw = true; }
+        expect(threw, "bad symbol index accepted");
+    });
+
+    test("scripts may be binary", [] {
+        Context ctx;
+        std::string bin = encode_binary(parse_program("(defun twice (x) (* 2 x)) (twice 21)", ctx));
+        std::string path = "/tmp/minilisp_test_" + std::to_string(::getpid()) + ".mlb";
+        std::FILE* f = std::fopen(path.c_str(), "wb");
+        expect(f != nullptr, "cannot create " + path);
+        std::fwrite(bin.data(), 1, bin.size(), f);
+        std::fclose(f);
+        Context run;
+        long value = get_long(run_script(path.c_str(), run));
+        std::remove(path.c_str());
+        expect(value == 42, "result " + std::to_string(value));
+    });
+}
+
+static void test_fuel() {
+    std::printf("\nFuel and fair scheduling:\n");
+    const char* fib = "(defun fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))";
+    const char* burn = "(defun burn (n) (if (= n 0) 0 (+ (burn (- n 1)) (burn (- n 1)))))";
+
+    test("fuel bounds an evaluation and preempts before side effects", [&] {
+        Context ctx;
+        eval_string(fib, ctx);
+        size_t fuel = 1000;
+        expect(std::get<long>(*eval_string_fueled("(fib 10)", ctx, fuel).atom) == 55, "fib 10");
+        expect(fuel > 0 && fuel < 1000, "fuel left: " + std::to_string(fuel));
+        bool preempted = false;
+        fuel = 1000;
+        try { eval_string_fueled("(fib 15)", ctx, fuel); } catch (const Preempted&) { preempted = true; }
+        expect(preempted && fuel == 0, "fib 15 finished on 1000 steps");
+        preempted = false;
+        fuel = 1000;
+        try { eval_string_fueled("(if (fib 5) (defun late () 7) 0)", ctx, fuel); } catch (const Preempted&) { preempted = true; }
+        expect(preempted, "defun ran under fuel");
+        expect(!ctx.env.lookup_fn("late"), "preempted evaluation had an effect");
+        expect(ctx.env.fuel == nullptr, "fuel left installed");
+    });
+
+    test("preempted requests complete with the right results", [&] {
+        std::mutex m;
+        std::vector<EvalResponse> responses;
+        EvalService service(2, [&](const EvalResponse& r) {
+            std::lock_guard<std::mutex> lock(m);
+            responses.push_back(r);
+        }, 100);
+        service.submit(0, fib);
+        for (uint64_t id = 1; id <= 12; ++id) {
+            service.submit(id, "(fib " + std::to_string(id) + ")", id % 3);
+        }
+        service.submit(13, "(if (fib 8) (defun late () 7) 0)");
+        service.drain();
+        service.submit(14, "(late)");
+        service.drain();
+
+        long want[] = {0, 1, 1, 2, 3, 5, 8, 13, 21, 34, 55, 89, 144};
+        expect(responses.size() == 15, std::to_string(responses.size()) + " responses");
+        for (const auto& r : responses) {
+            expect(r.ok, "request " + std::to_string(r.id) + " failed: " + r.result);
+            if (r.id >= 1 && r.id <= 12) {
+                expect(r.result == std::to_string(want[r.id]), "fib " + std::to_string(r.id) + " => " + r.result);
+            }
+            if (r.id == 13) expect(r.result == "late", "defun => " + r.result);
+            if (r.id == 14) expect(r.result == "7", "(late) => " + r.result);
+        }
+        expect(service.preemptions() > 0, "nothing was preempted");
+    });
+
+    test("an endless request does not starve other tenants", [&] {
+        std::mutex m;
+        std::condition_variable cv;
+        size_t short_done = 0;
+        bool burn_done = false;
+        EvalService service(1, [&](const EvalResponse& r) {
+            std::lock_guard<std::mutex> lock(m);
+            if (r.id == 1) burn_done = true;
+            if (r.id >= 2) ++short_done;
+            cv.notify_one();
+        }, 500);
+        service.submit(0, burn);
+        service.submit(1, "(burn 40)", 1);
+        for (uint64_t id = 2; id < 22; ++id) service.submit(id, "(+ 1 2)", 2);
+        std::unique_lock<std::mutex> lock(m);
+        cv.wait(lock, [&] { return short_done == 20; });
+        expect(!burn_done, "(burn 40) finished");
+        expect(service.preemptions() > 0, "the long request was never preempted");
+        // Destroying the service abandons (burn 40)
+    });
+
+    test("forms after a request's definitions run fueled on a worker", [&] {
+        std::mutex m;
+        std::condition_variable cv;
+        std::vector<EvalResponse> responses;
+        bool on_caller = false;
+        size_t short_done = 0;
+        auto caller = std::this_thread::get_id();
+        EvalService service(1, [&](const EvalResponse& r) {
+            std::lock_guard<std::mutex> lock(m);
+            on_caller = on_caller || std::this_thread::get_id() == caller;
+            responses.push_back(r);
+            if (r.id >= 3) ++short_done;
+            cv.notify_one();
+        }, 500);
+        service.submit(1, std::string(burn) + " (burn 40)", 1);  // Returns without running it
+        service.submit(2, "(defun ok () 1) (defun (bad) 2) (ok)", 2);
+        for (uint64_t id = 3; id < 23; ++id) service.submit(id, "(burn 2)", 2);
+        std::unique_lock<std::mutex> lock(m);
+        cv.wait(lock, [&] { return short_done == 20; });
+        expect(!on_caller, "a response was delivered on the submitting thread");
+        for (const auto& r : responses) {
+            expect(r.id != 1, "(burn 40) finished");
+            if (r.id == 2) expect(!r.ok, "a failed definition ran the forms after it");
+            if (r.id >= 3) expect(r.ok && r.result == "0", "(burn 2) => " + r.result);
+        }
+        expect(service.preemptions() > 0, "the long request was never preempted");
+    });
+
+    test("queued and running requests keep the definitions they were submitted with", [&] {
+        std::mutex m;
+        std::vector<EvalResponse> responses;
+        EvalService service(1, [&](const EvalResponse& r) {
+            std::lock_guard<std::mutex> lock(m);
+            responses.push_back(r);
+        }, 100);
+        service.submit(0, fib);
+        service.submit(1, "(defun v () 1)");
+        service.submit(2, "(+ (* 0 (fib 15)) (v))");
+        service.submit(3, "(defun f (n) (if (= n 0) 0 (+ 2 (f (- n 1)))))");
+        service.submit(4, "(+ (fib 12) (f 100))");  // Preempted many times
+        service.submit(5, "(defun v () 2) (defun f (n) 1000) (v)");
+        service.submit(6, "(+ (v) (f 3))");
+        service.drain();
+
+        expect(responses.size() == 7, std::to_string(responses.size()) + " responses");
+        for (const auto& r : responses) {
+            expect(r.ok, "request " + std::to_string(r.id) + " failed: " + r.result);
+            if (r.id == 2) expect(r.result == "1", "queued (v) => " + r.result);
+            if (r.id == 4) expect(r.result == "344", "running (f 100) => " + r.result);
+            if (r.id == 5) expect(r.result == "2", "(v) after its own defun => " + r.result);
+            if (r.id == 6) expect(r.result == "1002", "later request => " + r.result);
+        }
+        expect(service.preemptions() > 0, "nothing was preempted");
+    });
+
+    test("pmap and preduce are preempted like any other form", [&] {
+        std::mutex m;
+        std::condition_variable cv;
+        std::vector<EvalResponse> responses;
+        size_t short_done = 0;
+        bool burn_done = false;
+        EvalService service(1, [&](const EvalResponse& r) {
+            std::lock_guard<std::mutex> lock(m);
+            responses.push_back(r);
+            if (r.id == 4) burn_done = true;
+            if (r.id >= 5) ++short_done;
+            cv.notify_one();
+        }, 100);
+        service.submit(0, fib);
+        service.submit(1, burn);
+        service.submit(2, "(pmap fib '(1 2 3 4 5 6 7 8 9 10 11 12))");
+        service.submit(3, "(preduce - 1000 (pmap fib '(10 11 12)))");
+        service.drain();
+        service.submit(4, "(pmap burn '(40))", 1);
+        for (uint64_t id = 5; id < 25; ++id) service.submit(id, "(+ 1 2)", 2);
+        std::unique_lock<std::mutex> lock(m);
+        cv.wait(lock, [&] { return short_done == 20; });
+        expect(!burn_done, "(pmap burn '(40)) finished");
+        for (const auto& r : responses) {
+            if (r.id == 2) expect(r.result == "(1 1 2 3 5 8 13 21 34 55 89 144)", "pmap => " + r.result);
+            if (r.id == 3) expect(r.result == "712", "preduce => " + r.result);
+        }
+    });
+}
+
+// Runs `name` over `records` with a BatchProgram and checks every result and
+// error against evaluating "(name args...)" from source
+static void expect_batch_matches_eval(Context& ctx, const char* name, bool compiled,
+                                      const std::vector<std::vector<long>>& records,
+                                      size_t lane_width = 8) {
+    BatchProgram program(ctx, name);
+    program.set_lane_width(lane_width);
+    expect(program.compiled() == compiled, compiled ? "not compiled" : "unexpectedly compiled");
+    std::vector<long> args, out(records.size());
+    for (const auto& rec : records) args.insert(args.end(), rec.begin(), rec.end());
+    std::vector<BatchError> errors;
+    size_t failed = program.run(args, out, &errors);
+    expect(failed == errors.size(), "failure count");
+
+    size_t next_error = 0;
+    for (size_t r = 0; r < records.size(); ++r) {
+        std::string src = std::string("(") + name;
+        for (long v : records[r]) src += " " + std::to_string(v);
+        src += ")";
+        try {
+            long want = eval_num(src, ctx);
+            expect(out[r] == want, src + " => " + std::to_string(out[r]) + ", want " + std::to_string(want));
+        } catch (const std::runtime_error& e) {
+            expect(next_error < errors.size() && errors[next_error].record == r, src + " should fail");
+            expect(errors[next_error].message == e.what(), src + ": " + errors[next_error].message);
+            ++next_error;
+        }
+    }
+    expect(next_error == errors.size(), "unexpected batch errors");
+}
+
+// Connect to a SocketServer, send `input`, half-close and read to EOF
+static std::string socket_exchange(const std::string& path, const std::string& input) {
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.data(), path.size());
+    expect(::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0, "connect failed");
+    for (size_t sent = 0; sent < input.size();) {
+        ssize_t n = ::send(fd, input.data() + sent, input.size() - sent, MSG_NOSIGNAL);
+        expect(n > 0, "send failed");
+        sent += static_cast<size_t>(n);
+    }
+    ::shutdown(fd, SHUT_WR);
+    std::string out;
+    char buf[4096];
+    for (ssize_t n; (n = ::read(fd, buf, sizeof(buf))) > 0;) out.append(buf, static_cast<size_t>(n));
+    ::close(fd);
+    return out;
+}
+
+static void test_socket() {
+    std::printf("\nSocket server:\n");
+    std::string path = "/tmp/minilisp_test_" + std::to_string(::getpid()) + ".sock";
+
+    test("pipelined requests are answered in order", [&] {
+        SocketServer server(path, 2, 100);
+        std::thread loop([&] { server.run(); });
+        std::string out = socket_exchange(path,
+            "(defun fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))\n"
+            "(fib 18)\n(+ 1 2)\n\n(car 1)\n(fib 10)");  // Slow then fast; no final newline
+        server.stop();
+        loop.join();
+        std::string want = "fib\n2584\n3\nError: 'car' argument must be a list\n55\n";
+        expect(out == want, "got:\n" + out);
+    });
+
+    test("concurrent clients each get their own answers", [&] {
+        SocketServer server(path, 3);
+        std::thread loop([&] { server.run(); });
+        std::vector<std::thread> clients;
+        std::atomic<int> wrong{0};
+        for (int c = 0; c < 8; ++c) {
+            clients.emplace_back([&, c] {
+                std::string input, want;
+                for (int i = 0; i < 500; ++i) {
+                    input += "(* " + std::to_string(c) + " " + std::to_string(i) + ")\n";
+                    want += std::to_string(c * i) + "\n";
+                }
+                if (socket_exchange(path, input) != want) ++wrong;
+            });
+        }
+        for (auto& t : clients) t.join();
+        server.stop();
+        loop.join();
+        expect(wrong == 0, std::to_string(wrong.load()) + " clients got wrong answers");
+        expect(server.latency().count() == 8 * 500, std::to_string(server.latency().count()) + " served");
+    });
+
+    test("a slow definition request does not hold up other clients", [&] {
+        auto server = std::make_unique<SocketServer>(path, 1);
+        std::thread loop([&] { server->run(); });
+        std::thread slow([&] {
+            socket_exchange(path, "(defun burn (n) (if (= n 0) 0 (+ (burn (- n 1)) (burn (- n 1))))) (burn 40)\n");
+        });
+        // Once burn is defined, (burn 40) is running; other clients are still answered
+        bool defined = false;
+        for (int i = 0; i < 1000 && !defined; ++i) {
+            defined = socket_exchange(path, "(burn 1)\n") == "0\n";
+            if (!defined) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        expect(defined, "burn was never defined");
+        expect(socket_exchange(path, "(+ 2 2)\n(burn 3)\n") == "4\n0\n", "second client");
+        server->stop();
+        loop.join();
+        server.reset();  // Closes the slow client's connection
+        slow.join();
+    });
+
+    test("an oversized line is refused and the connection closed", [&] {
+        SocketServer server(path, 1);
+        std::thread loop([&] { server.run(); });
+        std::string out = socket_exchange(path, "(+ 1 1)\n" + std::string(SocketServer::MAX_LINE + 10, ' '));
+        expect(out == "2\nError: Request too long\n", "got:\n" + out);
+        // The server keeps serving other clients
+        expect(socket_exchange(path, "(+ 2 2)\n") == "4\n", "second client");
+        server.stop();
+        loop.join();
+    });
+}
+
+static void test_batch() {
+    std::printf("\nBatch evaluation:\n");
+
+    test("compiled recursive function", [] {
+        Context ctx;
+        eval_string("(defun fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))", ctx);
+        std::vector<std::vector<long>> records;
+        for (long n = 0; n <= 20; ++n) records.push_back({n});
+        expect_batch_matches_eval(ctx, "fib", true, records);
+    });
+
+    test("compiled rule with calls, division and errors", [] {
+        Context ctx;
+        eval_string("(defun clamp (v lo hi) (if (< v lo) lo (if (> v hi) hi v)))", ctx);
+        eval_string("(defun score (a b c) (clamp (+ (* a 3) (/ b c) (- a) '7) 0 (* 100 (>= a b))))", ctx);
+        eval_string("(defun deep (n) (if (= n 0) 0 (+ 1 (deep (- n 1)))))", ctx);
+        std::vector<std::vector<long>> records;
+        for (long a = -3; a <= 3; ++a) {
+            for (long b = -2; b <= 2; ++b) {
+                for (long c = -1; c <= 1; ++c) records.push_back({a * 11, b * 7, c});
+            }
+        }
+        for (size_t lanes : {0, 4, 8}) expect_batch_matches_eval(ctx, "score", true, records, lanes);
+        expect(BatchProgram(ctx, "score").vectorized(), "score not vectorized");
+        expect(!BatchProgram(ctx, "deep").vectorized(), "recursion vectorized");
+        ctx.limits.max_depth = 50;
+        expect_batch_matches_eval(ctx, "deep", true, {{10}, {49}, {50}, {80}});
+    });
+
+    test("call chains run the function they name", [] {
+        Context ctx;
+        eval_string("(defun b (x) (* x 10))", ctx);
+        eval_string("(defun a (x) (+ (b x) 1))", ctx);
+        eval_string("(defun score (x) (a x))", ctx);
+        eval_string("(defun top (x y) (- (score x) (a y)))", ctx);
+        expect_batch_matches_eval(ctx, "score", true, {{0}, {2}, {-7}}, 0);
+        expect_batch_matches_eval(ctx, "top", true, {{2, 1}, {5, -3}}, 0);
+    });
+
+    test("lane groups and the scalar tail agree with eval", [] {
+        Context ctx;
+        eval_string("(defun b (x) (* x 10))", ctx);
+        eval_string("(defun a (x) (+ (b x) 1))", ctx);
+        eval_string("(defun score (x) (if (< x 0) (a (- x)) (a x)))", ctx);
+        expect(BatchProgram(ctx, "score").vectorized(), "score not vectorized");
+        // 9 and 13 records: full groups of 4 and 8 plus a scalar tail
+        for (size_t count : {9, 13}) {
+            std::vector<std::vector<long>> records;
+            for (size_t i = 0; i < count; ++i) records.push_back({static_cast<long>(i) * 3 - 10});
+            for (size_t lanes : {4, 8}) expect_batch_matches_eval(ctx, "score", true, records, lanes);
+        }
+    });
+
+    test("lanes mask the untaken branch of if", [] {
+        Context ctx;
+        eval_string("(defun ratio (a b) (if (= b 0) -1 (if (< a 0) (/ b a) (/ a b))))", ctx);
+        std::vector<std::vector<long>> records;
+        for (long a = -20; a <= 20; ++a) {
+            for (long b = -3; b <= 3; ++b) records.push_back({a, b});
+        }
+        for (size_t lanes : {4, 8}) expect_batch_matches_eval(ctx, "ratio", true, records, lanes);
+        BatchProgram program(ctx, "ratio");
+        std::vector<long> args, out(records.size());
+        for (const auto& rec : records) args.insert(args.end(), rec.begin(), rec.end());
+        expect(program.vectorized(), "ratio not vectorized");
+        expect(program.run(args, out) == 0, "a division in an untaken branch failed");
+    });
+
+    test("interpreted fallback gives the same answers", [] {
+        Context ctx;
+        eval_string("(defun first (a b) (car (quote (5 6))))", ctx);
+        eval_string("(defun inner () x)", ctx);
+        eval_string("(defun outer (x) (* 2 (inner)))", ctx);
+        eval_string("(defun bad (a) (car a))", ctx);
+        expect_batch_matches_eval(ctx, "first", false, {{1, 2}, {3, 4}});
+        expect_batch_matches_eval(ctx, "outer", false, {{1}, {-4}, {21}});
+        expect_batch_matches_eval(ctx, "bad", false, {{1}});
+    });
+}
+
+static void test_incremental() {
+    std::printf("\nIncremental documents:\n");
+    const char* base =
+        "(defun sq (x) (* x x))\n"
+        "(defun quad (x) (sq (sq x)))\n"
+        "(defun inc (x) (+ x 1))\n"
+        "(quad 2)\n"
+        "(inc 41)\n"
+        "(+ 1 2)\n";
+    auto values = [](const LiveDocument& doc) {
+        std::string out;
+        for (const auto& f : doc.forms()) {
+            if (!f.error.empty()) {
+                out += "!";
+            } else if (std::holds_alternative<long>(*f.value.atom)) {
+                out += std::to_string(std::get<long>(*f.value.atom));
+            } else {
+                out += std::get<std::string_view>(*f.value.atom);
+            }
+            out += f.evaluated ? "* " : " ";
+        }
+        return out;
+    };
+
+    test("first update parses and evaluates everything", [&] {
+        Context ctx;
+        LiveDocument doc(ctx);
+        auto stats = doc.update(base);
+        expect(stats.forms == 6 && stats.parsed == 6 && stats.evaluated == 6, "stats");
+        expect(get_long(doc.forms()[3].value) == 16 && get_long(doc.forms()[4].value) == 42, values(doc));
+    });
+
+    test("an unchanged document evaluates nothing", [&] {
+        Context ctx;
+        LiveDocument doc(ctx);
+        doc.update(base);
+        auto stats = doc.update(base);
+        expect(stats.parsed == 0 && stats.evaluated == 0, values(doc));
+    });
+
+    test("editing a function re-runs it and its transitive callers only", [&] {
+        Context ctx;
+        LiveDocument doc(ctx);
+        doc.update(base);
+        std::string edited = base;
+        edited.replace(edited.find("(* x x)"), 7, "(* x 3)");
+        auto stats = doc.update(edited);
+        expect(stats.parsed == 1 && stats.evaluated == 2, values(doc));
+        // quad 2 = sq (sq 2) = 18
+        expect(values(doc) == "sq* quad inc 18* 42 3 ", values(doc));
+    });
+
+    test("moved and new forms: only new text is parsed", [&] {
+        Context ctx;
+        LiveDocument doc(ctx);
+        doc.update(base);
+        std::string edited = std::string("(+ 1 2)\n(inc 1)\n") + base;
+        edited.erase(edited.rfind("(+ 1 2)"));
+        auto stats = doc.update(edited);
+        expect(stats.parsed == 1 && stats.evaluated == 1, values(doc));
+        expect(get_long(doc.forms()[1].value) == 2, values(doc));
+    });
+
+    test("a removed definition is forgotten and its callers fail", [&] {
+        Context ctx;
+        LiveDocument doc(ctx);
+        doc.update(base);
+        std::string edited = base;
+        edited.erase(edited.find("(defun inc"), std::strlen("(defun inc (x) (+ x 1))\n"));
+        doc.update(edited);
+        expect(ctx.functions.lookup("inc") == nullptr, "inc still defined");
+        expect(values(doc) == "sq quad 16 !* 3 ", values(doc));
+        doc.update(base);
+        expect(values(doc) == "sq quad inc* 16 42* 3 ", values(doc));
+    });
+
+    test("syntax errors stay with their form", [&] {
+        Context ctx;
+        LiveDocument doc(ctx);
+        doc.update("(defun f (x) (* x 2))\n(f 4)\n(f (");
+        expect(values(doc) == "f* 8* !* ", values(doc));
+        expect(doc.forms()[2].error == "Unterminated list", doc.forms()[2].error);
+    });
+
+    test("a deeply nested form updates without recursion", [] {
+        constexpr size_t DEPTH = 1000000;
+        std::string deep = "(car '" + std::string(DEPTH, '(') + "x" + std::string(DEPTH, ')') + ")";
+        Context ctx;
+        LiveDocument doc(ctx);
+        doc.update("(defun x () 1)\n" + deep);
+        expect(doc.forms().size() == 2 && doc.forms()[1].error.empty(), "deep form failed");
+        expect(print_sexpr(doc.forms()[1].value) == std::string(DEPTH - 1, '(') + "x" + std::string(DEPTH - 1, ')'),
+               "value");
+        auto stats = doc.update("(defun x () 2)\n" + deep);
+        expect(stats.evaluated == 2, "mentions of x not found");
+    });
+
+    test("a nested defun makes every update re-run everything", [&] {
+        Context ctx;
+        LiveDocument doc(ctx);
+        doc.update("(if 1 (defun g () 5) 0)\n(+ 1 1)");
+        auto stats = doc.update("(if 1 (defun g () 5) 0)\n(+ 1 1)");
+        expect(stats.parsed == 0 && stats.evaluated == 2, values(doc));
+    });
+}
+
+int main() {
+    std::printf("MiniLisp native runtime tests\n");
+    test_contexts();
+    test_rcu();
+    test_sliced();
+    test_actors(nullptr, "inline scheduler");
+    TaskPool pool(3);
+    test_actors(&pool, "TaskPool, 4 threads");
+    test_parsing(pool);
+    test_parallel(pool);
+    test_binary();
+    test_pipeline();
+    test_ndjson();
+    test_fuel();
+    test_socket();
+    test_batch();
+    test_incremental();
+
+    std::printf("\n%d passed, %d failed\n", passed, failed);
+    return failed == 0 ? 0 : 1;
+}
@@ -9,6 +9,12 @@
 // 4. Simple function definitions (defun)
 // 5. Recursive function definitions (the bug we're fixing!)
 // 6. Multiple function definitions
+// 7. Time-sliced evaluation (eval_start/eval_step/eval_result)
+// 8. Batch evaluation (batch_compile/batch_input/batch_run)
+// 9. Worker-thread pool (wasm_pool.js)
+// 10. Incremental document evaluation (doc_update/doc_value/doc_reevaluated)
+// 11. Batched eval (eval_many_input/eval_many_output/eval_many), with a per-call vs batched benchmark
+// 12. Structured results (eval_encoded/copy_result, decoded by wasm_result.js)
 //
 // The key test is recursive functions - these previously failed because
 // string_view pointers in the Lambda body became invalid when the WASM
@@ -36,7 +42,11 @@ async function runTests() {
         wasi_snapshot_preview1: wasi.wasiImport
     });
 
-    const { memory, eval: evalFn, fn_count, reset_env, get_buffer_offset } = instance.exports;
+    const { memory, eval: evalFn, fn_count, reset_env, get_buffer_offset,
+            eval_start, eval_step, eval_result, eval_many_input, eval_many_output, eval_many,
+            eval_encoded, copy_result, buffer_alloc, buffer_free,
+            batch_compile, batch_arity, batch_input, batch_run, batch_free,
+            doc_update, doc_parsed, doc_evaluated, doc_value, doc_reevaluated } = instance.exports;
 
     // Helper to evaluate Lisp code
     // IMPORTANT: Use get_buffer_offset() to get a safe offset that doesn't
@@ -48,6 +58,90 @@ async function runTests() {
         return evalFn(INPUT_BUFFER_OFFSET);
     }
 
+    // Start a time-sliced evaluation; returns its handle
+    function startLisp(code, sliceSteps) {
+        const bytes = new TextEncoder().encode(code + '\0');
+        new Uint8Array(memory.buffer, INPUT_BUFFER_OFFSET, bytes.length).set(bytes);
+        return eval_start(INPUT_BUFFER_OFFSET, sliceSteps);
+    }
+
+    // Run function `name` over `records` (arrays of arguments); returns the results
+    function batchLisp(name, records) {
+        const bytes = new TextEncoder().encode(name + '\0');
+        new Uint8Array(memory.buffer, INPUT_BUFFER_OFFSET, bytes.length).set(bytes);
+        const h = batch_compile(INPUT_BUFFER_OFFSET);
+        if (h < 0) return null;
+        const arity = batch_arity(h);
+        const args = batch_input(h, records.length);
+        new Int32Array(memory.buffer, args, records.length * arity).set(records.flat());
+        const out = batch_run(h, records.length);
+        const results = Array.from(new Int32Array(memory.buffer, out, records.length));
+        batch_free(h);
+        return results;
+    }
+
+    // Evaluate `code` and decode its full value; `capacity` is the size of
+    // the first result region tried
+    const { decodeResult, formatResult } = require('./wasm_result');
+    function evalValue(code, capacity = 256) {
+        const bytes = new TextEncoder().encode(code + '\0');
+        new Uint8Array(memory.buffer, INPUT_BUFFER_OFFSET, bytes.length).set(bytes);
+        let out = buffer_alloc(capacity);
+        const n = eval_encoded(INPUT_BUFFER_OFFSET, out, capacity);
+        if (n > capacity) {
+            buffer_free(out);
+            out = buffer_alloc(n);
+            copy_result(out, n);
+        }
+        const value = decodeResult(new Uint8Array(memory.buffer, out, n));
+        buffer_free(out);
+        return value;
+    }
+
+    // A new instance, for tests that trap: a trap skips destructors, so the
+    // instance that trapped is not used again
+    function freshExports() {
+        const scratch = new WASI({ version: 'preview1' });
+        return new WebAssembly.Instance(module, { wasi_snapshot_preview1: scratch.wasiImport }).exports;
+    }
+
+    // Evaluate every expression of `exprs` in one eval_many call on
+    // `exports`; returns the results, null for those not evaluated. After a
+    // trap the output is read from memory, not through another call.
+    function evalMany(exprs, exports = instance.exports) {
+        const encoder = new TextEncoder();
+        const sources = exprs.map(e => encoder.encode(e));
+        const bytes = sources.reduce((n, s) => n + 4 + s.length, 0);
+        const ptr = exports.eval_many_input(bytes);
+        const view = new DataView(exports.memory.buffer, ptr, bytes);
+        const dest = new Uint8Array(exports.memory.buffer, ptr, bytes);
+        let pos = 0;
+        for (const s of sources) {
+            view.setUint32(pos, s.length, true);
+            dest.set(s, pos + 4);
+            pos += 4 + s.length;
+        }
+        const out = exports.eval_many_output(exprs.length);
+        try { exports.eval_many(exprs.length); } catch (e) { /* Statuses say how far it got */ }
+        const words = new Int32Array(exports.memory.buffer, out, 2 * exprs.length);
+        return exprs.map((_, i) => words[exprs.length + i] ? words[i] : null);
+    }
+
+    // Bring the incremental document up to date with `code`; returns
+    // { parsed, evaluated, values, rerun } for that update
+    function updateDoc(code) {
+        const bytes = new TextEncoder().encode(code + '\0');
+        new Uint8Array(memory.buffer, INPUT_BUFFER_OFFSET, bytes.length).set(bytes);
+        const n = doc_update(INPUT_BUFFER_OFFSET);
+        const forms = Array.from({ length: n }, (_, i) => i);
+        return {
+            parsed: doc_parsed(),
+            evaluated: doc_evaluated(),
+            values: forms.map(i => doc_value(i)).join(','),
+            rerun: forms.filter(i => doc_reevaluated(i)).join(','),
+        };
+    }
+
     // Test runner with colored output
     let passed = 0;
     let failed = 0;
@@ -64,6 +158,18 @@ async function runTests() {
         }
     }
 
+    async function testAsync(name, fn) {
+        try {
+            await fn();
+            console.log(`\x1b[32m  PASS\x1b[0m ${name}`);
+            passed++;
+        } catch (e) {
+            console.log(`\x1b[31m  FAIL\x1b[0m ${name}`);
+            console.log(`       Expected: ${e.expected}, Actual: ${e.actual || e.message}`);
+            failed++;
+        }
+    }
+
     function assertEqual(actual, expected, message) {
         if (actual !== expected) {
             const err = new Error(message || `${actual} !== ${expected}`);
@@ -211,6 +317,203 @@ async function runTests() {
         assertEqual(fn_count(), 1);
     });
 
+    // --- Time-Sliced Evaluation ---
+    console.log('\nTime-Sliced Evaluation:');
+    reset_env();
+    evalLisp('(defun fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))');
+    test('sliced (fib 15) = 610 over many slices', () => {
+        const h = startLisp('(fib 15)', 100);
+        let slices = 1;
+        while (!eval_step(h)) slices++;
+        assertEqual(eval_result(h), 610);
+        assertEqual(slices > 10, true);
+    });
+    test('interleaved evaluations finish independently', () => {
+        const a = startLisp('(fib 12)', 50);
+        const b = startLisp('(* 6 7)', 50);
+        let doneA = 0, doneB = 0;
+        while (!doneA || !doneB) {
+            if (!doneA) doneA = eval_step(a);
+            if (!doneB) doneB = eval_step(b);
+        }
+        assertEqual(eval_result(b), 42);
+        assertEqual(eval_result(a), 144);
+    });
+    test('sliced defun is visible to eval', () => {
+        const h = startLisp('(defun sq (x) (* x x)) (sq 9)', 10);
+        while (!eval_step(h)) {}
+        assertEqual(eval_result(h), 81);
+        assertEqual(evalLisp('(sq 3)'), 9);
+    });
+    test('released handle is rejected', () => {
+        const h = startLisp('(+ 1 2)', 10);
+        while (!eval_step(h)) {}
+        eval_result(h);
+        assertEqual(eval_step(h), -1);
+    });
+
+    // --- Batch Evaluation ---
+    console.log('\nBatch Evaluation:');
+    reset_env();
+    evalLisp('(defun fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))');
+    evalLisp('(defun pick (a b c) (if (> a b) (* c 2) (- c a)))');
+    test('batch fib over 0..15', () => {
+        const results = batchLisp('fib', Array.from({ length: 16 }, (_, n) => [n]));
+        assertEqual(results.join(','), '0,1,1,2,3,5,8,13,21,34,55,89,144,233,377,610');
+    });
+    test('batch results match eval for a 3-argument rule', () => {
+        const records = [[5, 2, 10], [1, 9, 4], [-3, -3, 7], [100, 0, -1]];
+        const results = batchLisp('pick', records);
+        records.forEach((r, i) => assertEqual(results[i], evalLisp(`(pick ${r.join(' ')})`)));
+    });
+    test('unknown function gives no handle', () => {
+        assertEqual(batchLisp('nosuchfn', [[1]]), null);
+    });
+
+    // --- Incremental Documents ---
+    console.log('\nIncremental Documents:');
+    reset_env();
+    const doc = [
+        '(defun sq (x) (* x x))',
+        '(defun quad (x) (sq (sq x)))',
+        '(defun inc (x) (+ x 1))',
+        '(quad 2)',
+        '(inc 41)',
+        '(* 6 7)',
+    ];
+    test('first update evaluates every form', () => {
+        const r = updateDoc(doc.join('\n'));
+        assertEqual(r.parsed, 6);
+        assertEqual(r.values, '0,0,0,16,42,42');
+    });
+    test('unchanged text evaluates nothing', () => {
+        const r = updateDoc(doc.join('\n'));
+        assertEqual(r.parsed, 0);
+        assertEqual(r.evaluated, 0);
+    });
+    test('editing sq re-runs sq and (quad 2) only', () => {
+        const edited = doc.slice();
+        edited[0] = '(defun sq (x) (* x 3))';
+        const r = updateDoc(edited.join('\n'));
+        assertEqual(r.parsed, 1);
+        assertEqual(r.rerun, '0,3');
+        assertEqual(r.values, '0,0,0,18,42,42');
+    });
+    test('a new form is the only one evaluated', () => {
+        const r = updateDoc(doc.concat(['(inc 1)']).join('\n'));
+        assertEqual(r.rerun, '0,3,6');  // sq changed back, so (quad 2) runs again
+        assertEqual(r.values, '0,0,0,16,42,42,2');
+    });
+
+    // --- Batched Eval ---
+    console.log('\nBatched Eval:');
+    reset_env();
+    test('results match per-call eval, in order', () => {
+        const exprs = ['(defun sq (x) (* x x))', '(sq 9)', '(+ 1 2 3)', "'(1 2)", '(sq (sq 2))', '(- 5)'];
+        const batched = evalMany(exprs);
+        reset_env();
+        assertEqual(batched.join(','), exprs.map(e => evalLisp(e)).join(','));
+        assertEqual(batched.join(','), '0,81,6,0,16,-5');
+    });
+    test('a failing expression stops the batch; earlier results are kept', () => {
+        const exprs = ['(defun sq (x) (* x x))', '(sq 3)', '(car 5)', '(* 2 3)'];
+        assertEqual(evalMany(exprs, freshExports()).join(','), '0,9,,');
+        assertEqual(evalMany(['(car 1)'], freshExports()).join(','), '');
+    });
+    test('the rest of a failed batch runs on a fresh instance', () => {
+        const exprs = ['(+ 1 2)', '(undefined-fn 1)', '(- 10 4)', '(* 2 3)'];
+        const first = evalMany(exprs, freshExports());
+        const failed = first.indexOf(null);
+        assertEqual(failed, 1);
+        const rest = evalMany(exprs.slice(failed + 1), freshExports());
+        assertEqual(first.slice(0, failed).concat([null], rest).join(','), '3,,6,6');
+    });
+    test('an empty batch returns nothing', () => {
+        assertEqual(evalMany([]).length, 0);
+    });
+    test('100k expressions: per-call vs batched', () => {
+        const exprs = Array.from({ length: 100000 }, (_, i) => `(+ ${i} (* 2 3))`);
+        let start = process.hrtime.bigint();
+        const single = exprs.map(e => evalLisp(e));
+        const perCall = Number(process.hrtime.bigint() - start) / 1e6;
+        start = process.hrtime.bigint();
+        const batched = evalMany(exprs);
+        const many = Number(process.hrtime.bigint() - start) / 1e6;
+        console.log(`       per-call ${perCall.toFixed(0)} ms, batched ${many.toFixed(0)} ms ` +
+                    `(${(perCall / many).toFixed(1)}x)`);
+        assertEqual(batched.join(','), single.join(','));
+        assertEqual(batched[99999], 99999 + 6);
+    });
+
+    // --- Structured Results ---
+    console.log('\nStructured Results:');
+    reset_env();
+    test('numbers, symbols and lists come back whole', () => {
+        assertEqual(evalValue('(* 6 -7)'), -42);
+        assertEqual(evalValue('(defun sq (x) (* x x))'), 'sq');
+        assertEqual(evalValue('(sq 9)'), 81);
+        assertEqual(evalValue("'foo"), 'foo');
+        assertEqual(JSON.stringify(evalValue("'(1 (a b) () -3)")), '[1,["a","b"],[],-3]');
+        assertEqual(formatResult(evalValue("(cdr '(sq (x) y))")), '((x) y)');
+    });
+    test('a result larger than the region is copied by copy_result', () => {
+        const items = Array.from({ length: 300 }, (_, i) => i);
+        const value = evalValue(`(cdr '(${items.join(' ')}))`, 8);
+        assertEqual(value.join(','), items.slice(1).join(','));
+        assertEqual(fn_count(), 1);
+    });
+    test('deeply nested results decode without recursion', () => {
+        // "MLB1", symbol table ["x"], one form: 100k list-of-one tags, then x
+        const depth = 100000;
+        const bytes = new Uint8Array(4 + 3 + 1 + depth + 1);
+        bytes.set(new TextEncoder().encode('MLB1\x01\x01x\x01'));
+        bytes.fill((1 << 2) | 2, 8, 8 + depth);
+        bytes[8 + depth] = (0 << 2) | 1;
+        let value = decodeResult(bytes);
+        let levels = 0;
+        while (Array.isArray(value)) { value = value[0]; levels++; }
+        assertEqual(levels, depth);
+        assertEqual(value, 'x');
+        assertEqual(formatResult([[['x']]]), '(((x)))');
+        // Spacing depends on position in the list, not on the text so far
+        assertEqual(formatResult(['a(', 'b']), '(a( b)');
+        assertEqual(formatResult([[], ['(']]), '(() (())');
+    });
+
+    // --- Worker Pool ---
+    console.log('\nWorker Pool:');
+    const { LispPool } = require('./wasm_pool');
+    const pool = new LispPool(module, 3);
+    await testAsync('definitions reach every worker', async () => {
+        await pool.eval('(defun sq (x) (* x x))');
+        const values = await Promise.all([1, 2, 3, 4, 5, 6, 7, 8, 9].map(n => pool.eval(`(sq ${n})`)));
+        assertEqual(values.join(','), '1,4,9,16,25,36,49,64,81');
+    });
+    await testAsync('a trapping request rejects and its worker recovers', async () => {
+        let rejected = false;
+        try { await pool.eval('(car 5)'); } catch (e) { rejected = true; }
+        assertEqual(rejected, true);
+        const values = await Promise.all(Array.from({ length: 9 }, () => pool.eval('(sq 7)')));
+        assertEqual(values.every(v => v === 49), true);
+    });
+    await testAsync('definitions are logged before they are sent', async () => {
+        const applied = pool.eval('(defun cube (x) (* x (sq x)))');
+        assertEqual(pool.defs[pool.defs.length - 1], '(defun cube (x) (* x (sq x)))');
+        await applied;
+        const values = await Promise.all([1, 2, 3, 4, 5, 6].map(n => pool.eval(`(cube ${n})`)));
+        assertEqual(values.join(','), '1,8,27,64,125,216');
+    });
+    await testAsync('a failed definition is rolled back on every worker', async () => {
+        let rejected = false;
+        try { await pool.eval('(defun half x (/ x 2))'); } catch (e) { rejected = true; }
+        assertEqual(rejected, true);
+        assertEqual(pool.defs.some(d => d.includes('half')), false);
+        const results = await Promise.allSettled([1, 2, 3, 4, 5, 6].map(() => pool.eval('(half 8)')));
+        assertEqual(results.every(r => r.status === 'rejected'), true);
+        assertEqual(await pool.eval('(sq 5)'), 25);
+    });
+    await pool.close();
+
     // --- Summary ---
     console.log('\n=== Test Results ===');
     console.log(`\x1b[32m${passed} passed\x1b[0m, \x1b[31m${failed} failed\x1b[0m`);
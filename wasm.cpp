@@ -20,15 +20,11 @@
 #include "main.cpp"
 #include <cstdlib>
 
-// Lazy initialization to avoid WASM static init order issues
-static MiniLisp::FunctionStore* get_fn_store() {
-    static MiniLisp::FunctionStore store;
-    return &store;
-}
-
-static MiniLisp::Env* get_global_env() {
-    static MiniLisp::Env env(get_fn_store());
-    return &env;
+// The module instance is the isolate: one Context per instantiation.
+// Lazy initialization to avoid WASM static init order issues.
+static MiniLisp::Context* get_context() {
+    static MiniLisp::Context ctx;
+    return &ctx;
 }
 
 // Safe buffer offset - well beyond WASM data section
@@ -38,6 +34,18 @@ static constexpr long SAFE_BUFFER_OFFSET = 65536;
 // Track last input size for JS to query
 static long g_last_input_len = 0;
 
+// Evaluate the first form of `src`: its numeric result, or 0 for
+// non-numeric results (e.g., defun returns the function name)
+static long eval_numeric(std::string_view src) {
+    auto* ctx = get_context();
+    auto ast = MiniLisp::parse_interned(src, *ctx);
+    auto result = MiniLisp::eval_toplevel(ast, *ctx);
+    if (result.atom.has_value() && std::holds_alternative<long>(*result.atom)) {
+        return std::get<long>(*result.atom);
+    }
+    return 0;
+}
+
 extern "C" {
 
 // Return safe buffer offset for JavaScript to use
@@ -50,13 +58,13 @@ long get_buffer_offset() {
 // Count defined functions (useful for testing)
 __attribute__((export_name("fn_count")))
 long fn_count() {
-    return static_cast<long>(get_fn_store()->functions.size());
+    return static_cast<long>(get_context()->functions.size());
 }
 
 // Count interned symbols (useful for testing)
 __attribute__((export_name("sym_count")))
 long sym_count() {
-    return static_cast<long>(MiniLisp::get_symbol_table()->size());
+    return static_cast<long>(get_context()->symbols.size());
 }
 
 // Get last input length
@@ -67,29 +75,330 @@ long last_input_len() {
 
 // Evaluate Lisp expression with persistent environment
 // Returns the numeric result, or 0 for non-numeric results (like defun)
-// Uses parse_interned to ensure all symbols are stored in the global SymbolTable,
+// Uses parse_interned to ensure all symbols are stored in the context's SymbolTable,
 // so string_views remain valid even when the input buffer is reused.
 __attribute__((export_name("eval")))
 long eval_lisp(const char* input) {
     std::string_view sv(input);
     g_last_input_len = static_cast<long>(sv.size());
-    auto ast = MiniLisp::parse_interned(sv);
-    auto result = MiniLisp::eval_with_env(ast, *get_global_env());
+    return eval_numeric(sv);
+}
+
+// --- Batched eval ---
+// Many expressions per boundary crossing. The host writes them into a
+// module-owned input area, each as a 4-byte little-endian length followed
+// by that many bytes of source (no terminator):
+//
+//   const ptr = eval_many_input(bytes);          // room for `bytes` bytes
+//   new Uint8Array(memory.buffer, ptr, bytes).set(encoded);
+//   const out = eval_many_output(count);         // 2 * count words
+//   eval_many(count);                            // returns out
+//
+// The output holds count results, as eval returns them, then count status
+// words: 1 once that expression has been evaluated, 0 otherwise. A failing
+// expression traps the whole call (the WASM build has no exceptions), and a
+// trap skips destructors, so the instance must be replaced afterwards, as
+// with eval. The output is in place before evaluation starts: the host can
+// still read the results before the failure from memory (without calling
+// into the trapped instance) and re-send the rest to a fresh instance.
+static std::vector<char>& many_input() {
+    static std::vector<char> buffer;
+    return buffer;
+}
+
+static std::vector<long>& many_output() {
+    static std::vector<long> buffer;
+    return buffer;
+}
+
+// Input area of `bytes` bytes, filled by the host before eval_many
+__attribute__((export_name("eval_many_input")))
+char* eval_many_input(long bytes) {
+    if (bytes < 0) return nullptr;
+    many_input().resize(static_cast<size_t>(bytes));
+    return many_input().data();
+}
+
+// Output area for `count` expressions, all marked not evaluated. eval_many
+// with the same count writes to it without moving it.
+__attribute__((export_name("eval_many_output")))
+long* eval_many_output(long count) {
+    if (count < 0) return nullptr;
+    many_output().assign(2 * static_cast<size_t>(count), 0);
+    return many_output().data();
+}
+
+// Evaluate the first `count` expressions of the input area; returns the
+// results followed by their status words
+__attribute__((export_name("eval_many")))
+long* eval_many(long count) {
+    long* out = eval_many_output(count);  // Same capacity: same address
+    if (!out) return nullptr;
+    const auto& in = many_input();
+    size_t n = static_cast<size_t>(count);
+    size_t pos = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t len = 0;
+        MiniLisp::p_assert(in.size() - pos >= 4, "Truncated expression batch");
+        std::memcpy(&len, in.data() + pos, 4);
+        MiniLisp::p_assert(len <= in.size() - pos - 4, "Truncated expression batch");
+        std::string_view src(in.data() + pos + 4, len);
+        pos += 4 + len;
+        out[i] = eval_numeric(src);
+        out[n + i] = 1;
+    }
+    g_last_input_len = static_cast<long>(pos);
+    return out;
+}
+
+// --- Structured results ---
+// eval collapses every non-number to 0. eval_encoded writes the whole
+// value - numbers, symbols, nested lists - to a region the host provides,
+// in the binary S-expression format (encode_binary; decodeResult in
+// wasm_result.js reads it):
+//
+//   const out = buffer_alloc(capacity);             // once, reused
+//   let n = eval_encoded(ptr, out, capacity);       // encoded size
+//   if (n > capacity) copy_result(bigger, n);       // Too small: copy again, don't re-run
+//   const value = decodeResult(new Uint8Array(memory.buffer, out, n));
+static std::string g_result;  // Last encoded value, for copy_result
+
+// Copy the last encoded value to `out` if it fits in `capacity` bytes;
+// returns its size either way
+__attribute__((export_name("copy_result")))
+long copy_result(unsigned char* out, long capacity) {
+    if (capacity >= 0 && g_result.size() <= static_cast<size_t>(capacity)) {
+        std::memcpy(out, g_result.data(), g_result.size());
+    }
+    return static_cast<long>(g_result.size());
+}
+
+// Evaluate the first form of `input` and write its encoded value to `out`
+// (see copy_result)
+__attribute__((export_name("eval_encoded")))
+long eval_encoded(const char* input, unsigned char* out, long capacity) {
+    std::string_view sv(input);
+    g_last_input_len = static_cast<long>(sv.size());
+    auto* ctx = get_context();
+    auto ast = MiniLisp::parse_interned(sv, *ctx);
+    auto result = MiniLisp::eval_toplevel(ast, *ctx);
+    g_result = MiniLisp::encode_binary(std::span<const MiniLisp::SExpr>(&result, 1));
+    return copy_result(out, capacity);
+}
 
-    // Return long for numeric results
-    if (result.atom.has_value()) {
-        if (std::holds_alternative<long>(*result.atom)) {
-            return std::get<long>(*result.atom);
+// Host-owned regions of linear memory, e.g. for eval_encoded results
+__attribute__((export_name("buffer_alloc")))
+void* buffer_alloc(long bytes) {
+    return bytes > 0 ? malloc(static_cast<size_t>(bytes)) : nullptr;
+}
+
+__attribute__((export_name("buffer_free")))
+void buffer_free(void* p) {
+    free(p);
+}
+
+// --- Time-sliced evaluation ---
+// Long computations can be run a slice at a time so the host's event loop
+// stays responsive, and several evaluations can be interleaved:
+//
+//   const h = eval_start(ptr, 10000);     // copies the input
+//   while (!eval_step(h)) await nextTick();
+//   const value = eval_result(h);         // releases h
+static std::vector<std::unique_ptr<MiniLisp::SlicedEval>>& sliced_evals() {
+    static std::vector<std::unique_ptr<MiniLisp::SlicedEval>> evals;
+    return evals;
+}
+
+static MiniLisp::SlicedEval* sliced_eval(long handle) {
+    auto& evals = sliced_evals();
+    if (handle < 0 || static_cast<size_t>(handle) >= evals.size()) return nullptr;
+    return evals[static_cast<size_t>(handle)].get();
+}
+
+// Begin evaluating every form in `input`, suspending every `slice_steps`
+// reduction steps. Nothing runs until eval_step. Returns a handle.
+__attribute__((export_name("eval_start")))
+long eval_start(const char* input, long slice_steps) {
+    std::string_view sv(input);
+    g_last_input_len = static_cast<long>(sv.size());
+    auto ev = std::make_unique<MiniLisp::SlicedEval>(
+        sv, *get_context(), static_cast<size_t>(slice_steps > 0 ? slice_steps : 1));
+    auto& evals = sliced_evals();
+    for (size_t i = 0; i < evals.size(); ++i) {
+        if (!evals[i]) {
+            evals[i] = std::move(ev);
+            return static_cast<long>(i);
         }
     }
-    // Non-numeric result (e.g., defun returns function name)
+    evals.push_back(std::move(ev));
+    return static_cast<long>(evals.size() - 1);
+}
+
+// Run one slice. Returns 1 when finished, 0 if more slices are needed,
+// -1 for an unknown handle.
+__attribute__((export_name("eval_step")))
+long eval_step(long handle) {
+    auto* ev = sliced_eval(handle);
+    if (!ev) return -1;
+    return ev->step() ? 1 : 0;
+}
+
+// Numeric result of a finished evaluation (0 for non-numeric results, as
+// with eval) and release its handle. Abandons the evaluation if unfinished.
+__attribute__((export_name("eval_result")))
+long eval_result(long handle) {
+    auto* ev = sliced_eval(handle);
+    if (!ev) return 0;
+    long value = 0;
+    if (ev->done()) {
+        auto result = ev->result();
+        if (result.atom.has_value() && std::holds_alternative<long>(*result.atom)) {
+            value = std::get<long>(*result.atom);
+        }
+    }
+    sliced_evals()[static_cast<size_t>(handle)].reset();
+    return value;
+}
+
+// --- Batch evaluation ---
+// One defun over many records, with one boundary crossing per batch rather
+// than an encoded string and an eval call per record:
+//
+//   const h = batch_compile(namePtr);           // -1: no such function
+//   const args = batch_input(h, n);             // room for n * batch_arity(h)
+//   new Int32Array(memory.buffer, args, n * arity).set(records);
+//   const out = batch_run(h, n);                // n results, until the next run
+//   batch_free(h);
+//
+// A failing record traps, as eval does.
+struct WasmBatch {
+    MiniLisp::BatchProgram program;
+    std::vector<long> args;
+    std::vector<long> out;
+};
+
+static std::vector<std::unique_ptr<WasmBatch>>& batches() {
+    static std::vector<std::unique_ptr<WasmBatch>> list;
+    return list;
+}
+
+static WasmBatch* batch(long handle) {
+    auto& list = batches();
+    if (handle < 0 || static_cast<size_t>(handle) >= list.size()) return nullptr;
+    return list[static_cast<size_t>(handle)].get();
+}
+
+// Compile the function named by `name` for batch runs. Returns a handle, or
+// -1 if it isn't defined.
+__attribute__((export_name("batch_compile")))
+long batch_compile(const char* name) {
+    std::string_view sv(name);
+    g_last_input_len = static_cast<long>(sv.size());
+    auto* ctx = get_context();
+    if (!ctx->functions.lookup(sv)) return -1;
+    auto b = std::unique_ptr<WasmBatch>(new WasmBatch{MiniLisp::BatchProgram(*ctx, sv), {}, {}});
+    auto& list = batches();
+    for (size_t i = 0; i < list.size(); ++i) {
+        if (!list[i]) {
+            list[i] = std::move(b);
+            return static_cast<long>(i);
+        }
+    }
+    list.push_back(std::move(b));
+    return static_cast<long>(list.size() - 1);
+}
+
+// Arguments per record, or -1 for an unknown handle
+__attribute__((export_name("batch_arity")))
+long batch_arity(long handle) {
+    auto* b = batch(handle);
+    return b ? static_cast<long>(b->program.arity()) : -1;
+}
+
+// Input area for `count` records, filled by the host before batch_run
+__attribute__((export_name("batch_input")))
+long* batch_input(long handle, long count) {
+    auto* b = batch(handle);
+    if (!b || count < 0) return nullptr;
+    b->args.resize(static_cast<size_t>(count) * b->program.arity());
+    return b->args.data();
+}
+
+// Evaluate the first `count` records of the input area; returns the results
+__attribute__((export_name("batch_run")))
+long* batch_run(long handle, long count) {
+    auto* b = batch(handle);
+    if (!b || count < 0) return nullptr;
+    size_t n = static_cast<size_t>(count);
+    MiniLisp::p_assert(n * b->program.arity() <= b->args.size(), "Batch input too small");
+    b->out.resize(n);
+    b->program.run(std::span<const long>(b->args.data(), n * b->program.arity()), b->out);
+    return b->out.data();
+}
+
+__attribute__((export_name("batch_free")))
+void batch_free(long handle) {
+    if (batch(handle)) batches()[static_cast<size_t>(handle)].reset();
+}
+
+// --- Incremental documents ---
+// The playground's editor sends its whole text on every run, but only the
+// forms it changed are parsed, and only they and the forms that depend on a
+// changed definition are evaluated (see LiveDocument):
+//
+//   const n = doc_update(ptr);            // number of top-level forms
+//   doc_parsed(); doc_evaluated();        // work done by that update
+//   doc_value(i); doc_reevaluated(i);     // form i: value, 1 if it just ran
+static MiniLisp::LiveDocument& document() {
+    static MiniLisp::LiveDocument doc(*get_context());
+    return doc;
+}
+
+static MiniLisp::LiveDocument::Stats g_doc_stats;
+
+__attribute__((export_name("doc_update")))
+long doc_update(const char* input) {
+    std::string_view sv(input);
+    g_last_input_len = static_cast<long>(sv.size());
+    g_doc_stats = document().update(sv);
+    return static_cast<long>(g_doc_stats.forms);
+}
+
+__attribute__((export_name("doc_parsed")))
+long doc_parsed() {
+    return static_cast<long>(g_doc_stats.parsed);
+}
+
+__attribute__((export_name("doc_evaluated")))
+long doc_evaluated() {
+    return static_cast<long>(g_doc_stats.evaluated);
+}
+
+// Numeric value of form `i` (0 for non-numeric results, as with eval)
+__attribute__((export_name("doc_value")))
+long doc_value(long i) {
+    const auto& forms = document().forms();
+    if (i < 0 || static_cast<size_t>(i) >= forms.size()) return 0;
+    const auto& value = forms[static_cast<size_t>(i)].value;
+    if (value.atom.has_value() && std::holds_alternative<long>(*value.atom)) {
+        return std::get<long>(*value.atom);
+    }
     return 0;
 }
 
-// Reset the global environment (clear all function definitions)
+// 1 if form `i` was evaluated by the last doc_update, else 0
+__attribute__((export_name("doc_reevaluated")))
+long doc_reevaluated(long i) {
+    const auto& forms = document().forms();
+    if (i < 0 || static_cast<size_t>(i) >= forms.size()) return 0;
+    return forms[static_cast<size_t>(i)].evaluated ? 1 : 0;
+}
+
+// Reset the environment (clear all function definitions and the document)
 __attribute__((export_name("reset_env")))
 void reset_env() {
-    get_global_env()->clear();
+    get_context()->reset();
+    document().clear();
 }
 
 } // extern "C"
@@ -99,5 +408,5 @@ void* operator new(size_t size) { return malloc(size); }
 void* operator new[](size_t size) { return malloc(size); }
 void operator delete(void* p) noexcept { free(p); }
 void operator delete[](void* p) noexcept { free(p); }
-void operator delete(void*, size_t) noexcept {}
-void operator delete[](void*, size_t) noexcept {}
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
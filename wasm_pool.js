@@ -0,0 +1,211 @@
+// wasm_pool.js - Worker-thread pool for the WASM build under Node.js
+// =============================================================================
+// Library use:
+//   const { LispPool } = require('./wasm_pool');
+//   const pool = await LispPool.create(4);            // 4 worker threads
+//   await pool.eval('(defun sq (x) (* x x))');        // applied on every worker
+//   const [a, b] = await Promise.all([pool.eval('(sq 3)'), pool.eval('(sq 4)')]);
+//   await pool.close();
+//
+// Benchmark, throughput vs worker count (make bench-wasm):
+//   node wasm_pool.js [requests] [max_workers] [fib_n]
+//
+// lisp.wasm is compiled once and instantiated in every worker, so each worker
+// is an isolated interpreter with its own linear memory. As with EvalService
+// in main.cpp:
+// - eval requests go to the worker with the fewest outstanding requests;
+// - a request whose first form is a defun goes to every worker, behind the
+//   requests already queued there, so every request submitted after it sees
+//   it. Definitions are logged before they are sent and replayed into
+//   workers as they start, so a worker replaced mid-broadcast has them too;
+// - an error traps the instance (the WASM build has no exceptions). The
+//   request's promise rejects, and the worker replaces its instance and
+//   replays its definitions before serving the next request. A definition
+//   that fails on any worker is taken out of the log and every worker
+//   reloads from the log, so none of them keeps it.
+// =============================================================================
+'use strict';
+
+const fs = require('fs');
+const os = require('os');
+const { WASI } = require('wasi');
+const { Worker, isMainThread, parentPort, workerData } = require('worker_threads');
+
+// Does the first form define a function? (is_definition in main.cpp)
+function isDefinition(code) {
+    return /^[ \t\n]*\(defun[ \t\n]/.test(code);
+}
+
+// --- Worker thread ---
+function runWorker({ module, defs }) {
+    const encoder = new TextEncoder();
+    let exports;
+
+    function evalLisp(code) {
+        const offset = exports.get_buffer_offset();
+        const bytes = encoder.encode(code + '\0');
+        new Uint8Array(exports.memory.buffer, offset, bytes.length).set(bytes);
+        return exports.eval(offset);
+    }
+
+    // Fresh interpreter with every definition applied so far. One that traps
+    // on replay is dropped and the replay starts over without it.
+    function instantiate() {
+        for (;;) {
+            const wasi = new WASI({ version: 'preview1' });
+            exports = new WebAssembly.Instance(module, { wasi_snapshot_preview1: wasi.wasiImport }).exports;
+            const failed = defs.findIndex(def => {
+                try { evalLisp(def); return false; } catch (e) { return true; }
+            });
+            if (failed < 0) return;
+            defs.splice(failed, 1);
+        }
+    }
+
+    instantiate();
+    parentPort.on('message', ({ id, code, define, reload }) => {
+        if (reload) {  // Start over from the pool's log (no reply)
+            defs = reload;
+            instantiate();
+            return;
+        }
+        try {
+            const value = evalLisp(code);
+            if (define) defs.push(code);
+            parentPort.postMessage({ id, ok: true, value });
+        } catch (e) {
+            // The trap may have left the instance mid-update
+            instantiate();
+            parentPort.postMessage({ id, ok: false, error: String(e && e.message || e) });
+        }
+    });
+}
+
+// --- Pool (main thread) ---
+class LispPool {
+    static async create(size = defaultWorkers(), wasmPath = './lisp.wasm') {
+        const module = await WebAssembly.compile(fs.readFileSync(wasmPath));
+        return new LispPool(module, size);
+    }
+
+    constructor(module, size = defaultWorkers()) {
+        this.module = module;
+        this.defs = [];            // Definitions in order, from when they are sent
+        this.pending = new Map();  // Request id -> { resolve, reject, worker }
+        this.nextId = 1;
+        this.workers = [];
+        for (let i = 0; i < Math.max(1, size); i++) this.workers.push(this.spawn());
+    }
+
+    get size() { return this.workers.length; }
+
+    // Evaluate `code` on one worker (all of them for a definition); resolves
+    // with the numeric result, rejects if evaluation trapped
+    eval(code) {
+        if (!isDefinition(code)) {
+            let best = this.workers[0];
+            for (const w of this.workers) {
+                if (w.outstanding < best.outstanding) best = w;
+            }
+            return this.send(best, code, false);
+        }
+        // Logged first: a worker spawned before every reply is in replays it
+        this.defs.push(code);
+        const applied = this.workers.map(w => this.send(w, code, true));
+        return Promise.all(applied).then(values => values[0], e => {
+            // Failed somewhere: roll it back on the workers that applied it
+            this.defs.splice(this.defs.lastIndexOf(code), 1);
+            for (const w of this.workers) w.thread.postMessage({ reload: this.defs.slice() });
+            throw e;
+        });
+    }
+
+    async close() {
+        const workers = this.workers;
+        this.workers = [];
+        await Promise.all(workers.map(w => w.thread.terminate()));
+    }
+
+    spawn() {
+        const thread = new Worker(__filename, {
+            workerData: { lispPoolWorker: true, module: this.module, defs: this.defs.slice() },
+        });
+        const w = { thread, outstanding: 0 };
+        thread.on('message', ({ id, ok, value, error }) => {
+            const request = this.pending.get(id);
+            this.pending.delete(id);
+            w.outstanding--;
+            if (ok) {
+                request.resolve(value);
+            } else {
+                request.reject(new Error(error));
+            }
+        });
+        // The thread itself died: fail its requests and replace it
+        thread.on('error', e => {
+            for (const [id, request] of this.pending) {
+                if (request.worker !== w) continue;
+                this.pending.delete(id);
+                request.reject(e);
+            }
+            const index = this.workers.indexOf(w);
+            if (index >= 0) this.workers[index] = this.spawn();
+        });
+        return w;
+    }
+
+    send(w, code, define) {
+        const id = this.nextId++;
+        w.outstanding++;
+        return new Promise((resolve, reject) => {
+            this.pending.set(id, { resolve, reject, worker: w });
+            w.thread.postMessage({ id, code, define });
+        });
+    }
+}
+
+function defaultWorkers() {
+    return os.availableParallelism ? os.availableParallelism() : os.cpus().length;
+}
+
+// --- Benchmark ---
+async function benchmark(requests, maxWorkers, fibN) {
+    const module = await WebAssembly.compile(fs.readFileSync('./lisp.wasm'));
+    const call = `(fib ${fibN})`;
+    const counts = [];
+    for (let n = 1; n < maxWorkers; n *= 2) counts.push(n);
+    counts.push(maxWorkers);
+
+    console.log(`wasm pool: ${requests} x ${call}`);
+    console.log('workers'.padStart(8) + 'req/s'.padStart(12) + 'speedup'.padStart(10));
+    let base = 0;
+    for (const n of counts) {
+        const pool = new LispPool(module, n);
+        await pool.eval('(defun fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))');
+        await Promise.all(pool.workers.map(() => pool.eval(call)));  // Warm up
+        const start = process.hrtime.bigint();
+        await Promise.all(Array.from({ length: requests }, () => pool.eval(call)));
+        const secs = Number(process.hrtime.bigint() - start) / 1e9;
+        await pool.close();
+        const rate = requests / secs;
+        if (!base) base = rate;
+        console.log(String(n).padStart(8) + rate.toFixed(0).padStart(12) +
+                    (rate / base).toFixed(2).padStart(9) + 'x');
+    }
+}
+
+if (!isMainThread && workerData && workerData.lispPoolWorker) {
+    runWorker(workerData);
+} else if (isMainThread && require.main === module) {
+    const [requests = 2000, maxWorkers = defaultWorkers(), fibN = 18] = process.argv.slice(2).map(Number);
+    if (!fs.existsSync('./lisp.wasm')) {
+        console.error('Error: lisp.wasm not found. Run "make wasm" first.');
+        process.exit(1);
+    }
+    benchmark(requests, maxWorkers, fibN).catch(e => {
+        console.error('Benchmark error:', e);
+        process.exit(1);
+    });
+}
+
+module.exports = { LispPool, isDefinition };
@@ -0,0 +1,118 @@
+// wasm_result.js - Decoder for values returned by eval_encoded (wasm.cpp)
+// =============================================================================
+//   const { decodeResult, formatResult } = require('./wasm_result');
+//   const value = decodeResult(new Uint8Array(memory.buffer, out, n));
+//   formatResult(value);   // "(1 (a b) ())"
+//
+// Values use the binary S-expression format from main.cpp (encode_binary):
+// the magic "MLB1", a symbol table (varint count, then varint length and
+// bytes per name) and a varint form count (1 here). Each node is one varint
+// tag whose low two bits are the kind: 0 a zigzag integer in the rest of the
+// tag, 1 a symbol index, 2 a list length followed by its elements, 3 a
+// zigzag integer in the following varint.
+//
+// Numbers decode to numbers, symbols to strings and lists to arrays. Lists
+// are rebuilt with an explicit stack, so any depth is fine. In a page,
+// include this file with a <script> tag; the functions become globals.
+// =============================================================================
+'use strict';
+
+const RESULT_MAGIC = 'MLB1';
+
+// Bounds-checked reader over the encoded bytes
+class ResultReader {
+    constructor(bytes) {
+        this.bytes = bytes;
+        this.pos = 0;
+    }
+
+    // Unsigned LEB128; exact up to 2^53
+    varint() {
+        let value = 0;
+        for (let scale = 1; this.pos < this.bytes.length; scale *= 128) {
+            const b = this.bytes[this.pos++];
+            value += (b & 0x7f) * scale;
+            if (b < 0x80) return value;
+        }
+        throw new Error('Truncated result');
+    }
+
+    text(length) {
+        if (length > this.bytes.length - this.pos) throw new Error('Truncated result');
+        const s = new TextDecoder().decode(this.bytes.subarray(this.pos, this.pos + length));
+        this.pos += length;
+        return s;
+    }
+}
+
+function unzigzag(v) {
+    return v % 2 === 0 ? v / 2 : -(v + 1) / 2;
+}
+
+// The value encoded in `bytes` (a Uint8Array)
+function decodeResult(bytes) {
+    const r = new ResultReader(bytes);
+    if (r.text(RESULT_MAGIC.length) !== RESULT_MAGIC) throw new Error('Not an encoded result');
+    const symbols = Array.from({ length: r.varint() }, () => r.text(r.varint()));
+    if (r.varint() !== 1) throw new Error('Expected one value');
+
+    const open = [];  // Lists being filled: { list, remaining }
+    while (true) {
+        const tag = r.varint();
+        const kind = tag % 4;
+        const rest = Math.floor(tag / 4);
+        let value;
+        if (kind === 0) {
+            value = unzigzag(rest);
+        } else if (kind === 1) {
+            if (rest >= symbols.length) throw new Error('Bad symbol index in result');
+            value = symbols[rest];
+        } else if (kind === 2 && rest > 0) {
+            open.push({ list: [], remaining: rest });
+            continue;
+        } else if (kind === 2) {
+            value = [];
+        } else {
+            value = unzigzag(r.varint());
+        }
+        // Close every list this value completes
+        while (open.length) {
+            const top = open[open.length - 1];
+            top.list.push(value);
+            if (--top.remaining > 0) break;
+            value = top.list;
+            open.pop();
+        }
+        if (!open.length) return value;
+    }
+}
+
+// A decoded value printed as Lisp, e.g. [1, ['a', 'b'], []] -> "(1 (a b) ())"
+function formatResult(value) {
+    if (!Array.isArray(value)) return String(value);
+    const END = {};  // Marks a list's end on the stack
+    let out = '';
+    let first = true;  // The next value is the first in its list
+    const todo = [value];  // Values still to print
+    while (todo.length) {
+        const v = todo.pop();
+        if (v === END) {
+            out += ')';
+            first = false;
+            continue;
+        }
+        if (!first) out += ' ';
+        if (!Array.isArray(v)) {
+            out += String(v);
+            first = false;
+            continue;
+        }
+        out += '(';
+        first = true;
+        todo.push(END);
+        for (let i = v.length - 1; i >= 0; i--) todo.push(v[i]);
+    }
+    return out;
+}
+
+if (typeof module !== 'undefined') module.exports = { decodeResult, formatResult };